@@ -0,0 +1,114 @@
+#include "asynclog.h"
+#include <bit>
+#include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/sinks/stdout_sinks.h>
+#include <spdlog/spdlog.h>
+
+// 队列容量，每个条目自带约250字节的内联缓冲区
+constexpr size_t QUEUE_CAPACITY = 4096;
+
+AsyncSink::AsyncSink(std::vector<spdlog::sink_ptr> sinks, size_t capacity,
+                     LogOverflow overflow)
+    : m_sinks(std::move(sinks)), m_overflow(overflow),
+      m_queue(std::bit_ceil(capacity)), m_thread([this]() { run(); }) {}
+
+AsyncSink::~AsyncSink() {
+    m_stop.store(true);
+    wakeup();
+    m_thread.join();
+}
+
+void AsyncSink::log(const spdlog::details::log_msg &msg) {
+    spdlog::details::log_msg_buffer record(msg);
+    while (!m_queue.push(std::move(record))) {
+        if (m_overflow == LogOverflow::DropNewest) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (m_overflow == LogOverflow::DropOldest) {
+            spdlog::details::log_msg_buffer oldest;
+            if (m_queue.pop(oldest)) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            continue;
+        }
+        // Block：等写日志线程腾出空间
+        wakeup();
+        std::this_thread::yield();
+    }
+    wakeup();
+}
+
+void AsyncSink::wakeup() {
+    // 与run()中的栅栏配对：要么这里看到对方在睡眠，要么对方看到新的条目
+    // 由清掉睡眠标志的一方负责唤醒，对方醒来之前的后续日志不再重复系统调用
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed) &&
+        m_sleeping.exchange(false, std::memory_order_relaxed)) {
+        m_epoch.fetch_add(1, std::memory_order_release);
+        m_epoch.notify_one();
+    }
+}
+
+void AsyncSink::run() {
+    spdlog::details::log_msg_buffer record;
+    for (;;) {
+        bool wrote = false;
+        while (m_queue.pop(record)) {
+            for (auto &sink : m_sinks) {
+                if (sink->should_log(record.level)) sink->log(record);
+            }
+            wrote = true;
+        }
+        // 队列清空时统一刷新，批量写入
+        if (wrote) {
+            for (auto &sink : m_sinks) { sink->flush(); }
+        }
+        if (m_stop.load()) {
+            if (m_queue.empty()) return;
+            continue;
+        }
+        uint32_t epoch = m_epoch.load(std::memory_order_acquire);
+        m_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_queue.empty() && !m_stop.load()) m_epoch.wait(epoch);
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+void AsyncSink::flush() {
+    for (auto &sink : m_sinks) { sink->flush(); }
+}
+
+void AsyncSink::set_pattern(const std::string &pattern) {
+    for (auto &sink : m_sinks) { sink->set_pattern(pattern); }
+}
+
+void AsyncSink::set_formatter(std::unique_ptr<spdlog::formatter> formatter) {
+    for (auto &sink : m_sinks) { sink->set_formatter(formatter->clone()); }
+}
+
+void setupLogging(const ServerConfig &config) {
+    auto console = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    auto async = std::make_shared<AsyncSink>(
+        std::vector<spdlog::sink_ptr>{console}, QUEUE_CAPACITY,
+        config.log_overflow);
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>("", async));
+    if (config.access_log.empty()) return;
+
+    spdlog::sink_ptr target;
+    if (config.access_log == "-") {
+        target = std::make_shared<spdlog::sinks::stdout_sink_mt>();
+    } else {
+        target = std::make_shared<spdlog::sinks::basic_file_sink_mt>(
+            config.access_log);
+    }
+    auto access = std::make_shared<spdlog::logger>(
+        ACCESS_LOGGER, std::make_shared<AsyncSink>(
+                      std::vector<spdlog::sink_ptr>{target}, QUEUE_CAPACITY,
+                      config.log_overflow));
+    // 每行一条记录：ISO 8601时间 + key=value字段
+    access->set_pattern("ts=%Y-%m-%dT%H:%M:%S.%f%z %v");
+    spdlog::register_logger(access);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "config.h"
+#include "mpmcqueue.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <spdlog/details/log_msg_buffer.h>
+#include <spdlog/logger.h>
+#include <spdlog/sinks/sink.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 异步日志sink：调用线程只把格式化好的正文复制进无锁环形队列，
+// 由专门的线程加上时间、级别等前缀并写入下游sink，调用方不做任何I/O
+class AsyncSink : public spdlog::sinks::sink {
+ public:
+    AsyncSink(std::vector<spdlog::sink_ptr> sinks, size_t capacity,
+              LogOverflow overflow);
+    AsyncSink(const AsyncSink &) = delete;
+    AsyncSink &operator=(const AsyncSink &) = delete;
+    // 写完队列中剩余的日志后退出
+    ~AsyncSink() override;
+
+    void log(const spdlog::details::log_msg &msg) override;
+    // 只刷新下游sink，不等待队列清空
+    void flush() override;
+    void set_pattern(const std::string &pattern) override;
+    void set_formatter(std::unique_ptr<spdlog::formatter> formatter) override;
+    // 因队列满而丢弃的日志条数
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+ private:
+    void run();
+    void wakeup();
+
+    const std::vector<spdlog::sink_ptr> m_sinks;
+    const LogOverflow m_overflow;
+    MpmcQueue<spdlog::details::log_msg_buffer> m_queue;
+    std::atomic<uint64_t> m_dropped = 0;
+    std::atomic<bool> m_stop = false;
+    // 写日志线程空闲时等待epoch变化
+    std::atomic<bool> m_sleeping = false;
+    std::atomic<uint32_t> m_epoch = 0;
+    std::thread m_thread;
+};
+
+// 访问日志器的名字，未配置访问日志时spdlog::get()返回空指针
+inline constexpr const char *ACCESS_LOGGER = "access";
+
+// 把默认日志器换成异步的，配置了访问日志时另外注册一个按行输出key=value的日志器
+// 访问日志文件无法打开时抛出spdlog::spdlog_ex
+void setupLogging(const ServerConfig &config);
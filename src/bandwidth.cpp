@@ -0,0 +1,102 @@
+#include "bandwidth.h"
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+// 每片传输的时长目标，片越小越平滑，但定时器和系统调用越多
+constexpr uint64_t SLICES_PER_SECOND = 50;
+constexpr size_t MIN_SLICE = 16 << 10;
+constexpr size_t MAX_SLICE = 1 << 20;
+// 桶容量对应的时长，空闲后最多可以突发这么久的流量
+constexpr uint64_t BURST_DIVISOR = 10;
+
+static uint64_t burstFor(uint64_t rate) {
+    return std::max<uint64_t>(rate / BURST_DIVISOR, MIN_SLICE);
+}
+
+static size_t sliceFor(const ServerConfig &config) {
+    uint64_t lowest = 0;
+    for (uint64_t rate : {config.session_rate, config.user_rate,
+                          config.global_rate}) {
+        if (rate != 0 && (lowest == 0 || rate < lowest)) lowest = rate;
+    }
+    if (lowest == 0) return MAX_SLICE;
+    return std::clamp<uint64_t>(lowest / SLICES_PER_SECOND, MIN_SLICE,
+                                MAX_SLICE);
+}
+
+TokenBucket::TokenBucket(uint64_t rate, uint64_t burst)
+    : m_rate(rate),
+      m_burst_ns(rate ? int64_t(burst * 1'000'000'000 / rate) : 0) {}
+
+TokenBucket::Clock::time_point TokenBucket::reserve(uint64_t bytes,
+                                                    Clock::time_point now) {
+    if (!limited()) return now;
+    using std::chrono::nanoseconds;
+    const int64_t now_ns = nanoseconds(now.time_since_epoch()).count();
+    const int64_t cost = int64_t(bytes * 1'000'000'000 / m_rate);
+    int64_t tat = m_tat.load(std::memory_order_relaxed);
+    int64_t next;
+    do {
+        // 空闲期间积累的令牌不超过桶容量
+        next = std::max(tat, now_ns - m_burst_ns) + cost;
+    } while (!m_tat.compare_exchange_weak(tat, next,
+                                          std::memory_order_relaxed));
+    // 令牌攒够之后才能开始传输
+    if (next <= now_ns) return now;
+    return Clock::time_point(nanoseconds(next));
+}
+
+BandwidthShaper::Buckets::Buckets(uint64_t rate, uint64_t burst)
+    : dir{TokenBucket(rate, burst), TokenBucket(rate, burst)} {}
+
+BandwidthShaper::BandwidthShaper(const ServerConfig &config)
+    : m_session_rate(config.session_rate), m_user_rate(config.user_rate),
+      m_global(config.global_rate, burstFor(config.global_rate)),
+      m_slice(sliceFor(config)) {
+    if (enabled()) {
+        spdlog::info("限速(字节/秒) 会话:{} 用户:{} 全局:{}，每片{}字节",
+                     m_session_rate, m_user_rate, config.global_rate, m_slice);
+    }
+}
+
+bool BandwidthShaper::enabled() const {
+    return m_session_rate || m_user_rate || m_global.dir[0].limited();
+}
+
+std::shared_ptr<BandwidthShaper::Buckets>
+BandwidthShaper::userBuckets(const std::string &user) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto &entry = m_users[user];
+    if (auto buckets = entry.lock()) return buckets;
+    // 最后一个会话释放时从表中移除；同名用户可能已经换上了新的桶
+    std::shared_ptr<Buckets> buckets(
+        new Buckets(m_user_rate, burstFor(m_user_rate)),
+        [this, user](Buckets *p) {
+            delete p;
+            std::lock_guard<std::mutex> lock(m_mtx);
+            auto it = m_users.find(user);
+            if (it != m_users.end() && it->second.expired()) m_users.erase(it);
+        });
+    entry = buckets;
+    return buckets;
+}
+
+BandwidthShaper::Flow::Flow(BandwidthShaper &shaper)
+    : m_shaper(shaper), m_limited(shaper.enabled()),
+      m_session(shaper.m_session_rate, burstFor(shaper.m_session_rate)) {}
+
+void BandwidthShaper::Flow::setUser(std::string_view user) {
+    if (m_shaper.m_user_rate == 0) return;
+    m_user = m_shaper.userBuckets(std::string(user));
+}
+
+size_t BandwidthShaper::Flow::acquire(bool upload, size_t want,
+                                      TokenBucket::Clock::time_point &ready) {
+    const size_t slice = std::min(want, m_shaper.m_slice);
+    const auto now = TokenBucket::Clock::now();
+    // 各层分别预约，最晚就绪的一层决定开始时间
+    ready = m_session.dir[upload].reserve(slice, now);
+    if (m_user) ready = std::max(ready, m_user->dir[upload].reserve(slice, now));
+    ready = std::max(ready, m_shaper.m_global.dir[upload].reserve(slice, now));
+    return slice;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "config.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// 令牌桶，用GCRA的理论到达时间(TAT)表示桶中的令牌
+// 状态只有一个原子变量，可以被多个反应堆线程无锁共享
+class TokenBucket {
+ public:
+    using Clock = std::chrono::steady_clock;
+    // rate为每秒字节数，为0时不限速；burst为桶容量(字节)
+    explicit TokenBucket(uint64_t rate = 0, uint64_t burst = 0);
+    TokenBucket(const TokenBucket &) = delete;
+    TokenBucket &operator=(const TokenBucket &) = delete;
+
+    bool limited() const { return m_rate != 0; }
+    uint64_t rate() const { return m_rate; }
+    // 预约bytes个令牌，返回可以开始传输的时间
+    // 预约按调用顺序排队，令牌不足的会话依次等待，不会被后来者插队
+    Clock::time_point reserve(uint64_t bytes, Clock::time_point now);
+
+ private:
+    const uint64_t m_rate;
+    const int64_t m_burst_ns; // 令牌从空到满需要的时间
+    std::atomic<int64_t> m_tat{0};
+};
+
+// 分层限速：会话 -> 用户 -> 全局，上传和下载分别计量
+// 传输按"片"进行，每片先在各层预约令牌，全部就绪后再sendfile/splice，
+// 只调整每次零拷贝传输的长度，不经过用户态缓冲区
+class BandwidthShaper {
+ public:
+    explicit BandwidthShaper(const ServerConfig &config);
+    BandwidthShaper(const BandwidthShaper &) = delete;
+    BandwidthShaper &operator=(const BandwidthShaper &) = delete;
+
+    bool enabled() const;
+
+    // 同一层级的下载桶和上传桶，下标为是否上传
+    struct Buckets {
+        Buckets(uint64_t rate, uint64_t burst);
+        TokenBucket dir[2];
+    };
+
+    // 一个会话的限速状态，只在会话所在的反应堆线程中使用
+    class Flow {
+     public:
+        explicit Flow(BandwidthShaper &shaper);
+        bool limited() const { return m_limited; }
+        // USER之后改用该用户的桶，同一用户的所有会话共享
+        void setUser(std::string_view user);
+        // 申请下一片的配额，返回本片字节数(不超过want)，ready为可以开始传输的时间
+        size_t acquire(bool upload, size_t want,
+                       TokenBucket::Clock::time_point &ready);
+
+     private:
+        BandwidthShaper &m_shaper;
+        const bool m_limited;
+        Buckets m_session;
+        std::shared_ptr<Buckets> m_user;
+    };
+
+ private:
+    std::shared_ptr<Buckets> userBuckets(const std::string &user);
+
+    const uint64_t m_session_rate;
+    const uint64_t m_user_rate;
+    Buckets m_global;
+    // 每片的大小，按最低一层的速率折算
+    const size_t m_slice;
+    std::mutex m_mtx;
+    // 用户名 -> 该用户的下载/上传桶，最后一个会话结束时移除
+    std::unordered_map<std::string, std::weak_ptr<Buckets>> m_users;
+};
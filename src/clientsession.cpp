@@ -1,75 +1,710 @@
 #include "clientsession.h"
 #include "ftpcmd.h"
 #include "response.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <charconv>
+#include <chrono>
+#include <cctype>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <fcntl.h>
-#include <filesystem>
+#include <format>
+#include <limits>
+#include <random>
 #include <spdlog/spdlog.h>
 #include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <utility>
 
-void ClientSession::start() {
-    Response::sendResponse(m_ctrcl_socket, Response::READY);
-    while (m_connected) {
-        std::string buffer(128, '\0');
-        ssize_t bytes_received =
-            recv(m_ctrcl_socket, buffer.data(), buffer.size(), 0);
+// 访问日志中的字符串值加引号，转义引号、反斜杠和控制字符
+static std::string quoted(std::string_view value) {
+    std::string out = "\"";
+    for (unsigned char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20 || c == 0x7f) {
+            out += std::format("\\x{:02x}", c);
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+    return out;
+}
+// text以prefix(大写)开头时去掉它并返回true，不区分大小写
+static bool consumePrefix(std::string_view &text, std::string_view prefix) {
+    if (text.size() < prefix.size()) return false;
+    for (size_t i = 0; i < prefix.size(); ++i) {
+        if (std::toupper(static_cast<unsigned char>(text[i])) != prefix[i]) {
+            return false;
+        }
+    }
+    text.remove_prefix(prefix.size());
+    return true;
+}
+// 对端地址，形如 "1.2.3.4:5678"
+static std::string peerAddress(int sock) {
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    char ip[INET_ADDRSTRLEN] = "?";
+    if (::getpeername(sock, reinterpret_cast<sockaddr *>(&addr), &len) < 0 ||
+        addr.sin_family != AF_INET) {
+        return ip;
+    }
+    ::inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    return std::format("{}:{}", ip, ntohs(addr.sin_port));
+}
+bool ClientSession::start(std::function<void()> &&on_close) {
+    m_on_close = std::move(on_close);
+    // EPOLLOUT为边缘触发，只有响应写不完之后socket重新可写时才会通知
+    if (!m_loop.add(m_ctrcl_socket, EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP,
+                    [this](uint32_t events) { handleEvent(events); })) {
+        return false;
+    }
+    if (m_context.access_log) {
+        m_context.access_log->info("session={} event=connect peer={}", m_id,
+                                   quoted(peerAddress(m_ctrcl_socket)));
+    }
+    m_replies.push(Response::READY);
+    m_replies.flush();
+    armControlTimer();
+    return true;
+}
+void ClientSession::handleEvent(uint32_t events) {
+    if (handshaking()) return continueHandshake();
+    if ((events & EPOLLOUT) && !m_replies.flush()) m_connected = false;
+    // 传输结束后会主动读取，边缘触发不会丢失这期间到达的命令
+    if (m_busy) return;
+    readCommands();
+}
+void ClientSession::readCommands() {
+    processBufferedCommands();
+    while (m_connected && !m_busy) {
+        if (m_replies.pendingBytes() >= MAX_PENDING_REPLIES) {
+            // 客户端不读取响应时停止处理新命令，等EPOLLOUT把积压的响应发出去
+            if (!m_replies.flush()) m_connected = false;
+            if (m_replies.pendingBytes() >= MAX_PENDING_REPLIES) break;
+            continue;
+        }
+        if (!reserveInput()) {
+            // 命令行超长，丢弃到下一个换行符为止；几倍于MAX_LINE的一行
+            // 会多次填满缓冲区，只在第一次回复
+            if (!m_skip_line) m_replies.push(Response::LINETOOLONG);
+            m_in_begin = m_in_end = 0;
+            m_skip_line = true;
+        }
+        char *buffer = m_inbuf.data() + m_in_end;
+        const size_t space = m_inbuf.size() - m_in_end;
+        ssize_t bytes_received = m_tls ? m_tls->read(buffer, space)
+                                       : recv(m_ctrcl_socket, buffer, space, 0);
+        if (bytes_received < 0 && errno == EINTR) continue;
+        if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
         if (bytes_received <= 0) {
             m_connected = false;
-            spdlog::debug("ClientSession: 接收数据失败或客户端连接关闭");
+            SPDLOG_DEBUG("ClientSession: 接收数据失败或客户端连接关闭");
+            break;
+        }
+        m_in_end += bytes_received;
+        processBufferedCommands();
+    }
+    // 排空时等到没有传输、也没有等待传输命令的数据连接再关闭
+    if (m_draining && m_connected && !m_busy && m_state != TRANSFER) {
+        m_replies.push(Response::RESTARTING);
+        m_connected = false;
+    }
+    // 本轮处理的所有命令的响应合并发送
+    if (!m_replies.flush()) m_connected = false;
+    if (!m_connected && !m_busy) closeSession();
+}
+void ClientSession::continueHandshake() {
+    // 234必须以明文完整发出后才能开始握手
+    if (m_replies.pendingBytes() > 0) {
+        if (!m_replies.flush()) return closeSession();
+        if (m_replies.pendingBytes() > 0) return;
+    }
+    if (!m_tls->handshake()) {
+        if (errno == EAGAIN) return;
+        spdlog::warn("控制连接TLS握手失败: {}", strerror(errno));
+        return closeSession();
+    }
+    m_replies.setTls(m_tls.get());
+    m_busy = false;
+    readCommands();
+}
+void ClientSession::processBufferedCommands() {
+    while (m_connected && !m_busy && m_in_begin < m_in_end) {
+        std::string_view pending(m_inbuf.data() + m_in_begin,
+                                 m_in_end - m_in_begin);
+        size_t eol = pending.find('\n');
+        if (eol == std::string_view::npos) break;
+        m_in_begin += eol + 1;
+        if (std::exchange(m_skip_line, false)) continue;
+        processCommand(pending.substr(0, eol + 1));
+    }
+    if (m_in_begin == m_in_end) m_in_begin = m_in_end = 0;
+}
+bool ClientSession::reserveInput() {
+    if (m_in_end < m_inbuf.size()) return true;
+    if (m_in_begin > 0) {
+        std::memmove(m_inbuf.data(), m_inbuf.data() + m_in_begin,
+                     m_in_end - m_in_begin);
+        m_in_end -= m_in_begin;
+        m_in_begin = 0;
+        return true;
+    }
+    if (m_inbuf.size() >= MAX_LINE) return false;
+    m_inbuf.resize(m_inbuf.empty() ? INBUF_INITIAL : m_inbuf.size() * 2);
+    return true;
+}
+void ClientSession::closeSession() {
+    if (!m_on_close) return;
+    m_connected = false;
+    m_loop.remove(m_ctrcl_socket);
+    auto on_close = std::move(m_on_close);
+    m_on_close = nullptr;
+    on_close();
+}
+EventLoop::Clock::time_point ClientSession::controlDeadline() const {
+    using std::chrono::seconds;
+    const ServerConfig &config = m_context.config;
+    auto deadline = EventLoop::Clock::time_point::max();
+    if (config.idle_timeout) {
+        deadline = m_last_command + seconds(config.idle_timeout);
+    }
+    const bool logging_in = m_state == WAIT_USER || m_state == WAIT_PASS;
+    if (config.login_timeout && logging_in) {
+        auto login_deadline = m_started + seconds(config.login_timeout);
+        deadline = std::min(deadline, login_deadline);
+    }
+    return deadline;
+}
+void ClientSession::armControlTimer() {
+    auto deadline = controlDeadline();
+    if (deadline == EventLoop::Clock::time_point::max()) return;
+    auto delay = std::chrono::ceil<std::chrono::milliseconds>(
+        deadline - EventLoop::Clock::now());
+    m_control_timer = m_loop.runAfter(
+        std::max(delay, std::chrono::milliseconds::zero()), [this]() {
+            m_control_timer = {};
+            onControlTimer();
+        });
+}
+void ClientSession::onControlTimer() {
+    auto now = EventLoop::Clock::now();
+    // 传输期间不算空闲，从传输结束或现在重新计时；TLS握手仍受登录超时限制
+    const bool transferring = m_busy && !handshaking();
+    if (transferring) m_last_command = now;
+    if (transferring || now < controlDeadline()) return armControlTimer();
+    const bool logging_in = m_state == WAIT_USER || m_state == WAIT_PASS;
+    spdlog::warn("会话{}超时，关闭控制连接", logging_in ? "登录" : "空闲");
+    m_replies.push(Response::TIMEOUT);
+    m_replies.flush();
+    closeSession();
+}
+void ClientSession::armStallTimer() {
+    if (m_context.config.stall_timeout == 0) return;
+    auto timeout = std::chrono::seconds(m_context.config.stall_timeout);
+    m_transfer.stall_timer = m_loop.runAfter(timeout, [this]() {
+        m_transfer.stall_timer = {};
+        onStallTimer();
+    });
+}
+void ClientSession::onStallTimer() {
+    Transfer &t = m_transfer;
+    // 限速暂停或让出事件循环时由定时器和任务继续，不算停滞
+    if (t.bytes == t.stall_mark && !t.throttled && !t.yielded) {
+        spdlog::warn("数据传输{}秒没有进展，中止传输",
+                     m_context.config.stall_timeout);
+        return finishTransfer(false);
+    }
+    t.stall_mark = t.bytes;
+    armStallTimer();
+}
+void ClientSession::drain() {
+    m_draining = true;
+    // 传输结束后会调用readCommands()
+    if (!m_busy) readCommands();
+}
+void ClientSession::shutdown() {
+    ::shutdown(m_ctrcl_socket, SHUT_RDWR);
+    m_data_channel.shutdown();
+}
+void ClientSession::startTransfer() {
+    m_busy = true;
+    Transfer &t = m_transfer;
+    if (m_mode_z && t.upload) {
+        t.inflate = std::make_unique<InflateStream>();
+    } else if (m_mode_z) {
+        // 等待数据连接期间就开始压缩，第一块在连接建立时多半已经就绪
+        DeflateStream::Input input{t.buffer, t.file, t.offset, t.end};
+        DeflateStream::Options options;
+        options.level = m_deflate_level;
+        options.min_size = m_context.config.deflate_min_size;
+        t.deflate = DeflateStream::create(m_loop, m_context.pool,
+                                          std::move(input), options,
+                                          [this]() { continueTransfer(); });
+    }
+    const int server_sock = m_data_channel.m_server_sock;
+    if (!m_loop.add(server_sock, EPOLLIN,
+                    [this](uint32_t) { acceptDataConnection(); })) {
+        return onDataConnected(-1);
+    }
+    // 客户端迟迟不连接时回复425并释放资源
+    auto timeout = std::chrono::seconds(m_context.config.data_timeout);
+    m_accept_timer = m_loop.runAfter(timeout, [this]() {
+        spdlog::warn("等待数据连接超时");
+        m_accept_timer = {};
+        onDataConnected(-1);
+    });
+}
+void ClientSession::acceptDataConnection() {
+    for (;;) {
+        int data_sock = accept4(m_data_channel.m_server_sock, nullptr, nullptr,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (data_sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            return onDataConnected(-1);
+        }
+        // 只接受来自控制连接同一地址的数据连接，防止端口被他人抢占
+        sockaddr_in ctrl_peer{}, data_peer{};
+        socklen_t len = sizeof(ctrl_peer);
+        getpeername(m_ctrcl_socket, (sockaddr *)&ctrl_peer, &len);
+        len = sizeof(data_peer);
+        getpeername(data_sock, (sockaddr *)&data_peer, &len);
+        if (ctrl_peer.sin_addr.s_addr != data_peer.sin_addr.s_addr) {
+            spdlog::warn("拒绝来自其他地址的数据连接");
+            ::close(data_sock);
+            continue;
+        }
+        return onDataConnected(data_sock);
+    }
+}
+void ClientSession::onDataConnected(int data_sock) {
+    m_loop.cancel(std::exchange(m_accept_timer, {}));
+    m_loop.remove(m_data_channel.m_server_sock);
+    if (data_sock < 0) {
+        spdlog::error("接受数据连接失败");
+        m_data_channel.reset();
+        if (m_transfer.file_fd >= 0) ::close(m_transfer.file_fd);
+        if (m_transfer.upload) {
+            ::close(m_transfer.pipe_fds[0]);
+            ::close(m_transfer.pipe_fds[1]);
+        }
+        m_transfer = {};
+        m_busy = false;
+        m_replies.push(Response::FAILDATACONN);
+        readCommands();
+        return;
+    }
+    SPDLOG_DEBUG("接受数据连接: {}", data_sock);
+    m_context.metrics.dataConnectionOpened();
+    m_data_channel.m_data_sock = data_sock;
+    m_transfer.started = EventLoop::Clock::now();
+    armStallTimer();
+    uint32_t events = m_transfer.upload ? EPOLLIN | EPOLLRDHUP : EPOLLOUT;
+    if (m_prot_private) {
+        // 握手需要双向的就绪事件，在continueTransfer中完成
+        m_data_channel.m_tls = std::make_unique<TlsStream>(
+            *m_context.tls, data_sock, TlsStream::DATA);
+        events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    }
+    if (!m_loop.add(data_sock, events | EPOLLET,
+                    [this](uint32_t) { continueTransfer(); })) {
+        finishTransfer(false);
+        return;
+    }
+    continueTransfer();
+}
+void ClientSession::yieldTransfer() {
+    m_transfer.yielded = true;
+    m_loop.post([this]() {
+        m_transfer.yielded = false;
+        continueTransfer();
+    });
+}
+size_t ClientSession::paceTransfer(size_t want) {
+    Transfer &t = m_transfer;
+    if (!m_flow.limited()) return want;
+    if (t.credit == 0) {
+        auto now = EventLoop::Clock::now();
+        auto ready = now;
+        t.credit = m_flow.acquire(t.upload, want, ready);
+        if (ready > now) {
+            // 暂停期间数据socket的就绪事件被忽略，由定时器继续传输
+            t.throttled = true;
+            auto delay =
+                std::chrono::ceil<std::chrono::milliseconds>(ready - now);
+            t.pace_timer = m_loop.runAfter(delay, [this]() {
+                m_transfer.pace_timer = {};
+                m_transfer.throttled = false;
+                continueTransfer();
+            });
+            return 0;
+        }
+    }
+    return std::min(want, t.credit);
+}
+void ClientSession::continueTransfer() {
+    // 由已投递的任务或限速定时器继续
+    if (m_transfer.yielded || m_transfer.throttled) return;
+    TlsStream *tls = m_data_channel.m_tls.get();
+    if (tls && !tls->established()) {
+        if (!tls->handshake()) {
+            if (errno == EAGAIN) return;
+            spdlog::warn("数据连接TLS握手失败: {}", strerror(errno));
+            return finishTransfer(false);
+        }
+        m_transfer.tls_user = m_transfer.upload ? !tls->kernelReceive()
+                                                : !tls->kernelSend();
+    }
+    if (m_transfer.upload) {
+        continueUpload();
+    } else {
+        continueDownload();
+    }
+    reportTransferBytes(); // 传输结束时m_transfer已清空，不会重复计入
+}
+void ClientSession::reportTransferBytes() {
+    Transfer &t = m_transfer;
+    if (t.bytes == t.reported) return;
+    m_context.metrics.recordBytes(t.upload, t.bytes - t.reported);
+    t.reported = t.bytes;
+}
+// 单次最多传输的字节数，超过后让出事件循环，避免大文件饿死其他会话
+constexpr uint64_t TRANSFER_QUANTUM = 4 << 20;
+constexpr size_t TRANSFER_CHUNK = 1 << 20;
+// 用户态TLS每次读写文件的字节数，约为4个最大的TLS记录
+constexpr size_t TLS_CHUNK = 64 << 10;
+
+void ClientSession::continueDownload() {
+    Transfer &t = m_transfer;
+    if (t.deflate) return continueDeflate();
+    const int sock = m_data_channel.m_data_sock;
+    TlsStream *tls = m_data_channel.m_tls.get();
+    uint64_t quantum_end = t.bytes + TRANSFER_QUANTUM;
+    // 大目录的列表和缓存中的文件同样按时间片让出，不独占事件循环
+    while (t.buffer && t.offset < t.end) {
+        if (t.bytes >= quantum_end) return yieldTransfer();
+        size_t chunk = paceTransfer(
+            std::min<off_t>(t.end - t.offset, TRANSFER_CHUNK));
+        if (chunk == 0) return;
+        const char *data = t.buffer->data() + t.offset;
+        ssize_t n = t.tls_user ? tls->write(data, chunk)
+                               : send(sock, data, chunk, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n < 0) return finishTransfer(false);
+        t.offset += n;
+        t.bytes += n;
+        if (t.credit) t.credit -= n; // 不限速时credit始终为0
+    }
+    while (t.file && t.offset < t.end) {
+        if (t.bytes >= quantum_end) return yieldTransfer();
+        size_t chunk = paceTransfer(
+            std::min<off_t>(t.end - t.offset, TRANSFER_CHUNK));
+        if (chunk == 0) return;
+        // kTLS接管发送后sendfile照常零拷贝，由内核加密
+        ssize_t n = t.tls_user ? sendFileTls(chunk)
+                               : sendfile(sock, t.file->fd(), &t.offset, chunk);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n < 0) return finishTransfer(false);
+        if (n == 0) break; // 文件在传输过程中被截断
+        t.bytes += n;
+        if (t.credit) t.credit -= n;
+    }
+    // 客户端据close_notify确认数据没有被截断，发不出去时等待可写
+    if (tls && !tls->close() && errno == EAGAIN) return;
+    finishTransfer(true);
+}
+void ClientSession::continueDeflate() {
+    Transfer &t = m_transfer;
+    const int sock = m_data_channel.m_data_sock;
+    TlsStream *tls = m_data_channel.m_tls.get();
+    uint64_t quantum_end = t.bytes + TRANSFER_QUANTUM;
+    for (;;) {
+        std::string_view data = t.deflate->pending();
+        if (data.empty()) {
+            if (t.deflate->failed()) return finishTransfer(false);
+            // 下一块还在工作线程中，压缩完成后由on_ready继续
+            if (!t.deflate->finished()) return;
             break;
         }
-        buffer.resize(bytes_received);
-        spdlog::debug("接收到命令: {}", buffer);
-        processCommand(buffer);
+        if (t.bytes >= quantum_end) return yieldTransfer();
+        size_t chunk = paceTransfer(std::min(data.size(), TRANSFER_CHUNK));
+        if (chunk == 0) return;
+        ssize_t n = t.tls_user ? tls->write(data.data(), chunk)
+                               : send(sock, data.data(), chunk, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n < 0) return finishTransfer(false);
+        t.deflate->consume(n);
+        t.bytes += n;
+        if (t.credit) t.credit -= n;
+    }
+    if (tls && !tls->close() && errno == EAGAIN) return;
+    finishTransfer(true);
+}
+ssize_t ClientSession::sendFileTls(size_t chunk) {
+    Transfer &t = m_transfer;
+    // 上次没有发完时缓冲区中的数据不变，按OpenSSL的要求原样重试
+    if (t.offset < t.tls_base || t.offset >= t.tls_base + off_t(t.tls_size)) {
+        t.tls_buffer.resize(TLS_CHUNK);
+        size_t want = std::min<off_t>(t.end - t.offset, TLS_CHUNK);
+        ssize_t n = pread(t.file->fd(), t.tls_buffer.data(), want, t.offset);
+        if (n <= 0) return n;
+        t.tls_base = t.offset;
+        t.tls_size = n;
+    }
+    const size_t skip = t.offset - t.tls_base;
+    ssize_t n = m_data_channel.m_tls->write(
+        t.tls_buffer.data() + skip, std::min(chunk, t.tls_size - skip));
+    if (n > 0) t.offset += n;
+    return n;
+}
+void ClientSession::continueUpload() {
+    Transfer &t = m_transfer;
+    const int sock = m_data_channel.m_data_sock;
+    uint64_t quantum_end = t.bytes + TRANSFER_QUANTUM;
+    for (;;) {
+        if (t.bytes >= quantum_end) return yieldTransfer();
+        size_t chunk = paceTransfer(TRANSFER_CHUNK);
+        if (chunk == 0) return;
+        // kTLS接管接收后splice照常零拷贝，由内核解密
+        const bool spliced = !t.inflate && !t.tls_user;
+        ssize_t n;
+        if (t.inflate) {
+            n = receiveInflate(chunk);
+        } else if (t.tls_user) {
+            n = receiveTls(chunk);
+        } else {
+            n = splice(sock, nullptr, t.pipe_fds[1], nullptr, chunk,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        }
+        if (n < 0 && errno == EINTR) continue;
+        // pipe每次都会被清空，EAGAIN说明socket暂无数据，等待下一次EPOLLIN
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n < 0 && spliced && m_data_channel.m_tls) {
+            // kTLS遇到close_notify等非数据记录时splice失败，交给OpenSSL处理
+            t.tls_user = true;
+            continue;
+        }
+        if (n < 0) return finishTransfer(false);
+        if (n == 0) break; // 客户端关闭数据连接，上传结束
+        if (spliced) t.piped += n;
+        t.bytes += n;
+        if (t.credit) t.credit -= n;
+        if (!drainPipe()) return finishTransfer(false);
+    }
+    if (t.inflate && !t.inflate->finished()) {
+        spdlog::warn("MODE Z上传的数据不完整: {}", t.path);
+        return finishTransfer(false);
+    }
+    finishTransfer(drainPipe());
+}
+ssize_t ClientSession::receiveTls(size_t chunk) {
+    Transfer &t = m_transfer;
+    t.tls_buffer.resize(TLS_CHUNK);
+    ssize_t n = m_data_channel.m_tls->read(t.tls_buffer.data(),
+                                           std::min(chunk, TLS_CHUNK));
+    for (ssize_t done = 0; done < n;) {
+        ssize_t written = pwrite(t.file_fd, t.tls_buffer.data() + done,
+                                 n - done, t.offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            spdlog::error("写入文件失败: {}", strerror(errno));
+            errno = EIO;
+            return -1;
+        }
+        done += written;
+        t.offset += written;
     }
+    return n;
 }
-void ClientSession::processCommand(const std::string &raw_cmd) {
+ssize_t ClientSession::receiveInflate(size_t chunk) {
+    Transfer &t = m_transfer;
+    TlsStream *tls = m_data_channel.m_tls.get();
+    t.tls_buffer.resize(TLS_CHUNK);
+    // kTLS接管接收时OpenSSL也能正确处理非数据记录，统一经它读取
+    const size_t want = std::min(chunk, TLS_CHUNK);
+    ssize_t n = tls ? tls->read(t.tls_buffer.data(), want)
+                    : recv(m_data_channel.m_data_sock, t.tls_buffer.data(),
+                           want, 0);
+    if (n > 0 && !t.inflate->write(t.tls_buffer.data(), n, t.file_fd,
+                                   t.offset)) {
+        if (errno != EBADMSG) {
+            spdlog::error("写入文件失败: {}", strerror(errno));
+        }
+        errno = EIO;
+        return -1;
+    }
+    return n;
+}
+bool ClientSession::drainPipe() {
+    Transfer &t = m_transfer;
+    while (t.piped > 0) {
+        ssize_t n = splice(t.pipe_fds[0], nullptr, t.file_fd, &t.offset,
+                           t.piped, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            spdlog::error("写入文件失败: {}", strerror(errno));
+            return false;
+        }
+        t.piped -= n;
+    }
+    return true;
+}
+void ClientSession::finishTransfer(bool ok) {
+    Transfer &t = m_transfer;
+    reportTransferBytes();
+    m_loop.cancel(t.pace_timer);
+    m_loop.cancel(t.stall_timer);
+    m_context.metrics.recordTransfer(ok);
+    m_context.metrics.dataConnectionClosed();
+    m_loop.remove(m_data_channel.m_data_sock);
+    m_data_channel.reset();
+    if (t.upload) {
+        // 去掉ALLO预分配但未使用的空间
+        if (ftruncate(t.file_fd, t.offset) < 0) {
+            spdlog::warn("截断文件失败: {}", strerror(errno));
+        }
+        ::close(t.pipe_fds[0]);
+        ::close(t.pipe_fds[1]);
+    }
+    if (t.file_fd >= 0) ::close(t.file_fd);
+    if (t.upload) {
+        m_context.open_files.invalidate(t.path);
+        m_context.file_cache.invalidate(t.path);
+    }
+    if (m_context.access_log) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            EventLoop::Clock::now() - t.started);
+        m_context.access_log->info(
+            "session={} user={} event=transfer dir={} path={} bytes={} us={} "
+            "result={}",
+            m_id, quoted(m_user), t.upload ? "upload" : "download",
+            quoted(t.path), t.bytes, elapsed.count(), ok ? "ok" : "failed");
+    }
+    if (ok) {
+        m_replies.format("226 Transfer complete, {} bytes {}\r\n", t.bytes,
+                         t.upload ? "received" : "sent");
+    } else {
+        m_replies.push(Response::ABORTED);
+    }
+    m_transfer = {};
+    m_busy = false;
+    m_last_command = EventLoop::Clock::now();
+    readCommands();
+}
+void ClientSession::processCommand(std::string_view raw_cmd) {
+    auto start = std::chrono::steady_clock::now();
+    m_last_command = start;
     FTPCommand ftp_cmd = FTPCommandParser::parse(raw_cmd);
+    dispatchCommand(ftp_cmd);
+    // 对RETR/STOR等命令只统计到开始传输为止
+    auto latency = std::chrono::steady_clock::now() - start;
+    m_context.metrics.recordCommand(ftp_cmd.command, latency);
+    if (m_context.access_log) logCommand(ftp_cmd, latency);
+}
+void ClientSession::logCommand(const FTPCommand &ftp_cmd,
+                               std::chrono::nanoseconds latency) {
+    // 不记录密码
+    std::string_view arg = ftp_cmd.command == PASS ? "***" : ftp_cmd.arg;
+    m_context.access_log->info(
+        "session={} user={} event=command cmd={} arg={} reply={} us={}", m_id,
+        quoted(m_user), FTPCommandParser::name(ftp_cmd.command), quoted(arg),
+        m_replies.lastCode(),
+        std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+}
+void ClientSession::dispatchCommand(const FTPCommand &ftp_cmd) {
+    if (ftp_cmd.arg.empty() && FTPCommandParser::requiresArg(ftp_cmd.command)) {
+        m_replies.push(Response::BADARGS);
+        return;
+    }
     if (ftp_cmd.command == FTPCMD::QUIT) {
-        handleQuit(ftp_cmd.args);
+        handleQuit(ftp_cmd.arg);
+        return;
+    }
+    if (ftp_cmd.command == FTPCMD::NOOP) {
+        m_replies.push(Response::CMDOK);
         return;
     }
-    spdlog::debug("状态{}", (int)m_state);
+    // 客户端在登录前后发送PBSZ/PROT的都有
+    if (ftp_cmd.command == FTPCMD::PBSZ) {
+        handlePbsz(ftp_cmd.arg);
+        return;
+    }
+    if (ftp_cmd.command == FTPCMD::PROT) {
+        handleProt(ftp_cmd.arg);
+        return;
+    }
+    // 以下命令不改变会话状态，可以在PASV之后、RETR/STOR之前发送
+    if (m_state == AUTHENTICATED || m_state == TRANSFER) {
+        switch (ftp_cmd.command) {
+        case TYPE: handleType(ftp_cmd.arg); return;
+        case REST: handleRest(ftp_cmd.arg); return;
+        case RANG: handleRang(ftp_cmd.arg); return;
+        case HASH:
+            handleDigest(ftp_cmd.arg, m_hash_algorithm, true);
+            return;
+        case XCRC:
+            handleDigest(ftp_cmd.arg, DigestAlgorithm::CRC32, false);
+            return;
+        case XMD5:
+            handleDigest(ftp_cmd.arg, DigestAlgorithm::MD5, false);
+            return;
+        case XSHA256:
+            handleDigest(ftp_cmd.arg, DigestAlgorithm::SHA256, false);
+            return;
+        case MODE: handleMode(ftp_cmd.arg); return;
+        case OPTS: handleOpts(ftp_cmd.arg); return;
+        case ALLO: handleAllo(ftp_cmd.arg); return;
+        case SIZE: handleSize(ftp_cmd.arg); return;
+        case MDTM: handleMdtm(ftp_cmd.arg); return;
+        default: break;
+        }
+    }
     switch (m_state) {
     case WAIT_USER:
         switch (ftp_cmd.command) {
         case USER:
-            handleUser(ftp_cmd.args);
+            handleUser(ftp_cmd.arg);
             m_state = WAIT_PASS;
             break;
         case FEAT:
-            Response::sendResponse(m_ctrcl_socket, Response::NOTIMPL);
-            break;
-        case AUTH:
-            Response::sendResponse(m_ctrcl_socket, Response::NOTIMPL);
-            break;
-        case NOOP:
-            Response::sendResponse(m_ctrcl_socket, Response::NOTIMPL);
+            m_replies.push(Response::NOTIMPL);
             break;
+        case AUTH: handleAuth(ftp_cmd.arg); break;
         default:
-            Response::sendResponse(m_ctrcl_socket, Response::NOTIMPL);
+            m_replies.push(Response::NOTIMPL);
             break;
         }
         break;
     case WAIT_PASS:
         switch (ftp_cmd.command) {
-        case PASS: handlePass(ftp_cmd.args); break;
+        case PASS: handlePass(ftp_cmd.arg); break;
         default:
-            Response::sendResponse(m_ctrcl_socket, Response::NOTIMPL);
+            m_replies.push(Response::NOTIMPL);
             break;
         }
         break;
     case AUTHENTICATED:
         switch (ftp_cmd.command) {
-        case PASV: handlePasv(ftp_cmd.args); break;
-        case PORT: handlePort(ftp_cmd.args); break;
-        case CWD: handleCwd(std::move(ftp_cmd.args)); return;
-        case PWD: handlePwd(ftp_cmd.args); return;
+        case PASV: handlePasv(ftp_cmd.arg); break;
+        case PORT: handlePort(ftp_cmd.arg); break;
+        case CWD: handleCwd(ftp_cmd.arg); return;
+        case PWD: handlePwd(ftp_cmd.arg); return;
         default:
-            Response::sendResponse(m_ctrcl_socket, Response::BADSEQ);
+            m_replies.push(Response::BADSEQ);
             return;
         }
         m_state = TRANSFER;
@@ -77,142 +712,540 @@ void ClientSession::processCommand(const std::string &raw_cmd) {
     case TRANSFER:
         switch (m_data_channel.m_conn_mode) {
         case DataChannel::INACTIVE:
-            Response::sendResponse(m_ctrcl_socket, Response::BADSEQ);
+            m_replies.push(Response::BADSEQ);
             break;
         case DataChannel::PASV_READY:
             switch (ftp_cmd.command) {
-            case LIST: handleList(ftp_cmd.args); break;
-            case RETR: handleRetr(ftp_cmd.args); break;
-            case STOR: handleStor(ftp_cmd.args); break;
+            case LIST: handleList(ftp_cmd.arg, DirCache::LIST); break;
+            case NLST: handleList(ftp_cmd.arg, DirCache::NLST); break;
+            case MLSD: handleList(ftp_cmd.arg, DirCache::MLSD); break;
+            case RETR: handleRetr(ftp_cmd.arg); break;
+            case STOR: handleStor(ftp_cmd.arg); break;
+            case APPE: handleAppe(ftp_cmd.arg); break;
+            case STOU: handleStou(ftp_cmd.arg); break;
             default:
-                Response::sendResponse(m_ctrcl_socket, Response::BADSEQ);
+                m_replies.push(Response::BADSEQ);
                 break;
             }
             break;
         case DataChannel::PORT_READY:
             switch (ftp_cmd.command) {
-            case LIST: handleList(ftp_cmd.args); break;
-            case RETR: handleRetr(ftp_cmd.args); break;
-            case STOR: handleStor(ftp_cmd.args); break;
+            case LIST: handleList(ftp_cmd.arg, DirCache::LIST); break;
+            case NLST: handleList(ftp_cmd.arg, DirCache::NLST); break;
+            case MLSD: handleList(ftp_cmd.arg, DirCache::MLSD); break;
+            case RETR: handleRetr(ftp_cmd.arg); break;
+            case STOR: handleStor(ftp_cmd.arg); break;
+            case APPE: handleAppe(ftp_cmd.arg); break;
+            case STOU: handleStou(ftp_cmd.arg); break;
             default:
-                Response::sendResponse(m_ctrcl_socket, Response::BADSEQ);
+                m_replies.push(Response::BADSEQ);
                 break;
             }
             break;
         }
+        // 没有开始传输(文件不存在、断点无效或不是传输命令)时立即归还
+        // 监听socket，否则会话一直占着它，固定端口范围会被失败的RETR耗尽
+        if (!m_busy) m_data_channel.reset();
         m_state = AUTHENTICATED;
         break;
     }
 }
 
-ClientSession::~ClientSession() { close(m_ctrcl_socket); }
-ClientSession::ClientSession(int ctrl_socket, std::string &&wd)
-    : m_ctrcl_socket(ctrl_socket), m_working_dir(std::move(wd)),
-      m_data_channel(ctrl_socket) {
-    std::filesystem::current_path(m_working_dir);
-    spdlog::debug("创建客户端会话: {}", __FUNCTION__);
+ClientSession::~ClientSession() {
+    m_context.metrics.sessionClosed();
+    if (m_context.access_log) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            EventLoop::Clock::now() - m_started);
+        m_context.access_log->info(
+            "session={} user={} event=disconnect ms={}", m_id, quoted(m_user),
+            elapsed.count());
+    }
+    // 服务器关闭时可能仍在等待数据连接或传输中
+    m_loop.cancel(m_accept_timer);
+    m_loop.cancel(m_control_timer);
+    m_loop.cancel(m_transfer.pace_timer);
+    m_loop.cancel(m_transfer.stall_timer);
+    if (m_data_channel.m_server_sock >= 0) {
+        m_loop.remove(m_data_channel.m_server_sock);
+    }
+    if (m_data_channel.m_data_sock >= 0) {
+        m_loop.remove(m_data_channel.m_data_sock);
+        m_context.metrics.dataConnectionClosed();
+    }
+    if (m_transfer.file_fd >= 0) ::close(m_transfer.file_fd);
+    ::close(m_ctrcl_socket);
+}
+ClientSession::ClientSession(int ctrl_socket, EventLoop &loop,
+                             ServerContext &context)
+    : m_ctrcl_socket(ctrl_socket), m_loop(loop), m_context(context),
+      m_replies(ctrl_socket), m_deflate_level(context.config.deflate_level),
+      m_data_channel(ctrl_socket, context.passive_ports),
+      m_flow(context.shaper),
+      m_cwd_fd(context.dir_fds.openDir("/")) {
+    m_context.metrics.sessionOpened();
+    SPDLOG_DEBUG("创建客户端会话: {}", __FUNCTION__);
 }
-void ClientSession::handleUser(const CommandArgs &args) {
-    Response::sendResponse(m_ctrcl_socket, Response::NEEDPASS);
+void ClientSession::handleUser(std::string_view arg) {
+    m_user = arg;
+    m_flow.setUser(arg);
+    m_replies.push(Response::NEEDPASS);
 }
-void ClientSession::handlePass(const CommandArgs &args) {
+void ClientSession::handlePass(std::string_view arg) {
     // todo: check password
     m_state = AUTHENTICATED;
-    Response::sendResponse(m_ctrcl_socket, Response::LOGGED);
+    m_replies.push(Response::LOGGED);
 }
-void ClientSession::handleQuit(const CommandArgs &args) {
-    Response::sendResponse(m_ctrcl_socket, Response::CLOSECTRL);
+void ClientSession::handleQuit(std::string_view arg) {
+    m_replies.push(Response::CLOSECTRL);
     m_connected = false;
 }
-void ClientSession::handleCwd(CommandArgs &&args) {
-    std::filesystem::path path(args[0]);
-    if (path.is_relative()) {
-        path = std::filesystem::path(m_working_dir) / path;
-    }
-    if (setWorkingDir(path.string())) {
-        Response::sendResponse(m_ctrcl_socket, Response::FILEACTOK);
-    } else {
-        Response::sendResponse(m_ctrcl_socket, Response::FILEUNAVAIL);
+void ClientSession::handleCwd(std::string_view arg) {
+    std::string path = DirFdCache::normalize(m_cwd, arg);
+    auto dir = m_context.dir_fds.openDir(path);
+    if (!dir) {
+        spdlog::warn("工作目录不存在或不是目录: {}", path);
+        m_replies.push(Response::FILEUNAVAIL);
+        return;
     }
+    m_cwd = std::move(path);
+    m_cwd_fd = std::move(dir);
+    m_replies.push(Response::FILEACTOK);
 }
-void ClientSession::handlePwd(const CommandArgs &args) const {
-    Response::sendResponse(
-        m_ctrcl_socket,
-        std::format("257 \"{}\" is current directory.\r\n", m_working_dir));
+void ClientSession::handlePwd(std::string_view arg) {
+    m_replies.format("257 \"{}\" is current directory.\r\n", m_cwd);
 }
-void ClientSession::handleList(const CommandArgs &args) {
-    Response::sendResponse(m_ctrcl_socket, Response::PEND);
-    std::filesystem::path path(m_working_dir);
-    for (const auto &arg : args) { path.append(arg); }
-    spdlog::debug(path.c_str());
-    if (!std::filesystem::is_directory(path)) {
-        spdlog::warn("目录不存在或不是目录: {}", path.c_str());
-        Response::sendResponse(m_ctrcl_socket, Response::FILEUNAVAIL);
-        return;
+void ClientSession::handleList(std::string_view arg,
+                               DirCache::Format format) {
+    m_replies.push(Response::PEND);
+    // 跳过ls风格的选项，"LIST -la /pub"列出/pub
+    while (arg.starts_with('-')) {
+        size_t next = arg.find_first_not_of(' ', arg.find(' '));
+        arg = next == arg.npos ? std::string_view{} : arg.substr(next);
     }
-    std::filesystem::directory_iterator list(path);
-    std::string list_data;
-    for (const auto &entry : list) {
-        list_data += entry.path().filename().string() + "\r\n";
+    // 规范化后作为缓存键，同一目录的不同写法共享一份缓存
+    std::string dir = DirFdCache::normalize(m_cwd, arg);
+    auto dir_fd = dir == m_cwd ? m_cwd_fd : m_context.dir_fds.openDir(dir);
+    if (dir_fd) {
+        m_transfer.buffer = m_context.dir_cache.get(dir, dir_fd->get(), format);
     }
-    m_data_channel.m_data_sock =
-        accept(m_data_channel.m_server_sock, nullptr, nullptr);
-    if (m_data_channel.m_data_sock < 0) {
-        spdlog::error("接受数据连接失败");
-        Response::sendResponse(m_ctrcl_socket, Response::FAILDATACONN);
+    if (!m_transfer.buffer) {
+        spdlog::warn("目录不存在或不是目录: {}", dir);
+        m_replies.push(Response::FILEUNAVAIL);
         return;
     }
-    spdlog::debug("接受数据连接: {}", m_data_channel.m_data_sock);
-    ssize_t bytes_sent = send(m_data_channel.m_data_sock, list_data.c_str(),
-                              list_data.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
-    m_data_channel.reset();
-    Response::sendResponse(m_ctrcl_socket, Response::CLOSEDATACONN);
+    m_transfer.end = m_transfer.buffer->size();
+    m_transfer.path = std::move(dir);
+    startTransfer();
 }
-bool ClientSession::setWorkingDir(std::string &&path) {
-    if (!std::filesystem::is_directory(path)) {
-        spdlog::warn("工作目录不存在或不是目录: {}", path);
-        return false;
+std::shared_ptr<const DirFd>
+ClientSession::resolveParent(std::string_view arg, std::string &name) {
+    std::string path = DirFdCache::normalize(m_cwd, arg);
+    size_t slash = path.rfind('/');
+    name = path.substr(slash + 1);
+    std::string parent = slash == 0 ? "/" : path.substr(0, slash);
+    // 最常见的是当前目录下的文件，直接使用会话持有的fd
+    return parent == m_cwd ? m_cwd_fd : m_context.dir_fds.openDir(parent);
+}
+int ClientSession::openFile(std::string_view arg, int flags, mode_t mode) {
+    std::string name;
+    auto dir = resolveParent(arg, name);
+    if (!dir) return -1;
+    if (name.empty()) { // 根目录
+        errno = EISDIR;
+        return -1;
     }
-    m_working_dir = path;
-    std::filesystem::current_path(m_working_dir);
-    return true;
+    return DirFdCache::openBeneath(dir->get(), name.c_str(), flags, mode);
 }
-void ClientSession::handlePasv(const CommandArgs &args) {
+void ClientSession::handlePasv(std::string_view arg) {
     m_data_channel.setup();
     if (m_data_channel.m_conn_mode == DataChannel::INACTIVE) {
-        Response::sendResponse(m_ctrcl_socket, Response::FAILDATACONN);
+        m_replies.push(Response::FAILDATACONN);
         return;
     }
-    Response::sendResponse(
-        m_ctrcl_socket,
-        std::format("227 Entering Passive Mode (127,0,0,1,{},{})\r\n",
-                    m_data_channel.port() / 256, m_data_channel.port() % 256));
+    // 未配置公网地址时通告客户端连接进来的本地地址
+    in_addr addr{};
+    if (const in_addr *public_addr = m_context.passive_ports.publicAddress()) {
+        addr = *public_addr;
+    } else {
+        sockaddr_in local{};
+        socklen_t len = sizeof(local);
+        getsockname(m_ctrcl_socket, (sockaddr *)&local, &len);
+        addr = local.sin_addr;
+    }
+    const auto *ip = reinterpret_cast<const uint8_t *>(&addr.s_addr);
+    const uint16_t port = m_data_channel.port();
+    m_replies.format("227 Entering Passive Mode ({},{},{},{},{},{})\r\n",
+                     ip[0], ip[1], ip[2], ip[3], port / 256, port % 256);
+}
+std::shared_ptr<const OpenFile>
+ClientSession::openShared(const std::string &path) {
+    std::string name;
+    auto dir = resolveParent(path, name);
+    if (!dir) return nullptr;
+    if (name.empty()) { // 根目录
+        errno = EISDIR;
+        return nullptr;
+    }
+    return m_context.open_files.open(path, dir, name);
+}
+std::shared_ptr<const std::string>
+ClientSession::cachedContent(const std::string &path, const OpenFile &file) {
+    if (!m_context.file_cache.cacheable(file.stat())) return nullptr;
+    FileCache::Version version(file.stat());
+    if (auto content = m_context.file_cache.get(path, version)) return content;
+    auto content = std::make_shared<std::string>(file.size(), '\0');
+    size_t done = 0;
+    while (done < content->size()) {
+        ssize_t n = pread(file.fd(), content->data() + done,
+                          content->size() - done, done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return nullptr; // 读取出错或文件被截断
+        done += n;
+    }
+    m_context.file_cache.put(path, version, content);
+    return content;
 }
-void ClientSession::handleRetr(const CommandArgs &args) {
+void ClientSession::handleRetr(std::string_view arg) {
+    off_t offset = std::exchange(m_restart_offset, 0);
+    off_t range_end = std::exchange(m_range_end, 0);
+    std::string path = DirFdCache::normalize(m_cwd, arg);
+    // 热门文件的fd已经打开，小文件的内容已在内存中，都不需要再open/close
+    auto file = openShared(path);
+    if (!file) {
+        spdlog::error("打开文件失败: {}", arg);
+        m_replies.push(Response::FILEUNAVAIL);
+        return;
+    }
+    if (offset < 0 || offset > file->size()) {
+        m_replies.push(Response::INVALIDREST);
+        return;
+    }
+    // RANG超出文件末尾时发送到末尾为止
+    const off_t end =
+        range_end ? std::min(range_end, file->size()) : file->size();
     // start send
-    Response::sendResponse(m_ctrcl_socket, Response::PEND);
-    int file_fd = open(args[0].c_str(), O_RDONLY);
+    m_replies.push(Response::PEND);
+    // 分段下载时各段都是同一文件的并发读取，共用同一个fd和缓存的内容
+    if (auto content = cachedContent(path, *file)) {
+        m_transfer.buffer = std::move(content);
+    } else {
+        m_transfer.file = std::move(file);
+    }
+    m_transfer.offset = offset;
+    m_transfer.end = end;
+    m_transfer.path = std::move(path);
+    startTransfer();
+}
+void ClientSession::handleSize(std::string_view arg) {
+    auto file = openShared(DirFdCache::normalize(m_cwd, arg));
+    if (!file) {
+        m_replies.push(Response::FILEUNAVAIL);
+        return;
+    }
+    m_replies.format("213 {}\r\n", file->size());
+}
+void ClientSession::handleMdtm(std::string_view arg) {
+    auto file = openShared(DirFdCache::normalize(m_cwd, arg));
+    std::tm tm;
+    time_t mtime = file ? file->stat().stx_mtime.tv_sec : 0;
+    if (!file || !gmtime_r(&mtime, &tm)) {
+        m_replies.push(Response::FILEUNAVAIL);
+        return;
+    }
+    // RFC 3659：YYYYMMDDHHMMSS，UTC
+    m_replies.format("213 {:04}{:02}{:02}{:02}{:02}{:02}\r\n",
+                     tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour,
+                     tm.tm_min, tm.tm_sec);
+}
+void ClientSession::handleType(std::string_view arg) {
+    // 数据按原样传输，ASCII和二进制类型的处理相同
+    char type = std::toupper(static_cast<unsigned char>(arg[0]));
+    if (type != 'A' && type != 'I' && type != 'L') {
+        m_replies.push(Response::BADPARAM);
+        return;
+    }
+    m_replies.format("200 Type set to {}.\r\n", type);
+}
+void ClientSession::handleRest(std::string_view arg) {
+    off_t offset = 0;
+    auto [end, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), offset);
+    if (ec != std::errc() || end != arg.data() + arg.size() || offset < 0) {
+        m_replies.push(Response::BADARGS);
+        return;
+    }
+    m_restart_offset = offset;
+    m_range_end = 0; // REST取消之前的RANG
+    m_replies.format(
+        "350 Restarting at {}. Send RETR or STOR to initiate transfer.\r\n",
+        offset);
+}
+void ClientSession::handleRang(std::string_view arg) {
+    // RANG start end：下一次RETR只发送[start, end]，两端都包含
+    // 多个会话各取一段并行下载同一文件；RANG 1 0取消
+    off_t start = 0, last = 0;
+    const char *stop = arg.data() + arg.size();
+    auto first = std::from_chars(arg.data(), stop, start);
+    bool ok = first.ec == std::errc() && first.ptr < stop && *first.ptr == ' ';
+    if (ok) {
+        auto second = std::from_chars(first.ptr + 1, stop, last);
+        ok = second.ec == std::errc() && second.ptr == stop;
+    }
+    if (!ok || start < 0 || (last < start && !(start == 1 && last == 0))) {
+        m_replies.push(Response::BADARGS);
+        return;
+    }
+    if (last < start) {
+        m_restart_offset = m_range_end = 0;
+        m_replies.push(Response::RANGRESET);
+        return;
+    }
+    m_restart_offset = start;
+    // 结束位置不包含在内，last为最大值时不能再加1，反正超出任何文件的末尾
+    m_range_end = std::min(last, std::numeric_limits<off_t>::max() - 1) + 1;
+    m_replies.format("350 Restarting at {}. Ending at {}.\r\n", start, last);
+}
+void ClientSession::handleDigest(std::string_view arg,
+                                 DigestAlgorithm algorithm, bool hash) {
+    // HASH按draft-bryan-ftpext-hash使用RANG设置的范围，X命令总是整个文件
+    off_t offset = 0, range_end = 0;
+    if (hash) {
+        offset = std::exchange(m_restart_offset, 0);
+        range_end = std::exchange(m_range_end, 0);
+    }
+    std::string path = DirFdCache::normalize(m_cwd, arg);
+    auto file = openShared(path);
+    if (!file) {
+        m_replies.push(Response::FILEUNAVAIL);
+        return;
+    }
+    const off_t end =
+        range_end ? std::min(range_end, file->size()) : file->size();
+    if (offset < 0 || offset > end) {
+        m_replies.push(Response::INVALIDREST);
+        return;
+    }
+    auto request = std::make_shared<DigestRequest>(
+        DigestRequest{algorithm, hash, std::string(arg), offset, end});
+    // 整个文件的摘要可以缓存，重复校验同一文件时不需要再读一遍
+    const bool whole = offset == 0 && end == file->size();
+    if (whole) {
+        std::string digest = m_context.digests.get(*file, algorithm);
+        if (!digest.empty()) return replyDigest(*request, digest);
+    }
+    // 读取和计算在工作线程中进行，期间暂停处理控制命令
+    m_busy = true;
+    m_digest = std::move(request);
+    std::weak_ptr<DigestRequest> weak = m_digest;
+    m_context.pool.submit([this, weak, file = std::move(file), algorithm,
+                           offset, end, whole, &digests = m_context.digests,
+                           &loop = m_loop]() {
+        std::string digest = computeDigest(file->fd(), offset, end, algorithm);
+        if (whole && !digest.empty()) digests.put(*file, algorithm, digest);
+        loop.post([this, weak, digest = std::move(digest)]() {
+            if (weak.lock()) onDigestDone(digest);
+        });
+    });
+}
+void ClientSession::onDigestDone(const std::string &digest) {
+    auto request = std::move(m_digest);
+    m_busy = false;
+    replyDigest(*request, digest);
+    m_last_command = EventLoop::Clock::now();
+    readCommands();
+}
+void ClientSession::replyDigest(const DigestRequest &request,
+                                const std::string &digest) {
+    if (digest.empty()) {
+        m_replies.push(Response::FILEUNAVAIL);
+    } else if (request.hash) {
+        // 213 <算法> <起始>-<结束(含)> <摘要> <文件名>
+        m_replies.format("213 {} {}-{} {} {}\r\n",
+                         digestName(request.algorithm), request.offset,
+                         std::max(request.end - 1, request.offset), digest,
+                         request.name);
+    } else {
+        m_replies.format("250 {}\r\n", digest);
+    }
+}
+void ClientSession::handleMode(std::string_view arg) {
+    // S为默认的流模式；Z在流模式的基础上用deflate压缩数据(zlib格式)
+    char mode = std::toupper(static_cast<unsigned char>(arg[0]));
+    if (arg.size() != 1 || (mode != 'S' && mode != 'Z')) {
+        m_replies.push(Response::BADPARAM);
+        return;
+    }
+    m_mode_z = mode == 'Z';
+    m_replies.format("200 Mode set to {}.\r\n", mode);
+}
+void ClientSession::handleOpts(std::string_view arg) {
+    // OPTS MODE Z LEVEL n：设置本会话MODE Z的初始压缩级别
+    // OPTS HASH [算法]：查询或选择HASH命令使用的算法
+    if (consumePrefix(arg, "HASH")) {
+        DigestAlgorithm algorithm = m_hash_algorithm;
+        if (!arg.empty() &&
+            (arg[0] != ' ' || !parseDigestName(arg.substr(1), algorithm))) {
+            m_replies.push(Response::BADPARAM);
+            return;
+        }
+        m_hash_algorithm = algorithm;
+        m_replies.format("200 {}\r\n", digestName(algorithm));
+        return;
+    }
+    int level = -1;
+    if (consumePrefix(arg, "MODE Z LEVEL ")) {
+        auto [end, ec] =
+            std::from_chars(arg.data(), arg.data() + arg.size(), level);
+        if (ec != std::errc() || end != arg.data() + arg.size()) level = -1;
+    }
+    if (level < 0 || level > 9) {
+        m_replies.push(Response::BADARGS);
+        return;
+    }
+    m_deflate_level = level;
+    m_replies.format("200 MODE Z LEVEL set to {}.\r\n", level);
+}
+void ClientSession::handleStor(std::string_view arg) {
+    // 有REST断点时在断点处续传，不截断已有内容；RANG只用于RETR
+    off_t offset = std::exchange(m_restart_offset, 0);
+    m_range_end = 0;
+    if (offset < 0) {
+        m_replies.push(Response::INVALIDREST);
+        return;
+    }
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (offset ? 0 : O_TRUNC);
+    int file_fd = openFile(arg, flags, 0644);
     if (file_fd < 0) {
-        spdlog::error("打开文件失败: {}", args[0]);
-        Response::sendResponse(m_ctrcl_socket, Response::FILEUNAVAIL);
+        spdlog::error("创建文件失败: {}", arg);
+        m_replies.push(Response::FILEUNAVAIL);
         return;
     }
-    m_data_channel.m_data_sock =
-        accept(m_data_channel.m_server_sock, nullptr, nullptr);
-    if (m_data_channel.m_data_sock < 0) {
-        spdlog::error("接受数据连接失败");
-        Response::sendResponse(m_ctrcl_socket, Response::FAILDATACONN);
+    m_replies.push(Response::PEND);
+    startUpload(file_fd, offset, DirFdCache::normalize(m_cwd, arg));
+}
+void ClientSession::handleAppe(std::string_view arg) {
+    // splice不能写入O_APPEND打开的文件，改为从文件末尾的偏移写入
+    int file_fd = openFile(arg, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st;
+    if (file_fd < 0 || fstat(file_fd, &st) < 0) {
+        spdlog::error("打开文件失败: {}", arg);
+        if (file_fd >= 0) ::close(file_fd);
+        m_replies.push(Response::FILEUNAVAIL);
         return;
     }
-    spdlog::debug("接受数据连接: {}", m_data_channel.m_data_sock);
-    sendfile(m_data_channel.m_data_sock, file_fd, nullptr, BUFSIZ);
-    m_data_channel.reset();
-    close(file_fd);
-    Response::sendResponse(m_ctrcl_socket, Response::CLOSEDATACONN);
+    m_replies.push(Response::PEND);
+    startUpload(file_fd, st.st_size, DirFdCache::normalize(m_cwd, arg));
+}
+void ClientSession::handleStou(std::string_view arg) {
+    // mkostemp只能在进程工作目录下创建，这里在会话目录下自行生成唯一文件名
+    static constexpr std::string_view CHARS =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+    thread_local std::mt19937 rng(std::random_device{}());
+    std::string name;
+    int file_fd = -1;
+    for (int attempt = 0; attempt < 100 && file_fd < 0; ++attempt) {
+        name = "ftp.";
+        for (int i = 0; i < 6; ++i) { name += CHARS[rng() % CHARS.size()]; }
+        file_fd = DirFdCache::openBeneath(
+            m_cwd_fd->get(), name.c_str(),
+            O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (file_fd < 0 && errno != EEXIST) break;
+    }
+    if (file_fd < 0) {
+        spdlog::error("创建唯一文件失败: {}", strerror(errno));
+        m_replies.push(Response::FILEUNAVAIL);
+        return;
+    }
+    m_replies.format("150 FILE: {}\r\n", name);
+    startUpload(file_fd, 0, DirFdCache::normalize(m_cwd, name));
+}
+void ClientSession::startUpload(int file_fd, off_t offset, std::string path) {
+    if (offset < 0) {
+        ::close(file_fd);
+        m_data_channel.reset();
+        m_replies.push(Response::INVALIDREST);
+        return;
+    }
+    Transfer &t = m_transfer;
+    t.upload = true;
+    t.path = std::move(path);
+    t.file_fd = file_fd;
+    t.offset = offset;
+    if (pipe2(t.pipe_fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        spdlog::error("创建pipe失败: {}", strerror(errno));
+        ::close(file_fd);
+        m_transfer = {};
+        m_data_channel.reset();
+        m_replies.push(Response::FAILDATACONN);
+        return;
+    }
+    fcntl(t.pipe_fds[1], F_SETPIPE_SZ, TRANSFER_CHUNK);
+    if (off_t size = std::exchange(m_allocate_size, 0); size > 0) {
+        // 预分配空间，减少碎片和写入时的块分配开销
+        if (fallocate(file_fd, FALLOC_FL_KEEP_SIZE, offset, size) < 0) {
+            SPDLOG_DEBUG("预分配失败: {}", strerror(errno));
+        }
+    }
+    startTransfer();
 }
-void ClientSession::handleStor(const CommandArgs &args) const {
-    Response::sendResponse(m_ctrcl_socket, Response::NOTIMPL);
+void ClientSession::handleAllo(std::string_view arg) {
+    off_t size = 0;
+    auto [end, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), size);
+    if (ec != std::errc()) {
+        m_replies.push(Response::BADARGS);
+        return;
+    }
+    m_allocate_size = size;
+    m_replies.push(Response::CMDOK);
+}
+void ClientSession::handleAuth(std::string_view arg) {
+    if (!m_context.tls) {
+        m_replies.push(Response::NOTIMPL);
+        return;
+    }
+    if (m_tls) {
+        m_replies.push(Response::BADSEQ);
+        return;
+    }
+    std::string mechanism(arg);
+    for (char &c : mechanism) {
+        c = std::toupper(static_cast<unsigned char>(c));
+    }
+    // AUTH SSL是RFC 4217之前的写法，很多客户端仍然先尝试它
+    if (mechanism != "TLS" && mechanism != "TLS-C" && mechanism != "SSL") {
+        m_replies.push(Response::BADPARAM);
+        return;
+    }
+    m_replies.push(Response::AUTHOK);
+    m_tls = std::make_unique<TlsStream>(*m_context.tls, m_ctrcl_socket,
+                                        TlsStream::CONTROL);
+    m_busy = true;
+    // 丢弃与AUTH一起收到的明文，防止它们在加密之后被当作命令执行
+    m_in_begin = m_in_end = 0;
+}
+void ClientSession::handlePbsz(std::string_view arg) {
+    if (!m_tls) {
+        m_replies.push(Response::BADSEQ);
+        return;
+    }
+    // 流式的TLS不需要保护缓冲区，按RFC 4217总是回复0
+    m_pbsz = true;
+    m_replies.push(Response::PBSZOK);
+}
+void ClientSession::handleProt(std::string_view arg) {
+    if (!m_tls || !m_pbsz) {
+        m_replies.push(Response::BADSEQ);
+        return;
+    }
+    switch (std::toupper(static_cast<unsigned char>(arg[0]))) {
+    case 'C': m_prot_private = false; break;
+    case 'P': m_prot_private = true; break;
+    case 'S':
+    case 'E': m_replies.push(Response::BADPROT); return;
+    default: m_replies.push(Response::BADPARAM); return;
+    }
+    m_replies.format("200 Protection level set to {}.\r\n",
+                     m_prot_private ? 'P' : 'C');
 }
-void ClientSession::handlePort(const CommandArgs &args) {
-    Response::sendResponse(m_ctrcl_socket, Response::NOTIMPL);
+void ClientSession::handlePort(std::string_view arg) {
+    m_replies.push(Response::NOTIMPL);
 }
@@ -1,25 +1,88 @@
 #pragma once
+#include "bandwidth.h"
 #include "datachannel.h"
+#include "eventloop.h"
+#include "dircache.h"
+#include "deflatestream.h"
+#include "digest.h"
+#include "dirfdcache.h"
+#include "openfilecache.h"
+#include "response.h"
+#include "servercontext.h"
+#include "tls.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <netinet/in.h>
 #include <spdlog/spdlog.h>
 #include <string>
+#include <string_view>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <vector>
 
+struct FTPCommand;
+
+// 由事件循环驱动的会话状态机，空闲时不占用任何线程
 class ClientSession {
  public:
     ClientSession(const ClientSession &) = delete;
-    ClientSession(ClientSession &&) = default;
+    ClientSession(ClientSession &&) = delete;
     ClientSession &operator=(const ClientSession &) = delete;
     ClientSession &operator=(ClientSession &&) = delete;
-    ClientSession(int ctrcl_socket, std::string &&wd);
-    void start();
+    ClientSession(int ctrcl_socket, EventLoop &loop, ServerContext &context);
+    // 注册控制连接到事件循环并发送欢迎信息，会话结束时调用on_close
+    bool start(std::function<void()> &&on_close);
+    // 关闭所有连接，事件循环随后会收到关闭事件
+    void shutdown();
+    // 热重启排空：执行完已收到的命令和进行中的传输后回复421并关闭
+    void drain();
     ~ClientSession();
 
  private:
+    // 访问日志中的会话编号
+    static inline std::atomic<uint64_t> s_next_id = 1;
+    const uint64_t m_id = s_next_id++;
+    const EventLoop::Clock::time_point m_started = EventLoop::Clock::now();
+    std::string m_user;
     bool m_connected = true;
+    bool m_busy = false; // 数据传输进行中，暂停处理控制命令
+    bool m_draining = false;
     const int m_ctrcl_socket;
+    EventLoop &m_loop;
+    ServerContext &m_context;
+    std::function<void()> m_on_close;
+    ResponseQueue m_replies;
+    // AUTH TLS之后控制连接上的TLS，握手期间m_busy为true，不处理命令
+    std::unique_ptr<TlsStream> m_tls;
+    bool m_pbsz = false;         // PROT之前必须先有PBSZ
+    bool m_prot_private = false; // PROT P：数据连接也使用TLS
+    bool m_mode_z = false;       // MODE Z：数据连接上的数据经deflate压缩
+    int m_deflate_level;         // OPTS MODE Z LEVEL设置的压缩级别
+    // OPTS HASH选择的HASH算法
+    DigestAlgorithm m_hash_algorithm = DigestAlgorithm::SHA256;
+    // 正在工作线程中计算的摘要，期间m_busy为true；会话结束时随之释放，
+    // 工作线程的完成通知据此判断会话是否还在
+    struct DigestRequest {
+        DigestAlgorithm algorithm;
+        bool hash;        // HASH命令，否则为XCRC/XMD5/XSHA256
+        std::string name; // 回复中的文件名
+        off_t offset;
+        off_t end;
+    };
+    std::shared_ptr<DigestRequest> m_digest;
+    // 积压的响应超过该值时暂停读取命令
+    static constexpr size_t MAX_PENDING_REPLIES = 64 * 1024;
+    // 控制连接接收缓冲区，按CRLF切分命令，支持客户端一次发送多条命令
+    // 有效数据位于[m_in_begin, m_in_end)，按需增长到MAX_LINE
+    static constexpr size_t INBUF_INITIAL = 512;
+    static constexpr size_t MAX_LINE = 8192;
+    std::vector<char> m_inbuf;
+    size_t m_in_begin = 0;
+    size_t m_in_end = 0;
+    bool m_skip_line = false; // 正在丢弃超长命令行的剩余部分
     enum State {
         WAIT_USER,
         WAIT_PASS,
@@ -27,29 +90,164 @@ class ClientSession {
         TRANSFER
     } m_state = WAIT_USER;
     DataChannel m_data_channel;
+    BandwidthShaper::Flow m_flow;
+    // 当前数据传输
+    // 下载：发送内存中的数据或用sendfile发送文件，都是其中的[offset, end)
+    // 内存数据可能与目录缓存或小文件缓存共享，文件可能与其他会话共享，都只读
+    // 上传：socket -> pipe -> 文件，用splice零拷贝写入文件offset处
+    struct Transfer {
+        bool upload = false;
+        std::string path; // 传输的虚拟路径，上传结束后使其缓存失效
+        EventLoop::Clock::time_point started; // 数据连接建立的时间
+        std::shared_ptr<const std::string> buffer;
+        std::shared_ptr<const OpenFile> file; // 下载的文件
+        int file_fd = -1;                     // 上传的文件
+        off_t offset = 0;
+        off_t end = 0;
+        int pipe_fds[2] = {-1, -1};
+        size_t piped = 0;   // 已进入pipe但尚未写入文件的字节数
+        uint64_t bytes = 0; // 已传输字节数
+        uint64_t reported = 0; // 已计入指标的字节数
+        bool yielded = false; // 已让出事件循环，等待投递的任务继续
+        // 限速：已预约但尚未传输的字节数，用完后再预约下一片
+        size_t credit = 0;
+        EventLoop::TimerId pace_timer; // 等待令牌就绪
+        bool throttled = false;
+        // 停滞检测：定时检查已传输字节数是否变化
+        EventLoop::TimerId stall_timer;
+        uint64_t stall_mark = 0;
+        // 数据连接使用TLS而内核没有接管该方向时，经用户态缓冲区由OpenSSL加解密
+        // 下载时缓冲区中是文件[tls_base, tls_base + tls_size)的内容
+        bool tls_user = false;
+        std::vector<char> tls_buffer; // MODE Z上传时也用于接收
+        off_t tls_base = 0;
+        size_t tls_size = 0;
+        // MODE Z：下载经压缩流发送，上传解压后写入文件
+        std::shared_ptr<DeflateStream> deflate;
+        std::unique_ptr<InflateStream> inflate;
+    } m_transfer;
+    EventLoop::TimerId m_accept_timer; // 等待数据连接的超时
+    // 登录和空闲超时共用一个定时器，收到命令时只记录时间，到点后再判断
+    EventLoop::TimerId m_control_timer;
+    EventLoop::Clock::time_point m_last_command = m_started;
+    off_t m_restart_offset = 0; // REST设置的断点，下一次RETR/STOR使用
+    off_t m_range_end = 0; // RANG设置的结束位置(不含)，为0时到文件末尾
+    off_t m_allocate_size = 0;  // ALLO声明的上传大小，用于预分配
 
     // clang-format off
-    using CommandArgs = std::vector<std::string>;
-    std::string m_working_dir;
-    bool setWorkingDir(std::string&& path);
+    // 工作目录：相对服务器根目录的虚拟路径及其O_PATH fd
+    std::string m_cwd = "/";
+    std::shared_ptr<const DirFd> m_cwd_fd;
+    // 解析arg所在的目录，name返回最后一级文件名
+    std::shared_ptr<const DirFd> resolveParent(std::string_view arg,
+                                               std::string &name);
+    // 在根目录之内打开文件，返回值同open()
+    int openFile(std::string_view arg, int flags, mode_t mode = 0);
+    // 以只读方式打开文件，优先使用所有会话共享的fd和statx结果
+    // path为规范化后的虚拟路径
+    std::shared_ptr<const OpenFile> openShared(const std::string &path);
+    // 从小文件缓存取出文件内容，未命中时读入缓存，文件不适合缓存时返回空指针
+    std::shared_ptr<const std::string> cachedContent(const std::string &path,
+                                                     const OpenFile &file);
+
+    void handleEvent(uint32_t events);
+    bool handshaking() const { return m_tls && !m_tls->established(); }
+    // 234发出后在控制连接上完成TLS握手，之后继续处理命令
+    void continueHandshake();
+    // 读取控制连接上所有可读数据，直到EAGAIN或开始数据传输
+    void readCommands();
+    // 依次处理缓冲区中所有完整的命令行
+    void processBufferedCommands();
+    // 保证缓冲区尾部有空闲空间，行过长时返回false
+    bool reserveInput();
+    void closeSession();
+    // 登录前取登录期限和空闲期限中较早的一个，没有期限时返回time_point::max()
+    EventLoop::Clock::time_point controlDeadline() const;
+    void armControlTimer();
+    void onControlTimer();
+    void armStallTimer();
+    void onStallTimer();
+    // 在事件循环中等待数据连接，连接建立后按就绪事件传输m_transfer
+    void startTransfer();
+    void acceptDataConnection();
+    // data_sock小于0表示连接失败或超时
+    void onDataConnected(int data_sock);
+    void continueTransfer();
+    // 传输量达到配额后让出事件循环，稍后继续
+    void yieldTransfer();
+    // 返回现在可以传输的字节数(不超过want)，为0时已设置定时器，令牌就绪后继续
+    size_t paceTransfer(size_t want);
+    void continueDownload();
+    // MODE Z：发送压缩流的输出
+    void continueDeflate();
+    void continueUpload();
+    // 用户态TLS：读出文件内容后加密发送，返回值同send
+    ssize_t sendFileTls(size_t chunk);
+    // 用户态TLS：解密后写入文件，返回值同recv
+    ssize_t receiveTls(size_t chunk);
+    // MODE Z：接收后解压写入文件，返回值同recv
+    ssize_t receiveInflate(size_t chunk);
+    // 把pipe中的数据全部写入文件
+    bool drainPipe();
+    void finishTransfer(bool ok);
+    // STOR/APPE/STOU共用：在offset处写入已打开的文件，path为其虚拟路径
+    void startUpload(int file_fd, off_t offset, std::string path);
 
-    void processCommand(const std::string &raw_cmd);
+    // 解析并执行一条命令，记录处理耗时
+    void processCommand(std::string_view raw_cmd);
+    // 为每条命令写一行访问日志
+    void logCommand(const FTPCommand &ftp_cmd,
+                    std::chrono::nanoseconds latency);
+    void dispatchCommand(const FTPCommand &ftp_cmd);
+    // 把本轮新传输的字节数计入指标
+    void reportTransferBytes();
     // Handle USER command
-    void handleUser(const CommandArgs &args);
+    void handleUser(std::string_view arg);
     // Handle PASS command
-    void handlePass(const CommandArgs &args);
+    void handlePass(std::string_view arg);
     // Handle QUIT command
-    void handleQuit(const CommandArgs &args);
+    void handleQuit(std::string_view arg);
     // Handle CWD command
-    void handleCwd(CommandArgs &&args);
+    void handleCwd(std::string_view arg);
     // Handle PWD command
-    void handlePwd(const CommandArgs &args) const;
-    // Handle LIST command
-    void handleList(const CommandArgs &args);
+    void handlePwd(std::string_view arg);
+    // Handle LIST/NLST/MLSD command
+    void handleList(std::string_view arg, DirCache::Format format);
     // Handle RETR command
-    void handleRetr(const CommandArgs &args) ;
+    void handleRetr(std::string_view arg) ;
     // Handle STOR command
-    void handleStor(const CommandArgs &args) const ;
-    void handlePasv(const CommandArgs &args);
-    void handlePort(const CommandArgs &args) ;
+    void handleStor(std::string_view arg);
+    // Handle APPE command
+    void handleAppe(std::string_view arg);
+    // Handle STOU command
+    void handleStou(std::string_view arg);
+    // Handle ALLO command
+    void handleAllo(std::string_view arg);
+    // Handle SIZE command
+    void handleSize(std::string_view arg);
+    // Handle MDTM command
+    void handleMdtm(std::string_view arg);
+    // Handle TYPE command
+    void handleType(std::string_view arg);
+    // Handle REST command
+    void handleRest(std::string_view arg);
+    // Handle RANG command
+    void handleRang(std::string_view arg);
+    // Handle HASH/XCRC/XMD5/XSHA256 command
+    void handleDigest(std::string_view arg, DigestAlgorithm algorithm,
+                      bool hash);
+    void onDigestDone(const std::string &digest);
+    void replyDigest(const DigestRequest &request, const std::string &digest);
+    // Handle MODE command
+    void handleMode(std::string_view arg);
+    // Handle OPTS command
+    void handleOpts(std::string_view arg);
+    void handlePasv(std::string_view arg);
+    // Handle AUTH command
+    void handleAuth(std::string_view arg);
+    // Handle PBSZ command
+    void handlePbsz(std::string_view arg);
+    // Handle PROT command
+    void handleProt(std::string_view arg);
+    void handlePort(std::string_view arg) ;
 };
@@ -0,0 +1,65 @@
+#pragma once
+// 服务器启动配置
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// 异步日志队列满时的处理方式
+enum class LogOverflow {
+    Block,      // 等待写日志线程腾出空间
+    DropNewest, // 丢弃当前这条
+    DropOldest, // 丢弃队列中最旧的一条
+};
+
+struct ServerConfig {
+    int port = 21;
+    // 线程池线程数上限，实际为 min(limit, 核数) * 2
+    unsigned thread_limit = std::thread::hardware_concurrency() * 2;
+    // 反应堆(事件循环)数量，大于1时每个反应堆使用独立的SO_REUSEPORT监听socket
+    unsigned reactors = 1;
+    // 是否把第i个反应堆线程绑定到第i个CPU
+    bool pin_reactors = false;
+    // 是否把线程池的第i个工作线程绑定到第i个CPU
+    bool pin_workers = false;
+    std::string working_dir = "/var/ftp";
+    // 被动模式端口范围，为0时使用临时端口
+    uint16_t pasv_min_port = 0;
+    uint16_t pasv_max_port = 0;
+    // 发送150后等待客户端建立数据连接的秒数，超时回复425
+    unsigned data_timeout = 30;
+    // 以下超时以秒为单位，为0时不限制
+    unsigned login_timeout = 30;  // 连接后必须在此时间内完成登录
+    unsigned idle_timeout = 300;  // 控制连接上没有命令的时间，传输期间不计
+    // 数据传输没有任何进展的时间，按周期检查，最迟两个周期内发现并回复426
+    unsigned stall_timeout = 60;
+    // PASV回复中通告的IPv4地址，为空时使用控制连接的本地地址
+    std::string pasv_address;
+    // Prometheus指标导出端口(只监听127.0.0.1)，为0时不导出
+    int metrics_port = 0;
+    // 数据传输限速(字节/秒)，上传和下载分别计算，为0时不限速
+    uint64_t session_rate = 0; // 每个会话
+    uint64_t user_rate = 0;    // 同一用户的所有会话合计
+    uint64_t global_rate = 0;  // 整个服务器
+    // 小文件内容缓存的内存预算(字节)，为0时不缓存
+    size_t file_cache_size = 64 << 20;
+    // 访问日志文件，"-"为标准输出，为空时不记录
+    std::string access_log;
+    // 热重启的Unix域socket路径，新进程经它接管旧进程的监听socket，为空时不启用
+    std::string restart_socket;
+    // 交出监听socket后等待会话结束的最长秒数，超时后强制关闭
+    unsigned drain_timeout = 120;
+    LogOverflow log_overflow = LogOverflow::Block;
+    // FTPS证书链和私钥(PEM)，未配置时不支持AUTH TLS
+    std::string tls_cert;
+    std::string tls_key;
+    // 握手后把会话密钥装入kTLS，内核不支持时自动使用OpenSSL加密
+    bool ktls = true;
+    // MODE Z的初始压缩级别(0-9)，传输中按发送和压缩的快慢自动调整
+    int deflate_level = 6;
+    // 小于此大小的MODE Z下载只存储不压缩，省下的流量抵不上压缩的开销
+    size_t deflate_min_size = 1024;
+    // HASH/XCRC/XMD5/XSHA256的摘要缓存条目数，为0时不缓存
+    size_t digest_cache_entries = 4096;
+    // 同时把摘要写入文件的扩展属性，服务器重启后仍然有效
+    bool digest_xattr = false;
+};
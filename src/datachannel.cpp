@@ -5,37 +5,39 @@
 #include <unistd.h>
 
 void DataChannel::setup() {
-    m_server_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (bind(m_server_sock, (sockaddr *)&m_addr, sizeof(m_addr)) < 0) {
-        spdlog::error("绑定数据socket失败");
-        return;
-    }
-    if (listen(m_server_sock, 1) < 0) {
-        spdlog::error("监听数据socket失败");
-        return;
-    }
-    socklen_t addr_len = sizeof(m_addr);
-    if (getsockname(m_server_sock, (sockaddr *)&m_addr, &addr_len) < 0) {
-        spdlog::error("获取数据socket地址失败");
+    reset(); // 连续两次PASV时归还上一次的端口
+    auto listener = m_ports.acquire();
+    if (listener.fd < 0) {
+        spdlog::error("获取被动模式端口失败");
         return;
     }
+    m_server_sock = listener.fd;
+    m_port = listener.port;
     m_conn_mode = PASV_READY;
 }
-int DataChannel::port() const { return ntohs(m_addr.sin_port); }
+int DataChannel::port() const { return m_port; }
 DataChannel::~DataChannel() {
-    close(m_server_sock);
-    close(m_data_sock);
-    spdlog::debug("DataChannel关闭");
+    reset();
+    SPDLOG_DEBUG("DataChannel关闭");
 }
 
 void DataChannel::reset() {
-    spdlog::debug("重置数据通道");
-    close(m_server_sock);
-    close(m_data_sock);
+    SPDLOG_DEBUG("重置数据通道");
+    m_ports.release({m_server_sock, m_port});
+    if (m_tls) {
+        m_tls->close();
+        m_tls.reset();
+    }
+    if (m_data_sock >= 0) close(m_data_sock);
     m_server_sock = -1;
-    m_addr = {AF_INET, 0, INADDR_ANY};
+    m_data_sock = -1;
+    m_port = 0;
     m_conn_mode = INACTIVE;
 }
-DataChannel::DataChannel(int ctrcl_socket) : m_ctrcl_socket(ctrcl_socket) {
-    spdlog::debug("DataChannel创建");
+void DataChannel::shutdown() {
+    if (m_data_sock >= 0) ::shutdown(m_data_sock, SHUT_RDWR);
+}
+DataChannel::DataChannel(int ctrcl_socket, PassivePortPool &ports)
+    : m_ctrcl_socket(ctrcl_socket), m_ports(ports) {
+    SPDLOG_DEBUG("DataChannel创建");
 }
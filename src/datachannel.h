@@ -1,24 +1,33 @@
 #pragma once
+#include "passiveports.h"
+#include "tls.h"
+#include <memory>
 #include <netinet/in.h>
 #include <spdlog/spdlog.h>
 #include <sys/socket.h>
 #include <unistd.h>
 class DataChannel {
  public:
-    DataChannel(int ctrcl_socket);
+    DataChannel(int ctrcl_socket, PassivePortPool &ports);
     DataChannel(const DataChannel &) = delete;
     DataChannel(DataChannel &&) = default;
     DataChannel &operator=(const DataChannel &) = delete;
+    // 从端口池取得监听socket，失败时保持INACTIVE
     void setup();
     int port() const;
+    // 关闭数据连接，监听socket归还端口池
     void reset();
+    // 关闭数据连接，监听socket属于端口池，不能shutdown
+    void shutdown();
 
     ~DataChannel();
 
     const int m_ctrcl_socket = -1; // 控制连接socket
+    PassivePortPool &m_ports;
     int m_server_sock = -1;
+    uint16_t m_port = 0; // 被动模式监听端口
     int m_data_sock = -1;                       // 数据连接socket
-    sockaddr_in m_addr{AF_INET, 0, INADDR_ANY}; // 数据连接地址
+    std::unique_ptr<TlsStream> m_tls; // PROT P时数据连接上的TLS
     enum DataConnMode {
         INACTIVE,   // 无数据连接
         PASV_READY, // PASV模式已准备
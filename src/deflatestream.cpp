@@ -0,0 +1,258 @@
+#include "deflatestream.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <new>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// 每块的输入大小，与pigz的默认值相同
+constexpr size_t BLOCK_SIZE = 128 << 10;
+// deflate的窗口大小，每块以前面这么多的输入为字典，压缩率与整体压缩几乎相同
+constexpr size_t DICT_SIZE = 32 << 10;
+// 已提交但尚未发送的块数上限，约2MB输入
+constexpr size_t MAX_BLOCKS = 16;
+// 输出超过输入的该比例(百分比)时认为数据不可压缩(已压缩的文件、图片等)
+constexpr size_t INCOMPRESSIBLE_RATIO = 97;
+// 检测到不可压缩后只存储的块数，之后按当前级别重新试探
+constexpr unsigned STORE_BLOCKS = 16;
+// 解压时每次写入文件的最大字节数
+constexpr size_t INFLATE_CHUNK = 256 << 10;
+
+std::shared_ptr<DeflateStream>
+DeflateStream::create(EventLoop &loop, ThreadPool &pool, Input input,
+                      const Options &options, std::function<void()> on_ready) {
+    // 范围超出输入时不读取任何数据，返回的流直接失败
+    const off_t limit = input.buffer ? off_t(input.buffer->size())
+                        : input.file ? input.file->size()
+                                     : 0;
+    const bool valid =
+        input.offset >= 0 && input.offset <= input.end && input.end <= limit;
+    assert(valid);
+    if (!valid) {
+        spdlog::error("压缩范围越界: [{}, {})，输入大小{}", input.offset,
+                      input.end, limit);
+        input = {};
+    }
+    std::shared_ptr<DeflateStream> stream(new DeflateStream(
+        loop, pool, std::move(input), options, std::move(on_ready)));
+    if (valid) {
+        stream->submitBlocks();
+    } else {
+        stream->m_failed = true;
+    }
+    return stream;
+}
+
+DeflateStream::DeflateStream(EventLoop &loop, ThreadPool &pool, Input input,
+                             const Options &options,
+                             std::function<void()> on_ready)
+    : m_loop(loop), m_pool(pool), m_input(std::move(input)),
+      m_on_ready(std::move(on_ready)) {
+    const size_t size = m_input.end - m_input.offset;
+    m_level = size < options.min_size ? 0 : std::clamp(options.level, 0, 9);
+    // 只有一块时在调用线程中直接压缩，省去线程间往返
+    m_parallel = size > BLOCK_SIZE;
+    m_next = m_input.offset;
+    // zlib头：CM=8、32KB窗口，FLEVEL只是提示，按初始级别填写
+    const unsigned flevel = m_level < 2   ? 0
+                            : m_level < 6 ? 1
+                            : m_level == 6 ? 2
+                                           : 3;
+    unsigned header = 0x7800 | flevel << 6;
+    header += 31 - header % 31;
+    auto block = std::make_shared<Block>();
+    block->done = true;
+    block->out = {char(header >> 8), char(header & 0xff)};
+    m_blocks.push_back(std::move(block));
+}
+
+void DeflateStream::compress(const Input &input, Block &block) {
+    // 块前面最多DICT_SIZE的输入作为字典，与单线程压缩时的滑动窗口内容相同
+    const off_t dict_begin =
+        std::max<off_t>(input.offset, block.offset - DICT_SIZE);
+    const size_t dict_size = block.offset - dict_begin;
+    const size_t total = dict_size + block.size;
+    std::string scratch;
+    const char *data;
+    if (input.buffer) {
+        data = input.buffer->data() + dict_begin;
+    } else {
+        scratch.resize(total);
+        for (size_t done = 0; done < total;) {
+            ssize_t n = pread(input.file->fd(), scratch.data() + done,
+                              total - done, dict_begin + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) { // 读取出错或文件被截断
+                block.failed = true;
+                return;
+            }
+            done += n;
+        }
+        data = scratch.data();
+    }
+    const Bytef *in = reinterpret_cast<const Bytef *>(data + dict_size);
+    block.adler = adler32_z(1, in, block.size);
+
+    z_stream zs{};
+    if (deflateInit2(&zs, block.level, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        block.failed = true;
+        return;
+    }
+    if (dict_size > 0) {
+        deflateSetDictionary(&zs, reinterpret_cast<const Bytef *>(data),
+                             dict_size);
+    }
+    // 同步刷新在deflateBound之外还会多出一个空的存储块
+    block.out.resize(deflateBound(&zs, block.size) + 8);
+    zs.next_in = const_cast<Bytef *>(in);
+    zs.avail_in = block.size;
+    zs.next_out = reinterpret_cast<Bytef *>(block.out.data());
+    zs.avail_out = block.out.size();
+    int ret = deflate(&zs, block.last ? Z_FINISH : Z_SYNC_FLUSH);
+    block.out.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (ret != (block.last ? Z_STREAM_END : Z_OK) || zs.avail_in != 0 ||
+        zs.avail_out == 0) {
+        spdlog::error("压缩失败: {}", ret);
+        block.failed = true;
+    }
+}
+
+void DeflateStream::submitBlocks() {
+    while (!m_submitted && m_blocks.size() < MAX_BLOCKS) {
+        auto block = std::make_shared<Block>();
+        block->offset = m_next;
+        block->size = std::min<off_t>(m_input.end - m_next, BLOCK_SIZE);
+        block->level = nextLevel();
+        m_next += block->size;
+        block->last = m_submitted = m_next == m_input.end;
+        m_blocks.push_back(block);
+        if (!m_parallel) {
+            compress(m_input, *block);
+            block->done = true;
+            continue;
+        }
+        // 工作线程只持有块和输入，会话提前结束时完成通知被丢弃
+        m_pool.submit([input = m_input, block, weak = weak_from_this(),
+                       &loop = m_loop]() {
+            compress(input, *block);
+            loop.post([block, weak]() {
+                if (auto self = weak.lock()) self->onBlockDone(block);
+            });
+        });
+    }
+}
+
+int DeflateStream::nextLevel() {
+    if (m_level == 0) return 0;
+    // 发送方在等压缩时降低级别；压缩好的块积压说明网络是瓶颈，
+    // 可以多花CPU换更小的输出
+    size_t ready = 0;
+    for (size_t i = 1; i < m_blocks.size(); ++i) {
+        if (m_blocks[i]->done) ++ready;
+    }
+    if (m_starved) {
+        m_level = std::max(m_level - 1, 1);
+    } else if (ready >= MAX_BLOCKS / 2) {
+        m_level = std::min(m_level + 1, Z_BEST_COMPRESSION);
+    }
+    m_starved = false;
+    if (m_store_blocks > 0) {
+        --m_store_blocks;
+        return 0;
+    }
+    return m_level;
+}
+
+void DeflateStream::onBlockDone(const std::shared_ptr<Block> &block) {
+    block->done = true;
+    if (block->level > 0 &&
+        block->out.size() * 100 > block->size * INCOMPRESSIBLE_RATIO) {
+        m_store_blocks = STORE_BLOCKS;
+    }
+    if (m_waiting && m_blocks.front()->done) {
+        m_waiting = false;
+        m_on_ready();
+    }
+}
+
+std::string_view DeflateStream::pending() {
+    if (m_failed || m_blocks.empty()) return {};
+    const Block &block = *m_blocks.front();
+    // 块在工作线程中时不能读取它的任何字段
+    if (!block.done) {
+        m_starved = m_waiting = true;
+        return {};
+    }
+    if (block.failed) {
+        m_failed = true;
+        return {};
+    }
+    return std::string_view(block.out).substr(m_sent);
+}
+
+void DeflateStream::consume(size_t n) {
+    m_sent += n;
+    const Block &block = *m_blocks.front();
+    if (m_sent < block.out.size()) return;
+    m_sent = 0;
+    if (block.size > 0) {
+        m_adler = adler32_combine(m_adler, block.adler, block.size);
+    }
+    const bool last = block.last;
+    m_finished = block.trailer;
+    m_blocks.pop_front();
+    if (last) {
+        // zlib结尾：整个输入的adler32，大端
+        auto trailer = std::make_shared<Block>();
+        trailer->done = trailer->trailer = true;
+        trailer->out = {char(m_adler >> 24), char(m_adler >> 16),
+                        char(m_adler >> 8), char(m_adler)};
+        m_blocks.push_back(std::move(trailer));
+    }
+    submitBlocks();
+}
+
+InflateStream::InflateStream() : m_zs(std::make_unique<z_stream>()) {
+    if (inflateInit(m_zs.get()) != Z_OK) throw std::bad_alloc();
+}
+
+InflateStream::~InflateStream() { inflateEnd(m_zs.get()); }
+
+bool InflateStream::write(const char *data, size_t size, int fd,
+                          off_t &offset) {
+    z_stream &zs = *m_zs;
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    zs.avail_in = size;
+    m_out.resize(INFLATE_CHUNK);
+    // 输出缓冲区被填满时可能还有解压结果，继续直到输入用完
+    while (!m_finished && (zs.avail_in > 0 || zs.avail_out == 0)) {
+        zs.next_out = reinterpret_cast<Bytef *>(m_out.data());
+        zs.avail_out = m_out.size();
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            m_finished = true;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            spdlog::warn("MODE Z数据解压失败: {}", zs.msg ? zs.msg : "");
+            errno = EBADMSG;
+            return false;
+        }
+        const size_t produced = m_out.size() - zs.avail_out;
+        for (size_t done = 0; done < produced;) {
+            ssize_t n = pwrite(fd, m_out.data() + done, produced - done,
+                               offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                if (n == 0) errno = EIO;
+                return false;
+            }
+            done += n;
+            offset += n;
+        }
+        if (ret == Z_BUF_ERROR) break; // 没有进展，等待更多输入
+    }
+    return true;
+}
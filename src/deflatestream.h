@@ -0,0 +1,109 @@
+#pragma once
+#include "eventloop.h"
+#include "openfilecache.h"
+#include "threadpool.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+typedef struct z_stream_s z_stream;
+
+// MODE Z下载的压缩流，输出zlib格式(RFC 1950)
+// 与pigz相同，输入按块切分，每块以前一块末尾的32KB为字典单独压缩，
+// 以同步刷新结束使输出按字节对齐，各块的输出依次拼接就是完整的deflate流，
+// 校验和由各块的adler32合并得到。大的输入由线程池并行压缩，在途的块数有上限，
+// 发送跟不上时不会无限占用内存。只能在事件循环线程中使用
+class DeflateStream : public std::enable_shared_from_this<DeflateStream> {
+ public:
+    // 压缩的数据：内存中的内容，或文件的[offset, end)
+    struct Input {
+        std::shared_ptr<const std::string> buffer;
+        std::shared_ptr<const OpenFile> file;
+        off_t offset = 0;
+        off_t end = 0;
+    };
+    struct Options {
+        int level = 6;          // 初始压缩级别，按发送和压缩的快慢自动调整
+        size_t min_size = 1024; // 小于此大小的输入只存储不压缩
+    };
+    // pending()返回空之后有新的输出时，在事件循环线程中调用on_ready
+    // 要求0 <= offset <= end <= 输入大小，否则返回的流failed()为真
+    static std::shared_ptr<DeflateStream>
+    create(EventLoop &loop, ThreadPool &pool, Input input,
+           const Options &options, std::function<void()> on_ready);
+    DeflateStream(const DeflateStream &) = delete;
+    DeflateStream &operator=(const DeflateStream &) = delete;
+
+    // 可以按顺序发送的压缩数据，为空且未结束时等待on_ready
+    // 没有consume时再次调用返回同样的数据，满足OpenSSL重试的要求
+    std::string_view pending();
+    void consume(size_t n);
+    bool finished() const { return m_finished; }
+    // 读取文件失败，输出不完整
+    bool failed() const { return m_failed; }
+
+ private:
+    struct Block {
+        off_t offset = 0; // 在输入中的位置
+        size_t size = 0;
+        int level = 0;
+        bool last = false;
+        bool done = false; // 由事件循环线程在完成通知中设置
+        bool failed = false;
+        bool trailer = false; // 结尾的adler32，发送完即结束
+        std::string out;
+        unsigned long adler = 1;
+    };
+    DeflateStream(EventLoop &loop, ThreadPool &pool, Input input,
+                  const Options &options, std::function<void()> on_ready);
+    // 读出块及其前面的字典并压缩，在工作线程或小输入时在事件循环线程中执行
+    static void compress(const Input &input, Block &block);
+    // 补充在途的块，直到达到上限或输入全部提交
+    void submitBlocks();
+    // 下一块使用的压缩级别
+    int nextLevel();
+    void onBlockDone(const std::shared_ptr<Block> &block);
+
+    EventLoop &m_loop;
+    ThreadPool &m_pool;
+    const Input m_input;
+    std::function<void()> m_on_ready;
+    int m_level;
+    bool m_parallel;
+    off_t m_next = 0; // 下一块的起始位置
+    // 按顺序排列的块，队首正在发送
+    std::deque<std::shared_ptr<Block>> m_blocks;
+    size_t m_sent = 0; // 队首的块已发送的字节数
+    bool m_submitted = false; // 最后一块已提交
+    unsigned long m_adler = 1; // 已发送的块合并后的校验和
+    bool m_finished = false;
+    bool m_failed = false;
+    bool m_waiting = false; // pending()返回过空，下一块完成时调用on_ready
+    // 自适应级别：上次选择级别之后发送方是否等过压缩，
+    // 以及检测到不可压缩的数据后只存储的剩余块数
+    bool m_starved = false;
+    unsigned m_store_blocks = 0;
+};
+
+// MODE Z上传的解压，解压后写入文件
+class InflateStream {
+ public:
+    InflateStream();
+    InflateStream(const InflateStream &) = delete;
+    InflateStream &operator=(const InflateStream &) = delete;
+    ~InflateStream();
+    // 解压data并写入fd的offset处，数据损坏或写入失败时返回false并设置errno
+    // 流结束之后的数据被忽略
+    bool write(const char *data, size_t size, int fd, off_t &offset);
+    // 已收到完整的流，客户端关闭连接时未结束说明数据被截断
+    bool finished() const { return m_finished; }
+
+ private:
+    std::unique_ptr<z_stream> m_zs;
+    std::string m_out;
+    bool m_finished = false;
+};
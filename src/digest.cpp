@@ -0,0 +1,270 @@
+#include "digest.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <openssl/evp.h>
+#include <spdlog/spdlog.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// 计算摘要时每次读取的字节数
+constexpr size_t READ_CHUNK = 256 << 10;
+
+namespace {
+struct AlgorithmInfo {
+    DigestAlgorithm algorithm;
+    std::string_view name;  // HASH命令中的名称
+    std::string_view xattr; // 扩展属性名
+};
+constexpr std::array<AlgorithmInfo, 6> ALGORITHMS{{
+    {DigestAlgorithm::CRC32, "CRC32", "user.ftp.crc32"},
+    {DigestAlgorithm::CRC32C, "CRC32C", "user.ftp.crc32c"},
+    {DigestAlgorithm::MD5, "MD5", "user.ftp.md5"},
+    {DigestAlgorithm::SHA1, "SHA-1", "user.ftp.sha1"},
+    {DigestAlgorithm::SHA256, "SHA-256", "user.ftp.sha256"},
+    {DigestAlgorithm::SHA512, "SHA-512", "user.ftp.sha512"},
+}};
+
+const AlgorithmInfo &infoOf(DigestAlgorithm algorithm) {
+    return ALGORITHMS[static_cast<size_t>(algorithm)];
+}
+
+// 反射多项式0x82F63B78的查表实现，没有SSE4.2时使用
+constexpr auto CRC32C_TABLE = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? crc >> 1 ^ 0x82F63B78 : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}();
+
+uint32_t crc32cTable(uint32_t crc, const uint8_t *p, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        crc = CRC32C_TABLE[(crc ^ p[i]) & 0xff] ^ crc >> 8;
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) uint32_t
+crc32cHardware(uint32_t crc, const uint8_t *p, size_t size) {
+    uint64_t crc64 = crc;
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; ++p, --size) { crc = _mm_crc32_u8(crc, *p); }
+    return crc;
+}
+#endif
+
+using Crc32cImpl = uint32_t (*)(uint32_t, const uint8_t *, size_t);
+const Crc32cImpl CRC32C_IMPL = [] {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) return &crc32cHardware;
+#endif
+    return &crc32cTable;
+}();
+
+const EVP_MD *evpOf(DigestAlgorithm algorithm) {
+    switch (algorithm) {
+    case DigestAlgorithm::MD5: return EVP_md5();
+    case DigestAlgorithm::SHA1: return EVP_sha1();
+    case DigestAlgorithm::SHA256: return EVP_sha256();
+    case DigestAlgorithm::SHA512: return EVP_sha512();
+    default: return nullptr;
+    }
+}
+
+std::string toHex(const unsigned char *data, size_t size) {
+    static const char DIGITS[] = "0123456789abcdef";
+    std::string hex(size * 2, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        hex[i * 2] = DIGITS[data[i] >> 4];
+        hex[i * 2 + 1] = DIGITS[data[i] & 0xf];
+    }
+    return hex;
+}
+} // namespace
+
+std::string_view digestName(DigestAlgorithm algorithm) {
+    return infoOf(algorithm).name;
+}
+
+bool parseDigestName(std::string_view name, DigestAlgorithm &algorithm) {
+    for (const auto &info : ALGORITHMS) {
+        if (std::equal(name.begin(), name.end(), info.name.begin(),
+                       info.name.end(), [](char a, char b) {
+                           return std::toupper(
+                                      static_cast<unsigned char>(a)) == b;
+                       })) {
+            algorithm = info.algorithm;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t size) {
+    return ~CRC32C_IMPL(~crc, static_cast<const uint8_t *>(data), size);
+}
+
+std::string computeDigest(int fd, off_t offset, off_t end,
+                          DigestAlgorithm algorithm) {
+    const EVP_MD *md = evpOf(algorithm);
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(
+        md ? EVP_MD_CTX_new() : nullptr, EVP_MD_CTX_free);
+    if (md && (!ctx || EVP_DigestInit_ex(ctx.get(), md, nullptr) != 1)) {
+        return {};
+    }
+    uint32_t crc = 0;
+    std::vector<char> buffer(READ_CHUNK);
+    // 整个文件从头读到尾，提示内核加大预读
+    posix_fadvise(fd, offset, end - offset, POSIX_FADV_SEQUENTIAL);
+    for (off_t pos = offset; pos < end;) {
+        size_t want = std::min<off_t>(end - pos, buffer.size());
+        ssize_t n = pread(fd, buffer.data(), want, pos);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return {}; // 读取出错或文件被截断
+        const auto *data = reinterpret_cast<const Bytef *>(buffer.data());
+        if (algorithm == DigestAlgorithm::CRC32) {
+            crc = crc32_z(crc, data, n);
+        } else if (algorithm == DigestAlgorithm::CRC32C) {
+            crc = crc32c(crc, data, n);
+        } else if (EVP_DigestUpdate(ctx.get(), data, n) != 1) {
+            return {};
+        }
+        pos += n;
+    }
+    if (!md) {
+        const unsigned char bytes[] = {
+            static_cast<unsigned char>(crc >> 24),
+            static_cast<unsigned char>(crc >> 16),
+            static_cast<unsigned char>(crc >> 8),
+            static_cast<unsigned char>(crc)};
+        return toHex(bytes, sizeof(bytes));
+    }
+    unsigned char out[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    if (EVP_DigestFinal_ex(ctx.get(), out, &len) != 1) return {};
+    return toHex(out, len);
+}
+
+size_t DigestCache::KeyHash::operator()(const Key &key) const {
+    size_t h = std::hash<uint64_t>{}(key.ino);
+    h ^= (uint64_t(key.dev_major) << 32 | key.dev_minor) + 0x9e3779b97f4a7c15 +
+         (h << 6) + (h >> 2);
+    return h ^ static_cast<size_t>(key.algorithm);
+}
+
+DigestCache::Version::Version(const struct statx &stx)
+    : size(stx.stx_size), mtime_sec(stx.stx_mtime.tv_sec),
+      mtime_nsec(stx.stx_mtime.tv_nsec) {}
+
+DigestCache::DigestCache(size_t max_entries, bool xattr)
+    : m_max_entries(max_entries), m_xattr(xattr) {}
+
+DigestCache::Key DigestCache::keyOf(const struct statx &stx,
+                                    DigestAlgorithm algorithm) {
+    return {stx.stx_dev_major, stx.stx_dev_minor, stx.stx_ino, algorithm};
+}
+
+std::string DigestCache::get(const OpenFile &file, DigestAlgorithm algorithm) {
+    const Key key = keyOf(file.stat(), algorithm);
+    const Version version(file.stat());
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (auto found = m_index.find(key); found != m_index.end()) {
+            auto it = found->second;
+            if (it->version == version) {
+                m_lru.splice(m_lru.begin(), m_lru, it);
+                return it->digest;
+            }
+            m_lru.erase(it);
+            m_index.erase(found);
+        }
+    }
+    if (!m_xattr) return {};
+    std::string digest = getXattr(file, algorithm, version);
+    if (!digest.empty()) {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        insert(key, version, digest);
+    }
+    return digest;
+}
+
+void DigestCache::put(const OpenFile &file, DigestAlgorithm algorithm,
+                      const std::string &digest) {
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        insert(keyOf(file.stat(), algorithm), Version(file.stat()), digest);
+    }
+    if (m_xattr) setXattr(file, algorithm, digest);
+}
+
+void DigestCache::insert(const Key &key, const Version &version,
+                         std::string digest) {
+    if (m_max_entries == 0) return;
+    // 多个会话可能同时计算了同一个文件，以后放入的为准
+    if (auto found = m_index.find(key); found != m_index.end()) {
+        m_lru.erase(found->second);
+        m_index.erase(found);
+    }
+    while (m_lru.size() >= m_max_entries) {
+        m_index.erase(m_lru.back().key);
+        m_lru.pop_back();
+    }
+    m_lru.push_front({key, version, std::move(digest)});
+    m_index.emplace(key, m_lru.begin());
+}
+
+// 扩展属性的值为"<大小> <修改时间秒>.<纳秒> <摘要>"，版本不符时忽略
+std::string DigestCache::getXattr(const OpenFile &file,
+                                  DigestAlgorithm algorithm,
+                                  const Version &version) {
+    char value[256];
+    ssize_t n = fgetxattr(file.fd(), infoOf(algorithm).xattr.data(), value,
+                          sizeof(value) - 1);
+    if (n <= 0) return {};
+    value[n] = '\0';
+    unsigned long long size = 0;
+    long long sec = 0;
+    unsigned nsec = 0;
+    char digest[sizeof(value)];
+    int fields =
+        std::sscanf(value, "%llu %lld.%u %255s", &size, &sec, &nsec, digest);
+    if (fields != 4 || size != version.size || sec != version.mtime_sec ||
+        nsec != version.mtime_nsec) {
+        return {};
+    }
+    return digest;
+}
+
+void DigestCache::setXattr(const OpenFile &file, DigestAlgorithm algorithm,
+                           const std::string &digest) {
+    const Version version(file.stat());
+    std::string value = std::to_string(version.size) + ' ' +
+                        std::to_string(version.mtime_sec) + '.' +
+                        std::to_string(version.mtime_nsec) + ' ' + digest;
+    // 文件系统不支持或没有权限时只保留内存中的缓存
+    if (fsetxattr(file.fd(), infoOf(algorithm).xattr.data(), value.data(),
+                  value.size(), 0) < 0) {
+        SPDLOG_DEBUG("写入摘要扩展属性失败: {}", strerror(errno));
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "openfilecache.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unordered_map>
+
+// HASH/XCRC/XMD5/XSHA256支持的摘要算法
+enum class DigestAlgorithm { CRC32, CRC32C, MD5, SHA1, SHA256, SHA512 };
+
+// HASH命令中的算法名(draft-bryan-ftpext-hash)，如"SHA-256"
+std::string_view digestName(DigestAlgorithm algorithm);
+// 不区分大小写，未知的算法返回false
+bool parseDigestName(std::string_view name, DigestAlgorithm &algorithm);
+// CRC-32C(Castagnoli)，与zlib的crc32相同，crc为之前的结果，初始为0
+// CPU支持SSE4.2时使用crc32指令，运行时选择
+uint32_t crc32c(uint32_t crc, const void *data, size_t size);
+// 读取fd中[offset, end)计算摘要，返回小写十六进制，读取失败时返回空串
+// SHA/MD5由OpenSSL计算，它在运行时按CPU选择SHA-NI/AVX2等实现
+std::string computeDigest(int fd, off_t offset, off_t end,
+                          DigestAlgorithm algorithm);
+
+// 整个文件的摘要缓存，所有会话共享
+// 以设备号和inode为键，大小或修改时间变化后自动失效；
+// 可选把摘要写入文件的扩展属性(user.ftp.<算法>)，服务器重启后仍然有效
+class DigestCache {
+ public:
+    explicit DigestCache(size_t max_entries = 4096, bool xattr = false);
+    DigestCache(const DigestCache &) = delete;
+    DigestCache &operator=(const DigestCache &) = delete;
+
+    // 命中时返回十六进制摘要，否则返回空串
+    std::string get(const OpenFile &file, DigestAlgorithm algorithm);
+    void put(const OpenFile &file, DigestAlgorithm algorithm,
+             const std::string &digest);
+
+ private:
+    struct Key {
+        uint32_t dev_major;
+        uint32_t dev_minor;
+        uint64_t ino;
+        DigestAlgorithm algorithm;
+        bool operator==(const Key &other) const = default;
+    };
+    struct KeyHash {
+        size_t operator()(const Key &key) const;
+    };
+    // 摘要对应的文件版本；扩展属性的写入会改变ctime，只比较大小和修改时间
+    struct Version {
+        uint64_t size;
+        int64_t mtime_sec;
+        uint32_t mtime_nsec;
+        explicit Version(const struct statx &stx);
+        bool operator==(const Version &other) const = default;
+    };
+    struct Entry {
+        Key key;
+        Version version;
+        std::string digest;
+    };
+    static Key keyOf(const struct statx &stx, DigestAlgorithm algorithm);
+    // 调用方需持有锁
+    void insert(const Key &key, const Version &version, std::string digest);
+    std::string getXattr(const OpenFile &file, DigestAlgorithm algorithm,
+                         const Version &version);
+    void setXattr(const OpenFile &file, DigestAlgorithm algorithm,
+                  const std::string &digest);
+
+    const size_t m_max_entries;
+    const bool m_xattr;
+    std::mutex m_mtx;
+    std::list<Entry> m_lru; // 表头为最近使用
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_index;
+};
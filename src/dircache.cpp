@@ -0,0 +1,179 @@
+#include "dircache.h"
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <format>
+#include <iterator>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 目录内容(增删改名)或其中文件的大小、属性变化都会使列表失效
+const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                            IN_MOVED_TO | IN_MODIFY | IN_ATTRIB |
+                            IN_DELETE_SELF | IN_MOVE_SELF;
+
+DirCache::DirCache(size_t max_entries) : m_max_entries(max_entries) {
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify_fd < 0) {
+        spdlog::warn("inotify不可用，目录缓存改用mtime检查: {}",
+                     strerror(errno));
+    }
+}
+
+DirCache::~DirCache() {
+    if (m_inotify_fd >= 0) close(m_inotify_fd);
+}
+
+std::shared_ptr<const std::string> DirCache::get(const std::string &dir,
+                                                 int dirfd, Format format) {
+    {
+        std::shared_lock lock(m_mtx);
+        auto it = m_entries.find(dir);
+        if (it != m_entries.end() &&
+            (it->second->wd >= 0 || unchanged(dirfd, it->second->mtime))) {
+            return {it->second, &it->second->payloads[format]};
+        }
+    }
+    // 先添加监视再扫描，扫描期间发生的变化会使本次结果不被缓存
+    int wd = -1;
+    uint64_t generation = 0;
+    if (m_inotify_fd >= 0) {
+        std::unique_lock lock(m_mtx);
+        std::string proc = std::format("/proc/self/fd/{}", dirfd);
+        wd = inotify_add_watch(m_inotify_fd, proc.c_str(), WATCH_MASK);
+        if (wd >= 0) {
+            Watch &watch = m_watches[wd];
+            watch.dirs.insert(dir);
+            generation = watch.generation;
+        }
+    }
+    auto listing = scan(dirfd);
+    if (!listing) return nullptr;
+    listing->wd = wd;
+    std::unique_lock lock(m_mtx);
+    auto watch = m_watches.find(wd);
+    if (wd < 0 ||
+        (watch != m_watches.end() && watch->second.generation == generation)) {
+        if (m_entries.size() >= m_max_entries) evictOne();
+        m_entries[dir] = listing;
+    }
+    return {listing, &listing->payloads[format]};
+}
+
+void DirCache::processEvents() {
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t len = read(m_inotify_fd, buffer, sizeof(buffer));
+        if (len <= 0) break;
+        std::unique_lock lock(m_mtx);
+        for (ssize_t pos = 0; pos < len;) {
+            auto *event = reinterpret_cast<inotify_event *>(buffer + pos);
+            pos += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                spdlog::warn("inotify事件队列溢出，清空目录列表缓存");
+                clear();
+                continue;
+            }
+            auto watch = m_watches.find(event->wd);
+            if (watch == m_watches.end()) continue;
+            ++watch->second.generation;
+            for (const auto &dir : watch->second.dirs) m_entries.erase(dir);
+            if (event->mask & IN_IGNORED) m_watches.erase(watch);
+        }
+    }
+}
+
+void DirCache::evictOne() {
+    auto victim = m_entries.begin();
+    // 同一目录的其他路径仍在使用时保留监视
+    if (auto watch = m_watches.find(victim->second->wd);
+        watch != m_watches.end()) {
+        watch->second.dirs.erase(victim->first);
+        if (watch->second.dirs.empty()) {
+            inotify_rm_watch(m_inotify_fd, watch->first);
+            m_watches.erase(watch);
+        }
+    }
+    m_entries.erase(victim);
+}
+
+void DirCache::clear() {
+    // 正在扫描的目录找不到自己的监视，扫描结果不会被缓存
+    for (const auto &[wd, watch] : m_watches) {
+        inotify_rm_watch(m_inotify_fd, wd);
+    }
+    m_watches.clear();
+    m_entries.clear();
+}
+
+bool DirCache::unchanged(int dirfd, const timespec &mtime) {
+    struct stat st;
+    return fstat(dirfd, &st) == 0 && st.st_mtim.tv_sec == mtime.tv_sec &&
+           st.st_mtim.tv_nsec == mtime.tv_nsec;
+}
+
+static std::string permissions(mode_t mode) {
+    std::string perms = S_ISDIR(mode) ? "d" : S_ISLNK(mode) ? "l" : "-";
+    const char *rwx = "rwxrwxrwx";
+    for (int i = 0; i < 9; ++i) {
+        perms += (mode & (0400 >> i)) ? rwx[i] : '-';
+    }
+    return perms;
+}
+
+// ls -l风格，半年内的文件显示时间，否则显示年份
+static void appendListLine(std::string &out, const char *name,
+                           const struct stat &st, time_t now) {
+    tm mtime;
+    gmtime_r(&st.st_mtime, &mtime);
+    char date[16];
+    const bool recent = now - st.st_mtime < 180 * 24 * 3600;
+    strftime(date, sizeof(date), recent ? "%b %e %H:%M" : "%b %e  %Y", &mtime);
+    std::format_to(std::back_inserter(out), "{} {:>3} {:<8} {:<8} {:>12} {} {}\r\n",
+                   permissions(st.st_mode), st.st_nlink, st.st_uid, st.st_gid,
+                   st.st_size, date, name);
+}
+
+// RFC 3659 MLSD事实
+static void appendMlsdLine(std::string &out, const char *name,
+                           const struct stat &st) {
+    tm mtime;
+    gmtime_r(&st.st_mtime, &mtime);
+    char modify[16];
+    strftime(modify, sizeof(modify), "%Y%m%d%H%M%S", &mtime);
+    std::format_to(std::back_inserter(out),
+                   "type={};size={};modify={};unix.mode=0{:o}; {}\r\n",
+                   S_ISDIR(st.st_mode) ? "dir" : "file", st.st_size, modify,
+                   st.st_mode & 07777, name);
+}
+
+std::shared_ptr<DirCache::Listing> DirCache::scan(int dirfd) {
+    // dirfd可能是O_PATH，需要重新打开才能读取目录项
+    int fd = openat(dirfd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    DIR *d = fdopendir(fd);
+    if (!d) {
+        close(fd);
+        return nullptr;
+    }
+    auto listing = std::make_shared<Listing>();
+    struct stat dir_st;
+    fstat(fd, &dir_st);
+    listing->mtime = dir_st.st_mtim;
+    time_t now = time(nullptr);
+    while (dirent *entry = readdir(d)) {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        struct stat st;
+        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) continue;
+        appendListLine(listing->payloads[LIST], name, st, now);
+        listing->payloads[NLST].append(name).append("\r\n");
+        appendMlsdLine(listing->payloads[MLSD], name, st);
+    }
+    closedir(d);
+    return listing;
+}
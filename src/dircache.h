@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// 目录列表缓存，所有会话共享
+// 每个目录扫描一次，同时生成LIST/NLST/MLSD三种格式的内容；
+// 通过inotify监视目录变化使缓存失效，无法添加监视时退化为比较目录mtime
+class DirCache {
+ public:
+    enum Format { LIST, NLST, MLSD };
+    explicit DirCache(size_t max_entries = 1024);
+    DirCache(const DirCache &) = delete;
+    DirCache &operator=(const DirCache &) = delete;
+    ~DirCache();
+
+    // 返回目录对应格式的列表内容，目录不可读时返回空指针
+    // dir为缓存键(虚拟路径)，dirfd为该目录已打开的fd
+    std::shared_ptr<const std::string> get(const std::string &dir, int dirfd,
+                                           Format format);
+    // inotify fd，可读时调用processEvents()
+    int fd() const { return m_inotify_fd; }
+    void processEvents();
+
+ private:
+    struct Listing {
+        std::string payloads[3]; // 按Format索引
+        timespec mtime;
+        int wd; // inotify监视描述符，-1表示使用mtime检查
+    };
+    struct Watch {
+        // 经由符号链接等不同路径到达的同一目录共用一个监视
+        std::unordered_set<std::string> dirs;
+        uint64_t generation = 0; // 每收到一个事件加一
+    };
+    static std::shared_ptr<Listing> scan(int dirfd);
+    static bool unchanged(int dirfd, const timespec &mtime);
+    // 以下调用方需持有写锁
+    // 缓存已满时淘汰一个目录
+    void evictOne();
+    // 事件队列溢出后无法知道哪些目录变化了，删除所有列表和监视
+    void clear();
+
+    const size_t m_max_entries;
+    int m_inotify_fd = -1;
+    std::shared_mutex m_mtx;
+    std::unordered_map<std::string, std::shared_ptr<const Listing>> m_entries;
+    std::unordered_map<int, Watch> m_watches; // wd -> 目录的各个路径
+};
@@ -0,0 +1,189 @@
+#include "dirfdcache.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <linux/openat2.h>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+DirFd::~DirFd() { close(m_fd); }
+
+DirFdCache::DirFdCache(const std::string &root, size_t max_entries)
+    : m_max_entries(max_entries) {
+    int fd = open(root.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error(
+            std::format("无法打开根目录 {}: {}", root, strerror(errno)));
+    }
+    m_root = std::make_shared<const DirFd>(fd);
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify_fd < 0) {
+        spdlog::warn("inotify不可用，不缓存目录fd: {}", strerror(errno));
+    }
+}
+
+DirFdCache::~DirFdCache() {
+    if (m_inotify_fd >= 0) close(m_inotify_fd);
+}
+
+std::string DirFdCache::normalize(std::string_view cwd, std::string_view arg) {
+    std::vector<std::string_view> parts;
+    auto split = [&parts](std::string_view path) {
+        while (!path.empty()) {
+            size_t pos = path.find('/');
+            std::string_view part = path.substr(0, pos);
+            path = pos == path.npos ? "" : path.substr(pos + 1);
+            if (part.empty() || part == ".") continue;
+            if (part != "..") {
+                parts.push_back(part);
+            } else if (!parts.empty()) {
+                parts.pop_back();
+            }
+        }
+    };
+    if (arg.empty() || arg[0] != '/') split(cwd);
+    split(arg);
+    std::string path;
+    for (auto part : parts) { path.append("/").append(part); }
+    return path.empty() ? "/" : path;
+}
+
+int DirFdCache::openBeneath(int dirfd, const char *name, int flags,
+                            mode_t mode) {
+    static std::atomic<bool> has_openat2 = true;
+    if (has_openat2.load(std::memory_order_relaxed)) {
+        open_how how{};
+        how.flags = flags;
+        how.mode = (flags & O_CREAT) ? mode : 0;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+        long fd = syscall(SYS_openat2, dirfd, name, &how, sizeof(how));
+        if (fd >= 0 || errno != ENOSYS) return fd;
+        has_openat2.store(false, std::memory_order_relaxed);
+        spdlog::warn("内核不支持openat2，只能做到路径的词法限制");
+    }
+    // 路径已规范化不含".."，但中间的符号链接仍可能指向根目录之外
+    return openat(dirfd, name, flags | O_NOFOLLOW, mode);
+}
+
+std::shared_ptr<const DirFd> DirFdCache::lookup(const std::string &path) {
+    std::shared_lock lock(m_mtx);
+    auto it = m_entries.find(path);
+    if (it == m_entries.end()) return nullptr;
+    auto dir = it->second.dir;
+    lock.unlock();
+    // 目录已被删除但inotify事件尚未处理
+    struct stat st;
+    if (fstat(dir->get(), &st) < 0 || st.st_nlink == 0) return nullptr;
+    return dir;
+}
+
+std::shared_ptr<const DirFd> DirFdCache::openDir(const std::string &path) {
+    if (path == "/") return m_root;
+    if (auto dir = lookup(path)) return dir;
+    // 先缓存各级父目录，使每一级都有监视，任何一级改名都会删除整棵子树
+    const std::string parent =
+        path.substr(0, std::max<size_t>(path.rfind('/'), 1));
+    if (m_inotify_fd >= 0 && !openDir(parent)) return nullptr;
+    const char *relative = path.c_str() + 1;
+    int fd = openBeneath(m_root->get(), relative,
+                         O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    auto dir = std::make_shared<const DirFd>(fd);
+    if (m_inotify_fd < 0) return dir;
+    // O_PATH fd不能直接用于inotify，通过/proc按fd添加监视
+    std::string proc = std::format("/proc/self/fd/{}", fd);
+    int wd = inotify_add_watch(m_inotify_fd, proc.c_str(),
+                               IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    if (wd < 0) return dir;
+    // 打开之后、添加监视之前目录可能已被改名，确认路径仍指向同一目录
+    struct stat opened, current;
+    const bool same = fstat(fd, &opened) == 0 &&
+                      fstatat(m_root->get(), relative, &current, 0) == 0 &&
+                      opened.st_dev == current.st_dev &&
+                      opened.st_ino == current.st_ino;
+    std::unique_lock lock(m_mtx);
+    if (!(same && insert(path, parent, dir, wd)) && !m_watches.contains(wd)) {
+        inotify_rm_watch(m_inotify_fd, wd);
+    }
+    return dir;
+}
+
+bool DirFdCache::insert(const std::string &path, const std::string &parent,
+                        std::shared_ptr<const DirFd> dir, int wd) {
+    if (m_entries.contains(path)) return false; // 其他线程已经缓存
+    if (!m_entries.empty() && m_entries.size() >= m_max_entries) {
+        // 淘汰的目录连同子树一起删除，缓存中的目录的父目录总在缓存中
+        eraseTree(std::string(m_entries.begin()->first));
+    }
+    // 父目录已经因改名被删除或刚被淘汰，path可能已指向别处
+    if (parent != "/" && !m_entries.contains(parent)) return false;
+    m_entries.emplace(path, Entry{std::move(dir), wd});
+    m_watches.emplace(wd, path);
+    return true;
+}
+
+void DirFdCache::erase(std::map<std::string, Entry, std::less<>>::iterator it) {
+    const int wd = it->second.wd;
+    auto [first, last] = m_watches.equal_range(wd);
+    for (auto w = first; w != last; ++w) {
+        if (w->second == it->first) {
+            m_watches.erase(w);
+            break;
+        }
+    }
+    if (!m_watches.contains(wd)) inotify_rm_watch(m_inotify_fd, wd);
+    m_entries.erase(it);
+}
+
+void DirFdCache::eraseTree(const std::string &path) {
+    // "/a"的子树之间可能夹着"/a-b"这样的兄弟目录，不能遇到第一个不匹配就停止
+    auto it = m_entries.lower_bound(path);
+    while (it != m_entries.end() && it->first.starts_with(path)) {
+        const std::string &key = it->first;
+        if (key.size() == path.size() || key[path.size()] == '/') {
+            erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void DirFdCache::clear() {
+    for (const auto &[wd, path] : m_watches) {
+        inotify_rm_watch(m_inotify_fd, wd);
+    }
+    m_watches.clear();
+    m_entries.clear();
+}
+
+void DirFdCache::processEvents() {
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t len = read(m_inotify_fd, buffer, sizeof(buffer));
+        if (len <= 0) break;
+        std::unique_lock lock(m_mtx);
+        for (ssize_t pos = 0; pos < len;) {
+            auto *event = reinterpret_cast<inotify_event *>(buffer + pos);
+            pos += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                spdlog::warn("inotify事件队列溢出，清空目录fd缓存");
+                clear();
+                continue;
+            }
+            // 改名或删除后，该目录及其子目录的缓存路径都已失效
+            std::vector<std::string> paths;
+            auto [first, last] = m_watches.equal_range(event->wd);
+            for (auto w = first; w != last; ++w) { paths.push_back(w->second); }
+            for (const auto &path : paths) { eraseTree(path); }
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unordered_map>
+
+// 析构时自动关闭的fd
+class DirFd {
+ public:
+    explicit DirFd(int fd) : m_fd(fd) {}
+    DirFd(const DirFd &) = delete;
+    DirFd &operator=(const DirFd &) = delete;
+    ~DirFd();
+    int get() const { return m_fd; }
+
+ private:
+    const int m_fd;
+};
+
+// 服务器根目录下的路径解析，代替进程级的chdir
+// 会话使用相对根目录的虚拟路径(以'/'开头)，所有访问都通过openat2(RESOLVE_BENEATH)
+// 限制在根目录之内；常用目录的O_PATH fd在所有会话间共享，
+// 缓存的目录及其各级父目录都有inotify监视，其中任何一级被删除或改名时
+// 整棵子树的缓存失效
+class DirFdCache {
+ public:
+    explicit DirFdCache(const std::string &root, size_t max_entries = 1024);
+    DirFdCache(const DirFdCache &) = delete;
+    DirFdCache &operator=(const DirFdCache &) = delete;
+    ~DirFdCache();
+
+    // 把参数解析为规范化的虚拟路径，".."不会越过根目录
+    static std::string normalize(std::string_view cwd, std::string_view arg);
+    // 返回虚拟路径对应目录的O_PATH fd，失败时返回空指针并设置errno
+    std::shared_ptr<const DirFd> openDir(const std::string &path);
+    // 相对dirfd打开name，不允许越过dirfd
+    static int openBeneath(int dirfd, const char *name, int flags,
+                           mode_t mode = 0);
+    // inotify fd，可读时调用processEvents()
+    int fd() const { return m_inotify_fd; }
+    void processEvents();
+
+ private:
+    struct Entry {
+        std::shared_ptr<const DirFd> dir;
+        int wd = -1;
+    };
+    std::shared_ptr<const DirFd> lookup(const std::string &path);
+    // 以下调用方需持有写锁
+    // parent不在缓存中时不插入，返回是否插入
+    bool insert(const std::string &path, const std::string &parent,
+                std::shared_ptr<const DirFd> dir, int wd);
+    // 删除path及其所有子目录的缓存
+    void eraseTree(const std::string &path);
+    void erase(std::map<std::string, Entry, std::less<>>::iterator it);
+    // 事件队列溢出后无法知道哪些目录被改名，删除所有缓存项和监视
+    void clear();
+
+    const size_t m_max_entries;
+    std::shared_ptr<const DirFd> m_root;
+    int m_inotify_fd = -1;
+    std::shared_mutex m_mtx;
+    // 有序，便于目录改名时删除整棵子树
+    std::map<std::string, Entry, std::less<>> m_entries;
+    // wd -> 虚拟路径，经符号链接访问时同一目录可能对应多个路径
+    std::unordered_multimap<int, std::string> m_watches;
+};
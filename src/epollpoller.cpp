@@ -0,0 +1,55 @@
+#include "epollpoller.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+EpollPoller::EpollPoller() {
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1) { throw std::runtime_error("epoll创建失败"); }
+}
+
+EpollPoller::~EpollPoller() { close(m_epoll_fd); }
+
+bool EpollPoller::add(int fd, uint32_t events) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        spdlog::error("epoll注册失败: {}", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool EpollPoller::modify(int fd, uint32_t events) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1) {
+        spdlog::error("epoll修改失败: {}", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void EpollPoller::remove(int fd) {
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+bool EpollPoller::addAcceptor(int listen_fd) {
+    return add(listen_fd, EPOLLIN | EPOLLET); // 边缘触发模式
+}
+
+int EpollPoller::wait(Event *events, int max_events, int timeout_ms) {
+    struct epoll_event ready[MAX_EVENTS];
+    int num_events = epoll_wait(m_epoll_fd, ready,
+                                std::min(max_events, MAX_EVENTS), timeout_ms);
+    for (int i = 0; i < num_events; ++i) {
+        events[i] = Event{ready[i].data.fd, ready[i].events};
+    }
+    return num_events;
+}
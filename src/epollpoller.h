@@ -0,0 +1,20 @@
+#pragma once
+#include "poller.h"
+
+class EpollPoller : public Poller {
+ public:
+    EpollPoller();
+    EpollPoller(const EpollPoller &) = delete;
+    EpollPoller &operator=(const EpollPoller &) = delete;
+    ~EpollPoller() override;
+
+    bool add(int fd, uint32_t events) override;
+    bool modify(int fd, uint32_t events) override;
+    void remove(int fd) override;
+    bool addAcceptor(int listen_fd) override;
+    int wait(Event *events, int max_events, int timeout_ms) override;
+
+ private:
+    static constexpr int MAX_EVENTS = 64;
+    int m_epoll_fd = -1;
+};
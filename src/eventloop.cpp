@@ -0,0 +1,138 @@
+#include "eventloop.h"
+#include <cerrno>
+#include <cstring>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+EventLoop::EventLoop() : m_poller(Poller::create()) {
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeup_fd == -1) { throw std::runtime_error("eventfd创建失败"); }
+    if (!m_poller->add(m_wakeup_fd, EPOLLIN)) {
+        close(m_wakeup_fd);
+        throw std::runtime_error("epoll注册失败");
+    }
+}
+
+EventLoop::~EventLoop() {
+    m_poller->remove(m_wakeup_fd);
+    close(m_wakeup_fd);
+}
+
+bool EventLoop::add(int fd, uint32_t events, Handler &&handler) {
+    if (!m_poller->add(fd, events)) return false;
+    m_handlers[fd] = std::make_unique<Handler>(std::move(handler));
+    return true;
+}
+
+bool EventLoop::addAcceptor(int listen_fd, AcceptHandler &&handler) {
+    if (!m_poller->addAcceptor(listen_fd)) return false;
+    m_acceptors[listen_fd] =
+        std::make_unique<AcceptHandler>(std::move(handler));
+    return true;
+}
+
+bool EventLoop::modify(int fd, uint32_t events) {
+    return m_poller->modify(fd, events);
+}
+
+void EventLoop::remove(int fd) {
+    if (auto it = m_handlers.find(fd); it != m_handlers.end()) {
+        m_poller->remove(fd);
+        m_removed.push_back(std::move(it->second));
+        m_handlers.erase(it);
+    } else if (auto it = m_acceptors.find(fd); it != m_acceptors.end()) {
+        m_poller->remove(fd);
+        m_removed_acceptors.push_back(std::move(it->second));
+        m_acceptors.erase(it);
+    }
+}
+
+void EventLoop::post(Task &&task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_pending.push_back(std::move(task));
+    }
+    wakeup();
+}
+
+EventLoop::TimerId EventLoop::runAfter(std::chrono::milliseconds delay,
+                                       Task &&task) {
+    return m_timers.add(Clock::now() + delay, std::move(task));
+}
+
+void EventLoop::cancel(const TimerId &timer) { m_timers.cancel(timer); }
+
+void EventLoop::run() {
+    Poller::Event events[MAX_EVENTS];
+    while (m_running) {
+        int num_events = m_poller->wait(events, MAX_EVENTS,
+                                        m_timers.nextTimeout(Clock::now()));
+        if (num_events == -1) {
+            if (errno == EINTR) continue;
+            spdlog::error("事件循环错误: {}", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < num_events; ++i) { dispatch(events[i]); }
+        m_removed.clear();
+        m_removed_acceptors.clear();
+        m_timers.advance(Clock::now());
+        runPendingTasks();
+    }
+    // 退出前执行stop()之前投递的任务
+    runPendingTasks();
+}
+
+void EventLoop::stop() {
+    m_running = false;
+    wakeup();
+}
+
+void EventLoop::dispatch(const Poller::Event &event) {
+    if (event.fd == m_wakeup_fd) {
+        uint64_t count;
+        while (read(m_wakeup_fd, &count, sizeof(count)) > 0) {}
+        return;
+    }
+    if (auto it = m_handlers.find(event.fd); it != m_handlers.end()) {
+        (*it->second)(event.events);
+        return;
+    }
+    auto it = m_acceptors.find(event.fd);
+    if (it == m_acceptors.end()) return; // 本轮中已被移除
+    acceptAll(event.fd, *it->second);
+}
+
+void EventLoop::acceptAll(int listen_fd, AcceptHandler &handler) {
+    for (;;) { // 边缘触发需要循环accept
+        int sock = accept4(listen_fd, nullptr, nullptr,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sock == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            spdlog::error("接受连接失败: {}", strerror(errno));
+            break;
+        }
+        handler(sock);
+    }
+}
+
+void EventLoop::wakeup() {
+    uint64_t one = 1;
+    if (write(m_wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        spdlog::error("唤醒事件循环失败: {}", strerror(errno));
+    }
+}
+
+void EventLoop::runPendingTasks() {
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        tasks.swap(m_pending);
+    }
+    for (auto &task : tasks) { task(); }
+    m_removed.clear();
+    m_removed_acceptors.clear();
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "poller.h"
+#include "timerwheel.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <vector>
+
+// 事件循环，通过Poller等待I/O就绪
+// 所有回调和投递的任务都在run()所在线程执行
+class EventLoop {
+ public:
+    using Handler = std::function<void(uint32_t events)>;
+    // 参数为新连接的非阻塞socket
+    using AcceptHandler = std::function<void(int socket)>;
+    using Task = std::function<void()>;
+    using Clock = TimerWheel::Clock;
+    // 默认构造的TimerId不对应任何定时器，可以安全地cancel
+    using TimerId = TimerWheel::TimerId;
+
+    EventLoop();
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+    ~EventLoop();
+
+    // add/addAcceptor/modify/remove 只能在事件循环线程中调用
+    bool add(int fd, uint32_t events, Handler &&handler);
+    // 注册监听socket，由事件循环完成accept后回调
+    bool addAcceptor(int listen_fd, AcceptHandler &&handler);
+    bool modify(int fd, uint32_t events);
+    void remove(int fd);
+    // 线程安全，任务会在事件循环线程中执行
+    void post(Task &&task);
+    // delay之后在事件循环线程中执行一次task，只能在事件循环线程中调用
+    TimerId runAfter(std::chrono::milliseconds delay, Task &&task);
+    void cancel(const TimerId &timer);
+    void run();
+    void stop();
+
+ private:
+    void wakeup();
+    void runPendingTasks();
+    void dispatch(const Poller::Event &event);
+    void acceptAll(int listen_fd, AcceptHandler &handler);
+
+    static const int MAX_EVENTS = 64;
+    std::unique_ptr<Poller> m_poller;
+    int m_wakeup_fd = -1; // eventfd，用于唤醒等待中的事件循环
+    std::atomic<bool> m_running = true;
+    std::unordered_map<int, std::unique_ptr<Handler>> m_handlers;
+    std::unordered_map<int, std::unique_ptr<AcceptHandler>> m_acceptors;
+    // 在回调中被移除的处理器，等本轮分发结束后再释放
+    std::vector<std::unique_ptr<Handler>> m_removed;
+    std::vector<std::unique_ptr<AcceptHandler>> m_removed_acceptors;
+    std::mutex m_mtx;
+    std::vector<Task> m_pending;
+    // 会话的登录、空闲、数据连接等超时，数量与连接数相当
+    TimerWheel m_timers;
+};
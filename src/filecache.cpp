@@ -0,0 +1,94 @@
+#include "filecache.h"
+#include <functional>
+
+// 每个条目除内容外的估算开销：链表节点、索引节点和路径
+constexpr size_t ENTRY_OVERHEAD = 128;
+
+FileCache::Version::Version(const struct statx &stx)
+    : dev_major(stx.stx_dev_major), dev_minor(stx.stx_dev_minor),
+      ino(stx.stx_ino), size(stx.stx_size), mtime(stx.stx_mtime),
+      ctime(stx.stx_ctime) {}
+
+bool FileCache::Version::operator==(const Version &other) const {
+    return dev_major == other.dev_major && dev_minor == other.dev_minor &&
+           ino == other.ino && size == other.size &&
+           mtime.tv_sec == other.mtime.tv_sec &&
+           mtime.tv_nsec == other.mtime.tv_nsec &&
+           ctime.tv_sec == other.ctime.tv_sec &&
+           ctime.tv_nsec == other.ctime.tv_nsec;
+}
+
+FileCache::FileCache(size_t capacity, size_t max_file_size)
+    : m_shard_capacity(capacity / SHARDS), m_max_file_size(max_file_size) {}
+
+FileCache::Shard &FileCache::shardOf(const std::string &path) {
+    return m_shards[std::hash<std::string>{}(path) % SHARDS];
+}
+
+void FileCache::erase(Shard &shard, std::list<Entry>::iterator it) {
+    shard.bytes -= it->cost;
+    shard.index.erase(it->path);
+    shard.lru.erase(it);
+}
+
+std::shared_ptr<const std::string> FileCache::get(const std::string &path,
+                                                  const Version &version) {
+    Shard &shard = shardOf(path);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto found = shard.index.find(path);
+    if (found == shard.index.end()) {
+        ++shard.misses;
+        return nullptr;
+    }
+    auto it = found->second;
+    if (!(it->version == version)) {
+        erase(shard, it);
+        ++shard.misses;
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it);
+    ++shard.hits;
+    return it->content;
+}
+
+void FileCache::put(const std::string &path, const Version &version,
+                    std::shared_ptr<const std::string> content) {
+    const size_t cost = content->size() + path.size() + ENTRY_OVERHEAD;
+    if (cost > m_shard_capacity) return;
+    Shard &shard = shardOf(path);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    // 其他会话可能同时未命中并读取了同一个文件，以后放入的为准
+    if (auto found = shard.index.find(path); found != shard.index.end()) {
+        erase(shard, found->second);
+    }
+    while (shard.bytes + cost > m_shard_capacity) {
+        // 正在发送中的内容由会话持有的shared_ptr保活
+        erase(shard, std::prev(shard.lru.end()));
+        ++shard.evictions;
+    }
+    shard.lru.push_front({path, version, std::move(content), cost});
+    shard.index.emplace(path, shard.lru.begin());
+    shard.bytes += cost;
+}
+
+void FileCache::invalidate(const std::string &path) {
+    if (!enabled()) return;
+    Shard &shard = shardOf(path);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    if (auto found = shard.index.find(path); found != shard.index.end()) {
+        erase(shard, found->second);
+    }
+}
+
+FileCache::Stats FileCache::stats() {
+    Stats stats;
+    for (Shard &shard : m_shards) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.evictions += shard.evictions;
+        stats.bytes += shard.bytes;
+        stats.entries += shard.lru.size();
+    }
+    return stats;
+}
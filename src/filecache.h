@@ -0,0 +1,80 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+
+// 小文件内容缓存，所有会话共享，RETR命中时直接从内存发送
+// 按路径哈希分成多个分片，每个分片一把锁、一条LRU链表，内存预算平均分配；
+// 每次查找都比较文件的inode、大小和修改时间，文件被修改后缓存自动失效
+class FileCache {
+ public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t bytes = 0; // 已占用的内存(含估算的条目开销)
+        size_t entries = 0;
+    };
+    // 文件的身份，任何一项变化都说明缓存的内容已经过期
+    struct Version {
+        uint32_t dev_major = 0;
+        uint32_t dev_minor = 0;
+        uint64_t ino = 0;
+        uint64_t size = 0;
+        statx_timestamp mtime{};
+        statx_timestamp ctime{};
+        explicit Version(const struct statx &stx);
+        bool operator==(const Version &other) const;
+    };
+
+    // capacity为内存预算(字节)，为0时不缓存；超过max_file_size的文件不缓存
+    explicit FileCache(size_t capacity, size_t max_file_size = 64 << 10);
+    FileCache(const FileCache &) = delete;
+    FileCache &operator=(const FileCache &) = delete;
+
+    bool enabled() const { return m_shard_capacity != 0; }
+    // 文件是否适合放入缓存
+    bool cacheable(const struct statx &stx) const {
+        return enabled() && S_ISREG(stx.stx_mode) &&
+               stx.stx_size <= m_max_file_size;
+    }
+    // path为虚拟路径，version与缓存中的不一致时视为未命中并丢弃旧内容
+    std::shared_ptr<const std::string> get(const std::string &path,
+                                           const Version &version);
+    void put(const std::string &path, const Version &version,
+             std::shared_ptr<const std::string> content);
+    // 服务器自己修改了文件，不依赖时间戳精度立即丢弃
+    void invalidate(const std::string &path);
+    Stats stats();
+
+ private:
+    struct Entry {
+        std::string path;
+        Version version;
+        std::shared_ptr<const std::string> content;
+        size_t cost;
+    };
+    struct Shard {
+        std::mutex mtx;
+        std::list<Entry> lru; // 表头为最近使用
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+    static constexpr size_t SHARDS = 16;
+    Shard &shardOf(const std::string &path);
+    // 调用方需持有分片的锁
+    static void erase(Shard &shard, std::list<Entry>::iterator it);
+
+    const size_t m_shard_capacity;
+    const size_t m_max_file_size;
+    std::array<Shard, SHARDS> m_shards;
+};
@@ -1,40 +1,123 @@
 #include "ftpcmd.h"
-#include <cstring>
-#include <netinet/in.h>
-#include <regex>
-#include <spdlog/spdlog.h>
-#include <sys/socket.h>
-#include <unistd.h>
-
-std::vector<std::regex> FTPCommandParser::m_command_regexes{
-    std::regex(R"(^USER\s+(\S+))"),
-    std::regex(R"(^PASS\s+(\S+))"),
-    std::regex(R"(^QUIT\s*)"),
-    std::regex(R"(^CWD\s+(\S+))"),
-    std::regex(R"(^PWD\s*)"),
-    std::regex(R"(^LIST\s*(\S*))"),
-    std::regex(R"(^RETR\s+(\S+))"),
-    std::regex(R"(^STOR\s+(\S+))"),
-    std::regex(R"(^PASV)"),
-    std::regex(R"(^PORT\s+(\d+),(\d+),(\d+),(\d+),(\d+),(\d+))"),
-    std::regex(R"(^FEAT)"),
-    std::regex(R"(^AUTH\s+(\S+))"),
-    std::regex(R"(^NOOP\s*)"),
-    std::regex(R"(^ABOR)"),
+#include <array>
+
+namespace {
+// 把3~8个字符的动词按大写打包成一个整数，短的动词高位补0
+constexpr uint64_t verbKey(std::string_view verb) {
+    uint64_t key = 0;
+    for (char c : verb) { key = key << 8 | uint8_t(c); }
+    return key;
+}
+
+struct VerbInfo {
+    std::string_view verb;
+    FTPCMD command;
+    bool requires_arg;
 };
-FTPCommand FTPCommandParser::parse(const std::string &raw_cmd) {
+
+// 编译期按打包后的值排序，运行时二分查找
+constexpr auto VERBS = [] {
+    std::array<VerbInfo, Unknown> verbs{{
+        {"USER", USER, true},  {"PASS", PASS, false}, {"QUIT", QUIT, false},
+        {"CWD", CWD, true},    {"PWD", PWD, false},   {"LIST", LIST, false},
+        {"RETR", RETR, true},  {"STOR", STOR, true},  {"PASV", PASV, false},
+        {"PORT", PORT, true},  {"FEAT", FEAT, false}, {"AUTH", AUTH, true},
+        {"NOOP", NOOP, false}, {"ABOR", ABOR, false}, {"REST", REST, true},
+        {"APPE", APPE, true},  {"STOU", STOU, false}, {"ALLO", ALLO, true},
+        {"ACCT", ACCT, true},  {"CDUP", CDUP, false}, {"SMNT", SMNT, true},
+        {"REIN", REIN, false}, {"TYPE", TYPE, true},  {"STRU", STRU, true},
+        {"MODE", MODE, true},  {"RNFR", RNFR, true},  {"RNTO", RNTO, true},
+        {"DELE", DELE, true},  {"RMD", RMD, true},    {"MKD", MKD, true},
+        {"NLST", NLST, false}, {"SITE", SITE, true},  {"SYST", SYST, false},
+        {"STAT", STAT, false}, {"HELP", HELP, false}, {"OPTS", OPTS, true},
+        {"EPRT", EPRT, true},  {"EPSV", EPSV, false}, {"PBSZ", PBSZ, true},
+        {"PROT", PROT, true},  {"MDTM", MDTM, true},  {"SIZE", SIZE, true},
+        {"MLST", MLST, false}, {"MLSD", MLSD, false}, {"RANG", RANG, true},
+        {"HASH", HASH, true},  {"XCRC", XCRC, true},  {"XMD5", XMD5, true},
+        {"XSHA256", XSHA256, true},
+    }};
+    for (size_t i = 1; i < verbs.size(); ++i) {
+        for (size_t j = i; j > 0 && verbKey(verbs[j].verb) <
+                                        verbKey(verbs[j - 1].verb);
+             --j) {
+            std::swap(verbs[j], verbs[j - 1]);
+        }
+    }
+    return verbs;
+}();
+
+static_assert(
+    [] {
+        for (const auto &info : VERBS) {
+            if (info.verb.empty()) return false;
+        }
+        return true;
+    }(),
+    "每个命令都必须在VERBS中登记");
+
+// 按枚举值索引，用于requiresArg
+constexpr auto REQUIRES_ARG = [] {
+    std::array<bool, Unknown + 1> requires_arg{};
+    for (const auto &info : VERBS) {
+        requires_arg[info.command] = info.requires_arg;
+    }
+    return requires_arg;
+}();
+
+// 按枚举值索引，用于name
+constexpr auto NAMES = [] {
+    std::array<std::string_view, Unknown + 1> names{};
+    for (const auto &info : VERBS) { names[info.command] = info.verb; }
+    names[Unknown] = "UNKNOWN";
+    return names;
+}();
+
+FTPCMD lookup(uint64_t key) {
+    size_t lo = 0, hi = VERBS.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        uint64_t mid_key = verbKey(VERBS[mid].verb);
+        if (mid_key == key) return VERBS[mid].command;
+        if (mid_key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return Unknown;
+}
+} // namespace
+
+FTPCommand FTPCommandParser::parse(std::string_view raw_cmd) {
     FTPCommand ftp_cmd;
-    for (size_t i = 0; i < m_command_regexes.size(); ++i) {
-        std::smatch match;
-        if (std::regex_search(raw_cmd, match, m_command_regexes[i])) {
-            spdlog::debug("匹配到命令: {}", match[0].str());
-            ftp_cmd.command = static_cast<FTPCMD>(i);
-            for (size_t j = 1; j < match.size(); ++j) {
-                ftp_cmd.args.push_back(match[j].str());
-            }
-            return ftp_cmd;
+    // 去掉行尾的CRLF
+    while (!raw_cmd.empty() &&
+           (raw_cmd.back() == '\n' || raw_cmd.back() == '\r')) {
+        raw_cmd.remove_suffix(1);
+    }
+    size_t verb_end = raw_cmd.find(' ');
+    ftp_cmd.verb = raw_cmd.substr(0, verb_end);
+    if (verb_end != std::string_view::npos) {
+        size_t arg_begin = raw_cmd.find_first_not_of(' ', verb_end);
+        if (arg_begin != std::string_view::npos) {
+            ftp_cmd.arg = raw_cmd.substr(arg_begin);
         }
     }
-    ftp_cmd.command = FTPCMD::Unknown;
+    if (ftp_cmd.verb.size() < 3 || ftp_cmd.verb.size() > 8) return ftp_cmd;
+    uint64_t key = 0;
+    for (char c : ftp_cmd.verb) {
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A'; // 动词不区分大小写
+        // XSHA256等扩展命令的动词中有数字
+        if ((c < 'A' || c > 'Z') && (c < '0' || c > '9')) return ftp_cmd;
+        key = key << 8 | uint8_t(c);
+    }
+    ftp_cmd.command = lookup(key);
     return ftp_cmd;
 }
+
+bool FTPCommandParser::requiresArg(FTPCMD command) {
+    return REQUIRES_ARG[command];
+}
+std::string_view FTPCommandParser::name(FTPCMD command) {
+    return NAMES[command];
+}
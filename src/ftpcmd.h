@@ -1,8 +1,9 @@
 #pragma once
-#include <netinet/in.h>
-#include <regex>
-#include <string>
-#include <vector>
+#include <cstdint>
+#include <string_view>
+// RFC 959命令，RFC 2228/2389/2428/3659/4217中的扩展命令，
+// draft-bryan-ftp-range的RANG、draft-bryan-ftpext-hash的HASH，
+// 以及常见的摘要扩展XCRC/XMD5/XSHA256
 enum FTPCMD {
     USER,
     PASS,
@@ -18,18 +19,56 @@ enum FTPCMD {
     AUTH,
     NOOP,
     ABOR,
+    REST,
+    APPE,
+    STOU,
+    ALLO,
+    ACCT,
+    CDUP,
+    SMNT,
+    REIN,
+    TYPE,
+    STRU,
+    MODE,
+    RNFR,
+    RNTO,
+    DELE,
+    RMD,
+    MKD,
+    NLST,
+    SITE,
+    SYST,
+    STAT,
+    HELP,
+    OPTS,
+    EPRT,
+    EPSV,
+    PBSZ,
+    PROT,
+    MDTM,
+    SIZE,
+    MLST,
+    MLSD,
+    RANG,
+    HASH,
+    XCRC,
+    XMD5,
+    XSHA256,
     Unknown,
 };
 
+// 解析结果中的字符串都指向传入的命令行，不做任何内存分配
 struct FTPCommand {
-    FTPCMD command;
-    std::vector<std::string> args;
+    FTPCMD command = Unknown;
+    std::string_view verb;
+    std::string_view arg; // 动词之后的参数，可能为空
 };
 
 class FTPCommandParser {
  public:
-    static FTPCommand parse(const std::string &raw_cmd);
-
- private:
-    static std::vector<std::regex> m_command_regexes;
+    static FTPCommand parse(std::string_view raw_cmd);
+    // 该命令是否必须带参数
+    static bool requiresArg(FTPCMD command);
+    // 命令的动词，Unknown返回"UNKNOWN"
+    static std::string_view name(FTPCMD command);
 };
@@ -0,0 +1,235 @@
+#include "hotrestart.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// 第一条消息以Header开头，之后每条消息只有一个字节，socket都在附带的控制信息中
+// 依次为FTP监听socket、指标监听socket(如有)、被动模式监听socket
+constexpr uint32_t MAGIC = 0x46545048; // "FTPH"
+constexpr char CONFIRM = 'R';
+// 内核限制每条消息最多253个fd(SCM_MAX_FD)
+constexpr size_t FDS_PER_MESSAGE = 200;
+// 新进程等待旧进程回应的时间
+constexpr int TAKEOVER_TIMEOUT = 5;
+
+struct Header {
+    uint32_t magic;
+    uint32_t listeners;
+    uint32_t metrics;
+    uint32_t passive;
+};
+
+static sockaddr_un unixAddress(const std::string &path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("热重启socket路径过长: " + path);
+    }
+    std::memcpy(addr.sun_path, path.data(), path.size());
+    return addr;
+}
+
+// 对端必须与本进程同一用户或是root，否则任何能连上socket文件的用户
+// 都能拿到监听socket，或者让新进程在对方提供的socket上accept
+static bool trustedPeer(int sock) {
+    ucred cred{};
+    socklen_t len = sizeof(cred);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        spdlog::warn("无法获取热重启对端的身份: {}", strerror(errno));
+        return false;
+    }
+    if (cred.uid == geteuid() || cred.uid == 0) return true;
+    spdlog::warn("拒绝热重启对端: pid={} uid={}", cred.pid, cred.uid);
+    return false;
+}
+
+static bool sendFds(int sock, const void *data, size_t size, const int *fds,
+                    size_t count) {
+    iovec iov{const_cast<void *>(data), size};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * count));
+    if (count > 0) {
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    }
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == ssize_t(size);
+}
+
+// 收到的fd追加到fds，返回值同recvmsg
+static ssize_t recvFds(int sock, void *data, size_t size,
+                       std::vector<int> &fds) {
+    iovec iov{data, size};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * FDS_PER_MESSAGE)];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (n < 0) return n;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int *received = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+        fds.insert(fds.end(), received, received + count);
+    }
+    if (msg.msg_flags & MSG_CTRUNC) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return n;
+}
+
+HotRestart::Sockets HotRestart::takeOver(const std::string &path) {
+    Sockets sockets;
+    if (path.empty()) return sockets;
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) throw std::runtime_error("无法创建热重启socket");
+    sockaddr_un addr = unixAddress(path);
+    if (connect(sock, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        // 没有旧进程在运行，正常启动
+        if (errno != ENOENT && errno != ECONNREFUSED) {
+            spdlog::warn("连接旧进程失败: {}", strerror(errno));
+        }
+        close(sock);
+        return sockets;
+    }
+    if (!trustedPeer(sock)) {
+        close(sock);
+        throw std::runtime_error("热重启socket " + path + "属于其他用户");
+    }
+    timeval timeout{TAKEOVER_TIMEOUT, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::vector<int> fds;
+    auto fail = [&](const char *what) {
+        int err = errno;
+        for (int fd : fds) { close(fd); }
+        close(sock);
+        throw std::runtime_error(std::string("热重启握手失败: ") + what +
+                                 ": " + strerror(err));
+    };
+    Header header{};
+    if (recvFds(sock, &header, sizeof(header), fds) != sizeof(header) ||
+        header.magic != MAGIC) {
+        fail("无效的首条消息");
+    }
+    const size_t total = size_t(header.listeners) + header.metrics +
+                         header.passive;
+    while (fds.size() < total) {
+        char more;
+        if (recvFds(sock, &more, 1, fds) != 1) fail("socket数量不足");
+    }
+    if (fds.size() != total || header.listeners == 0) fail("socket数量不符");
+    auto it = fds.begin();
+    sockets.listeners.assign(it, it + header.listeners);
+    it += header.listeners;
+    if (header.metrics) sockets.metrics = *it++;
+    sockets.passive.assign(it, fds.end());
+    sockets.conn = sock;
+    spdlog::info("从旧进程接管{}个监听socket、{}个被动模式端口",
+                 sockets.listeners.size(), sockets.passive.size());
+    return sockets;
+}
+
+void HotRestart::confirm(Sockets &sockets) {
+    if (sockets.conn < 0) return;
+    if (send(sockets.conn, &CONFIRM, 1, MSG_NOSIGNAL) != 1) {
+        spdlog::warn("通知旧进程失败: {}", strerror(errno));
+    }
+    close(sockets.conn);
+    sockets.conn = -1;
+}
+
+HotRestart::HotRestart(EventLoop &loop, std::string path, Collect &&collect,
+                       Finish &&finish)
+    : m_loop(loop), m_path(std::move(path)), m_collect(std::move(collect)),
+      m_finish(std::move(finish)) {}
+
+HotRestart::~HotRestart() {
+    if (m_conn >= 0) close(m_conn);
+    if (m_listen_fd >= 0) close(m_listen_fd);
+}
+
+bool HotRestart::start() {
+    sockaddr_un addr = unixAddress(m_path);
+    m_listen_fd =
+        socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listen_fd < 0) return false;
+    // 旧进程留下的或已经交接完的socket文件
+    unlink(m_path.c_str());
+    if (bind(m_listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(m_listen_fd, 1) < 0) {
+        spdlog::error("热重启socket {}监听失败: {}", m_path, strerror(errno));
+        return false;
+    }
+    return m_loop.addAcceptor(m_listen_fd,
+                              [this](int conn) { onAccept(conn); });
+}
+
+void HotRestart::stop() {
+    if (m_listen_fd < 0) return;
+    m_loop.remove(m_listen_fd);
+    close(m_listen_fd);
+    m_listen_fd = -1;
+    if (!m_handed_off) unlink(m_path.c_str());
+}
+
+void HotRestart::onAccept(int conn) {
+    if (m_conn >= 0 || m_handed_off || !trustedPeer(conn)) {
+        close(conn);
+        return;
+    }
+    m_sockets = m_collect();
+    std::vector<int> fds = m_sockets.listeners;
+    if (m_sockets.metrics >= 0) fds.push_back(m_sockets.metrics);
+    fds.insert(fds.end(), m_sockets.passive.begin(), m_sockets.passive.end());
+    Header header{MAGIC, uint32_t(m_sockets.listeners.size()),
+                  m_sockets.metrics >= 0 ? 1u : 0u,
+                  uint32_t(m_sockets.passive.size())};
+    size_t sent = std::min(FDS_PER_MESSAGE, fds.size());
+    bool ok = sendFds(conn, &header, sizeof(header), fds.data(), sent);
+    while (ok && sent < fds.size()) {
+        const size_t count = std::min(FDS_PER_MESSAGE, fds.size() - sent);
+        const char more = 0;
+        ok = sendFds(conn, &more, 1, fds.data() + sent, count);
+        sent += count;
+    }
+    if (!ok || !m_loop.add(conn, EPOLLIN | EPOLLRDHUP,
+                           [this, conn](uint32_t) { onReply(conn); })) {
+        spdlog::error("向新进程发送监听socket失败: {}", strerror(errno));
+        close(conn);
+        m_finish(false, m_sockets);
+        return;
+    }
+    m_conn = conn;
+    spdlog::info("新进程正在接管监听socket");
+}
+
+void HotRestart::onReply(int conn) {
+    char reply = 0;
+    ssize_t n = recv(conn, &reply, 1, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    m_loop.remove(conn);
+    close(conn);
+    m_conn = -1;
+    m_handed_off = n == 1 && reply == CONFIRM;
+    if (!m_handed_off) spdlog::warn("新进程没有确认接管，继续服务");
+    m_finish(m_handed_off, m_sockets);
+    m_sockets = {};
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "eventloop.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// 热重启：新进程经Unix域socket从旧进程接管监听socket，接管期间不中断accept
+// 旧进程收到连接后用SCM_RIGHTS发出所有监听socket，两个进程同时accept；
+// 新进程开始accept后回复确认，旧进程随后停止accept并排空会话
+// 新进程在确认之前退出时旧进程照常服务
+class HotRestart {
+ public:
+    // 在进程间传递的socket
+    struct Sockets {
+        std::vector<int> listeners; // FTP监听socket，每个反应堆一个
+        int metrics = -1;           // 指标端点的监听socket
+        std::vector<int> passive;   // 被动模式端口池中空闲的监听socket
+        int conn = -1; // 新进程中与旧进程的连接，开始accept后经confirm()确认
+    };
+    // 旧进程：收集要交出的socket，在事件循环线程中调用
+    using Collect = std::function<Sockets()>;
+    // 旧进程：交接结束，confirmed为false时新进程没有接管，sockets原样交还
+    using Finish = std::function<void(bool confirmed, Sockets &sockets)>;
+
+    // 新进程：连接path上的旧进程并接管它的socket，没有旧进程时返回空的Sockets
+    // 握手中途失败时抛出std::runtime_error
+    static Sockets takeOver(const std::string &path);
+    // 新进程：已经开始accept，通知旧进程排空
+    static void confirm(Sockets &sockets);
+
+    HotRestart(EventLoop &loop, std::string path, Collect &&collect,
+               Finish &&finish);
+    HotRestart(const HotRestart &) = delete;
+    HotRestart &operator=(const HotRestart &) = delete;
+    ~HotRestart();
+    // 在path上等待新进程，start/stop只能在事件循环线程中调用
+    bool start();
+    // 交接成功后path已属于新进程，不再删除
+    void stop();
+
+ private:
+    void onAccept(int conn);
+    void onReply(int conn);
+
+    EventLoop &m_loop;
+    const std::string m_path;
+    Collect m_collect;
+    Finish m_finish;
+    int m_listen_fd = -1;
+    int m_conn = -1; // 正在交接的连接，同一时间只允许一个
+    Sockets m_sockets;
+    bool m_handed_off = false;
+};
@@ -1,22 +1,179 @@
+#include "asynclog.h"
 #include "server.h"
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
 #include <iostream>
+#include <poll.h>
+#include <string_view>
+#include <unistd.h>
 #if SOCKETEXAMPLE_DEBUG
 const int PORT = 8080; // 服务器端口
 #else
 const int PORT = 21; // 服务器端口
 #endif
 
-int main() {
-    Server server(PORT, 4);
-    std::jthread t([&server]() { server.run(); });
-    std::string command;
-    while (std::cin >> command) {
-        if (command == "q") {
-            std::cout << "正在等待任务完成..." << std::endl;
-            server.stop();
-            t.request_stop();
+// 解析字节数，支持K/M/G后缀(1024进制)，失败时返回false
+static bool parseBytes(const char *text, uint64_t &bytes) {
+    char *end = nullptr;
+    unsigned long long value = std::strtoull(text, &end, 10);
+    if (end == text) return false;
+    switch (*end) {
+    case 'K':
+    case 'k': value <<= 10; ++end; break;
+    case 'M':
+    case 'm': value <<= 20; ++end; break;
+    case 'G':
+    case 'g': value <<= 30; ++end; break;
+    }
+    if (*end != '\0') return false;
+    bytes = value;
+    return true;
+}
+
+static void usage(const char *prog) {
+    std::cerr << "用法: " << prog
+              << " [-p 端口] [-r 反应堆数量] [-a(反应堆绑定CPU)] [-w(工作线程绑定CPU)] [-d 根目录]"
+                 " [-P 最小端口-最大端口] [-A 被动模式地址]"
+                 " [-t 数据连接超时秒数] [-m 指标端口]"
+                 " [-L 登录超时] [-I 空闲超时] [-S 传输停滞超时](秒，0为不限制)"
+                 " [-s 会话限速] [-u 用户限速] [-g 全局限速](字节/秒，可带K/M/G)"
+                 " [-C 小文件缓存大小(可带K/M/G，0为关闭)]"
+                 " [-l 访问日志文件(-为标准输出)]"
+                 " [-O block|drop|drop-oldest(日志队列满时的处理)]"
+                 " [-H 热重启socket路径] [-D 排空超时秒数]"
+                 " [-T TLS证书文件] [-k TLS私钥(默认同证书)] [-N(不使用kTLS)]"
+                 " [-Z MODE Z压缩级别(0-9)] [-X(摘要写入扩展属性)]"
+              << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    // sendfile和OpenSSL写socket时无法带MSG_NOSIGNAL，客户端断开时
+    // 只应让这次写入返回EPIPE，而不是终止进程
+    std::signal(SIGPIPE, SIG_IGN);
+    ServerConfig config;
+    config.port = PORT;
+    config.thread_limit = 4;
+    int opt;
+    const char *options = "p:r:awd:P:A:t:m:s:u:g:C:l:O:L:I:S:H:D:T:k:NZ:Xh";
+    while ((opt = getopt(argc, argv, options)) != -1) {
+        switch (opt) {
+        case 'p': config.port = std::atoi(optarg); break;
+        case 'r': config.reactors = std::max(1, std::atoi(optarg)); break;
+        case 'a': config.pin_reactors = true; break;
+        case 'w': config.pin_workers = true; break;
+        case 'd': config.working_dir = optarg; break;
+        case 'P': {
+            unsigned min_port = 0, max_port = 0;
+            if (std::sscanf(optarg, "%u-%u", &min_port, &max_port) != 2 ||
+                min_port == 0 || min_port > max_port || max_port > 65535) {
+                usage(argv[0]);
+                return 1;
+            }
+            config.pasv_min_port = min_port;
+            config.pasv_max_port = max_port;
+            break;
+        }
+        case 'A': config.pasv_address = optarg; break;
+        case 't': config.data_timeout = std::max(1, std::atoi(optarg)); break;
+        case 'm': config.metrics_port = std::atoi(optarg); break;
+        case 'L': config.login_timeout = std::max(0, std::atoi(optarg)); break;
+        case 'I': config.idle_timeout = std::max(0, std::atoi(optarg)); break;
+        case 'S': config.stall_timeout = std::max(0, std::atoi(optarg)); break;
+        case 's':
+        case 'u':
+        case 'g': {
+            uint64_t &rate = opt == 's'   ? config.session_rate
+                             : opt == 'u' ? config.user_rate
+                                          : config.global_rate;
+            if (!parseBytes(optarg, rate)) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        }
+        case 'C': {
+            uint64_t size = 0;
+            if (!parseBytes(optarg, size)) {
+                usage(argv[0]);
+                return 1;
+            }
+            config.file_cache_size = size;
+            break;
+        }
+        case 'l': config.access_log = optarg; break;
+        case 'H': config.restart_socket = optarg; break;
+        case 'D': config.drain_timeout = std::max(1, std::atoi(optarg)); break;
+        case 'T': config.tls_cert = optarg; break;
+        case 'k': config.tls_key = optarg; break;
+        case 'N': config.ktls = false; break;
+        case 'Z':
+            config.deflate_level = std::clamp(std::atoi(optarg), 0, 9);
+            break;
+        case 'X': config.digest_xattr = true; break;
+        case 'O': {
+            std::string_view policy = optarg;
+            if (policy == "block") {
+                config.log_overflow = LogOverflow::Block;
+            } else if (policy == "drop") {
+                config.log_overflow = LogOverflow::DropNewest;
+            } else if (policy == "drop-oldest") {
+                config.log_overflow = LogOverflow::DropOldest;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
             break;
         }
+        default: usage(argv[0]); return 1;
+        }
+    }
+    try {
+        setupLogging(config);
+    } catch (const spdlog::spdlog_ex &e) {
+        std::cerr << "无法打开访问日志: " << e.what() << std::endl;
+        return 1;
+    }
+    {
+        // 服务器析构时还要写日志，须在drop_all之前析构
+        Server server(config);
+        // 热重启排空结束后run()自行返回，此时不再等待标准输入
+        std::atomic<bool> finished = false;
+        std::jthread t([&server, &finished]() {
+            server.run();
+            finished = true;
+            finished.notify_all();
+        });
+        std::string input;
+        bool eof = false;
+        while (!finished && !eof) {
+            pollfd pfd{STDIN_FILENO, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0) continue;
+            char buffer[256];
+            ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (n <= 0) {
+                eof = true;
+                break;
+            }
+            input.append(buffer, n);
+            size_t end;
+            while ((end = input.find('\n')) != std::string::npos) {
+                std::string command = input.substr(0, end);
+                input.erase(0, end + 1);
+                if (command == "q") {
+                    std::cout << "正在等待任务完成..." << std::endl;
+                    server.stop();
+                    t.request_stop();
+                    eof = true;
+                    break;
+                }
+            }
+        }
+        // 标准输入关闭后继续服务，直到被stop()或排空结束
+        finished.wait(false);
     }
     spdlog::drop_all(); // 清理所有日志
 }
@@ -0,0 +1,212 @@
+#include "metrics.h"
+#include "ftpcmd.h"
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <iterator>
+#include <unordered_map>
+
+constexpr size_t COMMANDS = Unknown + 1;
+using Counter = std::atomic<uint64_t>;
+
+struct Histogram {
+    Counter buckets[Metrics::BUCKETS] = {};
+    Counter sum_ns = 0;
+};
+
+struct Metrics::Shard {
+    Histogram commands[COMMANDS];
+    Counter bytes_sent = 0;
+    Counter bytes_received = 0;
+    Counter transfers_ok = 0;
+    Counter transfers_failed = 0;
+    Counter sessions_opened = 0;
+    Counter sessions_closed = 0;
+    Counter data_opened = 0;
+    Counter data_closed = 0;
+};
+
+Metrics::Metrics() = default;
+Metrics::~Metrics() = default;
+
+// 只有所属线程写入，不需要原子的读改写
+static void bump(std::atomic<uint64_t> &counter, uint64_t value = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+}
+
+static uint64_t sum(const std::atomic<uint64_t> &counter) {
+    return counter.load(std::memory_order_relaxed);
+}
+
+size_t Metrics::bucketOf(uint64_t ns) {
+    if (ns < SUB_BUCKETS) return ns;
+    int exponent = 63 - std::countl_zero(ns);
+    size_t sub = (ns >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1);
+    size_t bucket = (exponent - SUB_BITS + 1) * SUB_BUCKETS + sub;
+    return std::min(bucket, BUCKETS - 1);
+}
+
+uint64_t Metrics::bucketUpper(size_t bucket) {
+    if (bucket < SUB_BUCKETS) return bucket + 1;
+    int exponent = bucket / SUB_BUCKETS + SUB_BITS - 1;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    return (SUB_BUCKETS + sub + 1) << (exponent - SUB_BITS);
+}
+
+Metrics::Shard &Metrics::local() {
+    // 同一线程可能交替使用多个Metrics实例(例如测试)，每个实例只分配一次
+    // 分片；实例编号不会复用，已销毁实例留下的项不会再被查到
+    thread_local std::unordered_map<uint64_t, Shard *> shards;
+    thread_local uint64_t owner = 0; // 最近一次使用的实例，省去查表
+    thread_local Shard *shard = nullptr;
+    if (owner == m_id) return *shard;
+    Shard *&found = shards[m_id];
+    if (!found) {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_shards.push_back(std::make_unique<Shard>());
+        found = m_shards.back().get();
+    }
+    owner = m_id;
+    shard = found;
+    return *shard;
+}
+
+void Metrics::recordCommand(int command, std::chrono::nanoseconds latency) {
+    Histogram &histogram = local().commands[command];
+    uint64_t ns = std::max<int64_t>(latency.count(), 0);
+    bump(histogram.buckets[bucketOf(ns)]);
+    bump(histogram.sum_ns, ns);
+}
+
+void Metrics::recordBytes(bool upload, uint64_t bytes) {
+    Shard &shard = local();
+    bump(upload ? shard.bytes_received : shard.bytes_sent, bytes);
+}
+
+void Metrics::recordTransfer(bool ok) {
+    Shard &shard = local();
+    bump(ok ? shard.transfers_ok : shard.transfers_failed);
+}
+
+void Metrics::sessionOpened() { bump(local().sessions_opened); }
+void Metrics::sessionClosed() { bump(local().sessions_closed); }
+void Metrics::dataConnectionOpened() { bump(local().data_opened); }
+void Metrics::dataConnectionClosed() { bump(local().data_closed); }
+
+void Metrics::setQueueDepthProbe(std::function<size_t()> &&probe) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_queue_depth = std::move(probe);
+}
+
+void Metrics::setFileCacheProbe(std::function<FileCache::Stats()> &&probe) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_file_cache = std::move(probe);
+}
+
+std::string Metrics::exportText() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    std::string out;
+    auto it = std::back_inserter(out);
+
+    out += "# HELP ftp_command_latency_seconds Time spent handling a control "
+           "command.\n# TYPE ftp_command_latency_seconds summary\n";
+    std::vector<uint64_t> buckets(BUCKETS);
+    for (size_t command = 0; command < COMMANDS; ++command) {
+        std::fill(buckets.begin(), buckets.end(), 0);
+        uint64_t count = 0, sum_ns = 0;
+        for (const auto &shard : m_shards) {
+            const Histogram &histogram = shard->commands[command];
+            for (size_t b = 0; b < BUCKETS; ++b) {
+                uint64_t n = sum(histogram.buckets[b]);
+                buckets[b] += n;
+                count += n;
+            }
+            sum_ns += sum(histogram.sum_ns);
+        }
+        if (count == 0) continue;
+        auto name = FTPCommandParser::name(static_cast<FTPCMD>(command));
+        for (double quantile : {0.5, 0.9, 0.99, 0.999}) {
+            // 取第ceil(q*count)个样本所在桶的上界
+            auto rank = std::max<uint64_t>(1, quantile * count + 0.999999);
+            uint64_t seen = 0;
+            size_t b = 0;
+            while (b + 1 < BUCKETS && (seen += buckets[b]) < rank) { ++b; }
+            std::format_to(it,
+                           "ftp_command_latency_seconds{{command=\"{}\","
+                           "quantile=\"{}\"}} {:.9f}\n",
+                           name, quantile, bucketUpper(b) / 1e9);
+        }
+        std::format_to(it,
+                       "ftp_command_latency_seconds_sum{{command=\"{}\"}} "
+                       "{:.9f}\n"
+                       "ftp_command_latency_seconds_count{{command=\"{}\"}} "
+                       "{}\n",
+                       name, sum_ns / 1e9, name, count);
+    }
+
+    uint64_t sent = 0, received = 0, ok = 0, failed = 0;
+    int64_t sessions = 0, data = 0;
+    for (const auto &shard : m_shards) {
+        sent += sum(shard->bytes_sent);
+        received += sum(shard->bytes_received);
+        ok += sum(shard->transfers_ok);
+        failed += sum(shard->transfers_failed);
+        sessions += sum(shard->sessions_opened) - sum(shard->sessions_closed);
+        data += sum(shard->data_opened) - sum(shard->data_closed);
+    }
+    // 两次导出间隔至少1秒才更新速率，避免频繁抓取时抖动
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - m_last_export).count();
+    if (elapsed >= 1.0) {
+        if (m_last_export.time_since_epoch().count() != 0) {
+            m_sent_rate = (sent - m_last_sent) / elapsed;
+            m_received_rate = (received - m_last_received) / elapsed;
+        }
+        m_last_export = now;
+        m_last_sent = sent;
+        m_last_received = received;
+    }
+    size_t queue_depth = m_queue_depth ? m_queue_depth() : 0;
+    FileCache::Stats cache = m_file_cache ? m_file_cache() : FileCache::Stats{};
+
+    std::format_to(
+        it,
+        "# HELP ftp_bytes_sent_total Bytes sent on data connections.\n"
+        "# TYPE ftp_bytes_sent_total counter\nftp_bytes_sent_total {}\n"
+        "# HELP ftp_bytes_received_total Bytes received on data connections.\n"
+        "# TYPE ftp_bytes_received_total counter\n"
+        "ftp_bytes_received_total {}\n"
+        "# HELP ftp_bytes_sent_per_second Send rate since the previous "
+        "scrape.\n# TYPE ftp_bytes_sent_per_second gauge\n"
+        "ftp_bytes_sent_per_second {:.0f}\n"
+        "# HELP ftp_bytes_received_per_second Receive rate since the previous "
+        "scrape.\n# TYPE ftp_bytes_received_per_second gauge\n"
+        "ftp_bytes_received_per_second {:.0f}\n"
+        "# HELP ftp_transfers_total Finished data transfers.\n"
+        "# TYPE ftp_transfers_total counter\n"
+        "ftp_transfers_total{{result=\"ok\"}} {}\n"
+        "ftp_transfers_total{{result=\"failed\"}} {}\n"
+        "# HELP ftp_sessions_active Open control connections.\n"
+        "# TYPE ftp_sessions_active gauge\nftp_sessions_active {}\n"
+        "# HELP ftp_data_connections_active Open data connections.\n"
+        "# TYPE ftp_data_connections_active gauge\n"
+        "ftp_data_connections_active {}\n"
+        "# HELP ftp_pool_queue_depth Tasks waiting in the thread pool.\n"
+        "# TYPE ftp_pool_queue_depth gauge\nftp_pool_queue_depth {}\n"
+        "# HELP ftp_file_cache_requests_total Small-file cache lookups.\n"
+        "# TYPE ftp_file_cache_requests_total counter\n"
+        "ftp_file_cache_requests_total{{result=\"hit\"}} {}\n"
+        "ftp_file_cache_requests_total{{result=\"miss\"}} {}\n"
+        "# HELP ftp_file_cache_evictions_total Entries evicted to stay within "
+        "the memory budget.\n# TYPE ftp_file_cache_evictions_total counter\n"
+        "ftp_file_cache_evictions_total {}\n"
+        "# HELP ftp_file_cache_bytes Memory held by the small-file cache.\n"
+        "# TYPE ftp_file_cache_bytes gauge\nftp_file_cache_bytes {}\n"
+        "# HELP ftp_file_cache_entries Files held by the small-file cache.\n"
+        "# TYPE ftp_file_cache_entries gauge\nftp_file_cache_entries {}\n",
+        sent, received, m_sent_rate, m_received_rate, ok, failed, sessions,
+        data, queue_depth, cache.hits, cache.misses, cache.evictions,
+        cache.bytes, cache.entries);
+    return out;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "filecache.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 服务器运行指标，导出为Prometheus文本格式
+// 记录只写当前线程的分片(单写者，无锁无原子读改写)，导出时再汇总所有分片；
+// 命令耗时使用对数线性直方图，相对误差不超过1/8
+class Metrics {
+ public:
+    Metrics();
+    Metrics(const Metrics &) = delete;
+    Metrics &operator=(const Metrics &) = delete;
+    ~Metrics();
+
+    // command为FTPCMD枚举值
+    void recordCommand(int command, std::chrono::nanoseconds latency);
+    void recordBytes(bool upload, uint64_t bytes);
+    void recordTransfer(bool ok);
+    void sessionOpened();
+    void sessionClosed();
+    void dataConnectionOpened();
+    void dataConnectionClosed();
+    // 导出时调用，获取线程池排队的任务数
+    void setQueueDepthProbe(std::function<size_t()> &&probe);
+    // 导出时调用，获取小文件缓存的统计
+    void setFileCacheProbe(std::function<FileCache::Stats()> &&probe);
+    // 汇总所有分片，生成Prometheus文本格式
+    std::string exportText();
+
+    // 直方图桶：[0, 8)每个值一个桶，之后每个2的幂区间分8个桶，上限约68秒
+    static constexpr int SUB_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int MAX_EXPONENT = 36;
+    static constexpr size_t BUCKETS =
+        (MAX_EXPONENT - SUB_BITS + 2) * SUB_BUCKETS;
+    static size_t bucketOf(uint64_t ns);
+    // 桶内数值的上界(不含)
+    static uint64_t bucketUpper(size_t bucket);
+
+ private:
+    struct Shard; // 每个线程一份，只有所属线程写入
+    Shard &local();
+
+    // 区分先后创建在同一地址上的实例
+    static inline std::atomic<uint64_t> s_next_id = 1;
+    const uint64_t m_id = s_next_id++;
+    std::mutex m_mtx; // 保护分片列表和上次导出的快照
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::function<size_t()> m_queue_depth;
+    std::function<FileCache::Stats()> m_file_cache;
+    // 用于计算每秒字节数
+    std::chrono::steady_clock::time_point m_last_export;
+    uint64_t m_last_sent = 0;
+    uint64_t m_last_received = 0;
+    double m_sent_rate = 0;
+    double m_received_rate = 0;
+};
@@ -0,0 +1,110 @@
+#include "metricsendpoint.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <netinet/in.h>
+#include <spdlog/spdlog.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+MetricsEndpoint::MetricsEndpoint(EventLoop &loop, Metrics &metrics, int port,
+                                 int listen_fd)
+    : m_loop(loop), m_metrics(metrics), m_port(port), m_listen_fd(listen_fd) {}
+
+MetricsEndpoint::~MetricsEndpoint() {
+    for (auto &[sock, conn] : m_connections) { close(sock); }
+    if (m_listen_fd >= 0) close(m_listen_fd);
+}
+
+bool MetricsEndpoint::start() {
+    if (m_listen_fd < 0 && !listenPort()) return false;
+    if (!m_loop.addAcceptor(m_listen_fd,
+                            [this](int sock) { onAccept(sock); })) {
+        return false;
+    }
+    spdlog::info("指标导出: http://127.0.0.1:{}/metrics", m_port);
+    return true;
+}
+
+bool MetricsEndpoint::listenPort() {
+    m_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listen_fd < 0) return false;
+    int opt = 1;
+    setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sockaddr_in addr{AF_INET, htons(m_port), {htonl(INADDR_LOOPBACK)}};
+    if (bind(m_listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(m_listen_fd, 16) < 0) {
+        spdlog::error("指标端口{}监听失败: {}", m_port, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void MetricsEndpoint::stop() {
+    if (m_listen_fd >= 0) m_loop.remove(m_listen_fd);
+    while (!m_connections.empty()) {
+        closeConnection(m_connections.begin()->first);
+    }
+}
+
+void MetricsEndpoint::onAccept(int sock) {
+    if (!m_loop.add(sock, EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP,
+                    [this, sock](uint32_t events) { onEvent(sock, events); })) {
+        close(sock);
+        return;
+    }
+    m_connections[sock];
+}
+
+void MetricsEndpoint::onEvent(int sock, uint32_t events) {
+    auto it = m_connections.find(sock);
+    if (it == m_connections.end()) return;
+    Connection &conn = it->second;
+    bool keep = conn.response.empty() ? readRequest(sock, conn)
+                                      : writeResponse(sock, conn);
+    if (!keep) closeConnection(sock);
+}
+
+bool MetricsEndpoint::readRequest(int sock, Connection &conn) {
+    char buffer[1024];
+    for (;;) {
+        ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (n <= 0) return false;
+        conn.request.append(buffer, n);
+        if (conn.request.size() > MAX_REQUEST) return false;
+        if (conn.request.find("\r\n\r\n") != std::string::npos) break;
+    }
+    // 只关心请求行
+    std::string_view line(conn.request);
+    line = line.substr(0, line.find("\r\n"));
+    const bool found = line.starts_with("GET /metrics ") ||
+                       line.starts_with("GET / ");
+    std::string body = found ? m_metrics.exportText() : "Not Found\n";
+    conn.response = std::format(
+        "HTTP/1.1 {}\r\nContent-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: {}\r\nConnection: close\r\n\r\n",
+        found ? "200 OK" : "404 Not Found", body.size());
+    conn.response += body;
+    return writeResponse(sock, conn);
+}
+
+bool MetricsEndpoint::writeResponse(int sock, Connection &conn) {
+    while (conn.sent < conn.response.size()) {
+        ssize_t n = send(sock, conn.response.data() + conn.sent,
+                         conn.response.size() - conn.sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (n < 0) return false;
+        conn.sent += n;
+    }
+    return false; // 发送完毕，关闭连接
+}
+
+void MetricsEndpoint::closeConnection(int sock) {
+    m_loop.remove(sock);
+    m_connections.erase(sock);
+    close(sock);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "eventloop.h"
+#include "metrics.h"
+#include <string>
+#include <unordered_map>
+
+// Prometheus抓取端点：只监听127.0.0.1，在给定的事件循环中处理
+// 每个连接读取一个HTTP请求，回复后关闭
+class MetricsEndpoint {
+ public:
+    // listen_fd为热重启时从旧进程接管的监听socket，为-1时自己监听port
+    MetricsEndpoint(EventLoop &loop, Metrics &metrics, int port,
+                    int listen_fd = -1);
+    MetricsEndpoint(const MetricsEndpoint &) = delete;
+    MetricsEndpoint &operator=(const MetricsEndpoint &) = delete;
+    ~MetricsEndpoint();
+    // start/stop只能在事件循环线程中调用
+    bool start();
+    void stop();
+    int fd() const { return m_listen_fd; }
+
+ private:
+    struct Connection {
+        std::string request;
+        std::string response;
+        size_t sent = 0;
+    };
+    // 请求最大长度，超过后直接关闭
+    static constexpr size_t MAX_REQUEST = 8192;
+    bool listenPort();
+    void onAccept(int sock);
+    void onEvent(int sock, uint32_t events);
+    // 返回false表示连接应当关闭
+    bool readRequest(int sock, Connection &conn);
+    bool writeResponse(int sock, Connection &conn);
+    void closeConnection(int sock);
+
+    EventLoop &m_loop;
+    Metrics &m_metrics;
+    const int m_port;
+    int m_listen_fd = -1;
+    std::unordered_map<int, Connection> m_connections;
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+// 有界无锁多生产者多消费者队列(Vyukov)
+// 元素就地存放在环形数组中，入队出队都不分配内存；容量必须是2的幂
+template <class T> class MpmcQueue {
+ public:
+    explicit MpmcQueue(size_t capacity)
+        : m_mask(capacity - 1), m_cells(new Cell[capacity]) {
+        for (size_t i = 0; i < capacity; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    MpmcQueue(const MpmcQueue &) = delete;
+    MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+    // 队列满时返回false，value保持不变
+    bool push(T &&value) {
+        Cell *cell;
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队列空时返回false
+    bool pop(T &value) {
+        Cell *cell;
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            auto diff =
+                static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->value);
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 近似值，只用于判断是否值得去取
+    bool empty() const { return size() == 0; }
+    // 近似值，用于监控
+    size_t size() const {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+ private:
+    static constexpr size_t CACHE_LINE = 64;
+    struct alignas(CACHE_LINE) Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+    const size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+    // 生产者和消费者的位置放在不同缓存行，避免伪共享
+    alignas(CACHE_LINE) std::atomic<size_t> m_tail = 0;
+    alignas(CACHE_LINE) std::atomic<size_t> m_head = 0;
+};
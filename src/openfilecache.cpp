@@ -0,0 +1,202 @@
+#include "openfilecache.h"
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <vector>
+
+// 这些事件都说明缓存的fd或statx结果可能不再对应该路径上的文件；
+// 被删除或被改名覆盖时链接数变化，会产生IN_ATTRIB
+constexpr uint32_t WATCH_MASK =
+    IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+
+OpenFile::~OpenFile() { close(m_fd); }
+
+// 写入扩展属性(例如DigestCache保存的摘要)也会产生IN_ATTRIB并改变ctime，
+// 这时内容、权限和链接数都没有变，缓存项仍然有效
+static bool attributesChanged(const OpenFile &file) {
+    struct statx stx;
+    if (statx(file.fd(), "", AT_EMPTY_PATH, STATX_BASIC_STATS, &stx) < 0) {
+        return true;
+    }
+    const struct statx &old = file.stat();
+    return stx.stx_nlink != old.stx_nlink || stx.stx_mode != old.stx_mode ||
+           stx.stx_uid != old.stx_uid || stx.stx_gid != old.stx_gid ||
+           stx.stx_size != old.stx_size ||
+           stx.stx_mtime.tv_sec != old.stx_mtime.tv_sec ||
+           stx.stx_mtime.tv_nsec != old.stx_mtime.tv_nsec;
+}
+
+OpenFileCache::OpenFileCache(size_t max_entries) : m_max_entries(max_entries) {
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify_fd < 0) {
+        spdlog::warn("inotify不可用，不缓存已打开的文件: {}", strerror(errno));
+    }
+}
+
+OpenFileCache::~OpenFileCache() {
+    if (m_inotify_fd >= 0) close(m_inotify_fd);
+}
+
+std::shared_ptr<const OpenFile> OpenFileCache::adopt(int fd) {
+    struct statx stx;
+    if (statx(fd, "", AT_EMPTY_PATH, STATX_BASIC_STATS, &stx) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return nullptr;
+    }
+    if (!S_ISREG(stx.stx_mode)) {
+        close(fd);
+        errno = S_ISDIR(stx.stx_mode) ? EISDIR : EINVAL;
+        return nullptr;
+    }
+    return std::make_shared<const OpenFile>(fd, stx);
+}
+
+std::shared_ptr<const OpenFile>
+OpenFileCache::lookup(const std::string &path,
+                      const std::shared_ptr<const DirFd> &dir) {
+    std::shared_lock lock(m_mtx);
+    auto it = m_entries.find(path);
+    if (it == m_entries.end() || it->second.dir != dir) return nullptr;
+    {
+        std::lock_guard<std::mutex> order(m_lru_mtx);
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+    }
+    return it->second.file;
+}
+
+std::shared_ptr<const OpenFile>
+OpenFileCache::open(const std::string &path,
+                    const std::shared_ptr<const DirFd> &dir,
+                    const std::string &name) {
+    if (auto file = lookup(path, dir)) return file;
+    const int flags = O_RDONLY | O_CLOEXEC;
+    int fd = DirFdCache::openBeneath(dir->get(), name.c_str(),
+                                     flags | O_NOFOLLOW);
+    if (fd < 0 && errno == ELOOP) {
+        // 符号链接可能被指向别处，而目标文件上的监视察觉不到
+        fd = DirFdCache::openBeneath(dir->get(), name.c_str(), flags);
+        return fd < 0 ? nullptr : adopt(fd);
+    }
+    if (fd < 0) return nullptr;
+    if (m_inotify_fd < 0) return adopt(fd);
+    // 先添加监视再获取statx，之后的任何修改都会产生事件
+    std::string proc = std::format("/proc/self/fd/{}", fd);
+    int wd = inotify_add_watch(m_inotify_fd, proc.c_str(), WATCH_MASK);
+    bool reserved = wd >= 0 && reserve(path, dir, wd);
+    auto file = adopt(fd);
+    if (!reserved) return file;
+    // 打开之后、添加监视之前文件可能已被替换，确认路径仍指向同一文件
+    struct statx current;
+    if (file &&
+        statx(dir->get(), name.c_str(), AT_SYMLINK_NOFOLLOW, STATX_INO,
+              &current) == 0 &&
+        current.stx_ino == file->stat().stx_ino &&
+        current.stx_dev_major == file->stat().stx_dev_major &&
+        current.stx_dev_minor == file->stat().stx_dev_minor) {
+        publish(path, wd, file);
+    } else {
+        publish(path, wd, nullptr);
+    }
+    return file;
+}
+
+bool OpenFileCache::reserve(const std::string &path,
+                            const std::shared_ptr<const DirFd> &dir, int wd) {
+    std::unique_lock lock(m_mtx);
+    if (auto it = m_entries.find(path); it != m_entries.end()) {
+        // 正在被其他会话打开；或父目录已换成新的fd，旧项作废
+        if (!it->second.file || it->second.dir == dir) {
+            // 同一文件的监视描述符相同，只在没有其他路径使用时移除
+            if (!m_watches.contains(wd)) inotify_rm_watch(m_inotify_fd, wd);
+            return false;
+        }
+        erase(it);
+    }
+    if (!m_entries.empty() && m_entries.size() >= m_max_entries) {
+        erase(m_entries.find(m_lru.back()));
+    }
+    m_lru.push_front(path);
+    m_entries.emplace(path, Entry{nullptr, dir, wd, m_lru.begin()});
+    m_watches.emplace(wd, path);
+    return true;
+}
+
+void OpenFileCache::publish(const std::string &path, int wd,
+                            std::shared_ptr<const OpenFile> file) {
+    std::unique_lock lock(m_mtx);
+    auto it = m_entries.find(path);
+    if (it == m_entries.end() || it->second.file || it->second.wd != wd) {
+        return;
+    }
+    if (file) {
+        it->second.file = std::move(file);
+    } else {
+        erase(it);
+    }
+}
+
+void OpenFileCache::erase(std::unordered_map<std::string, Entry>::iterator it) {
+    const int wd = it->second.wd;
+    auto [first, last] = m_watches.equal_range(wd);
+    for (auto w = first; w != last; ++w) {
+        if (w->second == it->first) {
+            m_watches.erase(w);
+            break;
+        }
+    }
+    if (!m_watches.contains(wd)) inotify_rm_watch(m_inotify_fd, wd);
+    m_lru.erase(it->second.lru);
+    m_entries.erase(it);
+}
+
+void OpenFileCache::clear() {
+    for (const auto &[wd, path] : m_watches) {
+        inotify_rm_watch(m_inotify_fd, wd);
+    }
+    m_watches.clear();
+    m_entries.clear();
+    m_lru.clear();
+}
+
+void OpenFileCache::invalidate(const std::string &path) {
+    std::unique_lock lock(m_mtx);
+    if (auto it = m_entries.find(path); it != m_entries.end()) erase(it);
+}
+
+void OpenFileCache::processEvents() {
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t len = read(m_inotify_fd, buffer, sizeof(buffer));
+        if (len <= 0) break;
+        std::unique_lock lock(m_mtx);
+        for (ssize_t pos = 0; pos < len;) {
+            auto *event = reinterpret_cast<inotify_event *>(buffer + pos);
+            pos += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                spdlog::warn("inotify事件队列溢出，清空已打开文件的缓存");
+                clear();
+                continue;
+            }
+            // 正在发送的会话仍持有旧的OpenFile，不受影响
+            std::vector<std::string> paths;
+            auto [first, last] = m_watches.equal_range(event->wd);
+            for (auto w = first; w != last; ++w) { paths.push_back(w->second); }
+            for (const auto &path : paths) {
+                auto it = m_entries.find(path);
+                if (it == m_entries.end()) continue;
+                // 占位项还没有statx结果可比较，照常删除
+                if (event->mask == IN_ATTRIB && it->second.file &&
+                    !attributesChanged(*it->second.file)) {
+                    continue;
+                }
+                erase(it);
+            }
+        }
+    }
+}
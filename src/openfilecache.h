@@ -0,0 +1,82 @@
+#pragma once
+#include "dirfdcache.h"
+#include <cstddef>
+#include <fcntl.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+
+// 以只读方式打开的文件及其statx结果，可以在多个会话间共享
+// sendfile/pread都显式传入偏移，不使用也不改变fd的文件位置，可以并发使用
+class OpenFile {
+ public:
+    OpenFile(int fd, const struct statx &stx) : m_fd(fd), m_stx(stx) {}
+    OpenFile(const OpenFile &) = delete;
+    OpenFile &operator=(const OpenFile &) = delete;
+    ~OpenFile();
+    int fd() const { return m_fd; }
+    const struct statx &stat() const { return m_stx; }
+    off_t size() const { return m_stx.stx_size; }
+
+ private:
+    const int m_fd;
+    const struct statx m_stx;
+};
+
+// 服务器级的已打开文件缓存，热门文件只打开一次，所有会话共用同一个fd
+// 对每个文件添加inotify监视，内容、属性或链接数变化以及改名时使缓存失效；
+// 缓存项记录打开时的父目录fd，父目录被改名后DirFdCache返回新的fd，旧项不再命中
+class OpenFileCache {
+ public:
+    explicit OpenFileCache(size_t max_entries = 512);
+    OpenFileCache(const OpenFileCache &) = delete;
+    OpenFileCache &operator=(const OpenFileCache &) = delete;
+    ~OpenFileCache();
+
+    // 打开dir下的普通文件name用于读取，path为其虚拟路径，作为缓存键
+    // 最后一级是符号链接时照常打开但不缓存；失败时返回空指针并设置errno
+    std::shared_ptr<const OpenFile>
+    open(const std::string &path, const std::shared_ptr<const DirFd> &dir,
+         const std::string &name);
+    // 服务器自己修改了文件，不等inotify事件立即丢弃
+    void invalidate(const std::string &path);
+    // inotify fd，可读时调用processEvents()
+    int fd() const { return m_inotify_fd; }
+    void processEvents();
+
+ private:
+    struct Entry {
+        std::shared_ptr<const OpenFile> file; // 为空表示正在打开
+        std::shared_ptr<const DirFd> dir;
+        int wd = -1;
+        std::list<std::string>::iterator lru;
+    };
+    // 接管fd并获取statx，不是普通文件时关闭fd并返回空指针
+    static std::shared_ptr<const OpenFile> adopt(int fd);
+    std::shared_ptr<const OpenFile>
+    lookup(const std::string &path, const std::shared_ptr<const DirFd> &dir);
+    // 为path登记一个正在打开的占位项，之后到达的事件会把它删除
+    bool reserve(const std::string &path,
+                 const std::shared_ptr<const DirFd> &dir, int wd);
+    // 占位项仍在时填入打开的文件，否则说明期间文件已被修改
+    void publish(const std::string &path, int wd,
+                 std::shared_ptr<const OpenFile> file);
+    // 以下调用方需持有写锁
+    void erase(std::unordered_map<std::string, Entry>::iterator it);
+    // 事件队列溢出后无法知道哪些文件变化了，删除所有缓存项和监视
+    void clear();
+
+    const size_t m_max_entries;
+    int m_inotify_fd = -1;
+    std::shared_mutex m_mtx;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::list<std::string> m_lru; // 表头为最近使用，满时淘汰表尾
+    // 命中时只持有共享锁，调整m_lru的顺序另用这把锁；持有写锁时不需要
+    std::mutex m_lru_mtx;
+    // wd -> 虚拟路径，硬链接或符号链接目录下同一文件可能对应多个路径
+    std::unordered_multimap<int, std::string> m_watches;
+};
@@ -0,0 +1,176 @@
+#include "passiveports.h"
+#include <arpa/inet.h>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// 未配置端口范围时最多缓存的空闲监听socket数量
+constexpr size_t MAX_IDLE_EPHEMERAL = 1024;
+
+static size_t queueCapacity(const ServerConfig &config) {
+    if (config.pasv_min_port == 0) return MAX_IDLE_EPHEMERAL;
+    return std::bit_ceil<size_t>(config.pasv_max_port - config.pasv_min_port +
+                                 1);
+}
+
+PassivePortPool::PassivePortPool(const ServerConfig &config,
+                                 const std::vector<int> &inherited)
+    : m_fixed_range(config.pasv_min_port != 0),
+      m_idle(queueCapacity(config)) {
+    if (!config.pasv_address.empty()) {
+        if (inet_pton(AF_INET, config.pasv_address.c_str(), &m_public_addr) !=
+            1) {
+            throw std::runtime_error("被动模式地址无效: " +
+                                     config.pasv_address);
+        }
+        m_has_public_addr = true;
+    }
+    if (!m_fixed_range) {
+        for (int fd : inherited) { close(fd); }
+        return;
+    }
+    std::vector<bool> owned(config.pasv_max_port - config.pasv_min_port + 1);
+    for (int fd : inherited) {
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+        getsockname(fd, (sockaddr *)&addr, &len);
+        uint16_t port = ntohs(addr.sin_port);
+        if (port < config.pasv_min_port || port > config.pasv_max_port ||
+            owned[port - config.pasv_min_port]) {
+            close(fd);
+            continue;
+        }
+        owned[port - config.pasv_min_port] = true;
+        m_idle.push({fd, port});
+    }
+    size_t bound = inherited.size();
+    for (unsigned port = config.pasv_min_port; port <= config.pasv_max_port;
+         ++port) {
+        if (owned[port - config.pasv_min_port]) continue;
+        Listener listener = listen(port);
+        if (listener.fd < 0) {
+            // 热重启时旧进程的会话可能还在使用，稍后再试
+            if (errno == EADDRINUSE) {
+                m_missing.push_back(port);
+            } else {
+                spdlog::warn("被动模式端口{}绑定失败: {}", port,
+                             strerror(errno));
+            }
+            continue;
+        }
+        m_idle.push(std::move(listener));
+        ++bound;
+    }
+    if (bound == 0 && m_missing.empty()) {
+        throw std::runtime_error("被动模式端口范围内没有可用端口");
+    }
+    spdlog::info("被动模式端口 {}-{}，可用{}个，{}个被占用",
+                 config.pasv_min_port, config.pasv_max_port, bound,
+                 m_missing.size());
+}
+
+PassivePortPool::~PassivePortPool() {
+    Listener listener;
+    while (m_idle.pop(listener)) { close(listener.fd); }
+}
+
+PassivePortPool::Listener PassivePortPool::listen(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return {};
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sockaddr_in addr{AF_INET, htons(port), {INADDR_ANY}};
+    socklen_t len = sizeof(addr);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+        ::listen(fd, 8) < 0 || getsockname(fd, (sockaddr *)&addr, &len) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return {};
+    }
+    return {fd, ntohs(addr.sin_port)};
+}
+
+// 丢弃已排队的连接，监听socket出错(例如服务器关闭时被shutdown)时返回false
+static bool discardPending(int fd) {
+    pollfd pfd{fd, POLLIN, 0};
+    while (poll(&pfd, 1, 0) > 0) {
+        int sock = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (sock >= 0) {
+            close(sock);
+        } else if (errno != EAGAIN && errno != ECONNABORTED) {
+            return false;
+        }
+    }
+    return true;
+}
+
+PassivePortPool::Listener PassivePortPool::renew(Listener listener) {
+    close(listener.fd);
+    if (!m_fixed_range) return {};
+    return listen(listener.port);
+}
+
+PassivePortPool::Listener PassivePortPool::acquire() {
+    Listener listener;
+    // 空闲期间监听socket仍在接受连接，迟到的连接不能交给新的会话，
+    // 否则来自同一IP时会通过数据连接的对端检查
+    while (m_idle.pop(listener)) {
+        if (discardPending(listener.fd)) return listener;
+        listener = renew(listener);
+        if (listener.fd >= 0) return listener;
+    }
+    if (m_fixed_range) {
+        if (bindMissing() > 0 && m_idle.pop(listener)) return listener;
+        spdlog::warn("被动模式端口已耗尽");
+        return {};
+    }
+    return listen(0);
+}
+
+size_t PassivePortPool::bindMissing() {
+    std::lock_guard<std::mutex> lock(m_missing_mtx);
+    size_t bound = 0;
+    std::erase_if(m_missing, [&](uint16_t port) {
+        Listener listener = listen(port);
+        if (listener.fd < 0) return false;
+        if (!m_idle.push(std::move(listener))) close(listener.fd);
+        ++bound;
+        return true;
+    });
+    return bound;
+}
+
+std::vector<int> PassivePortPool::takeIdle(bool keep_half) {
+    std::vector<Listener> idle;
+    if (!m_fixed_range) return {};
+    Listener listener;
+    while (m_idle.pop(listener)) { idle.push_back(listener); }
+    const size_t keep = keep_half ? idle.size() / 2 : 0;
+    for (size_t i = 0; i < keep; ++i) { m_idle.push(std::move(idle[i])); }
+    std::vector<int> fds;
+    for (size_t i = keep; i < idle.size(); ++i) { fds.push_back(idle[i].fd); }
+    return fds;
+}
+
+void PassivePortPool::adopt(int fd) {
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (sockaddr *)&addr, &len);
+    if (!m_idle.push({fd, ntohs(addr.sin_port)})) close(fd);
+}
+
+void PassivePortPool::release(Listener listener) {
+    if (listener.fd < 0) return;
+    // 上一个会话留下的连接尽早释放，acquire()时还会再检查一次
+    if (!discardPending(listener.fd)) {
+        listener = renew(listener);
+        if (listener.fd < 0) return;
+    }
+    if (!m_idle.push(std::move(listener))) close(listener.fd);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "config.h"
+#include "mpmcqueue.h"
+#include <cstdint>
+#include <mutex>
+#include <netinet/in.h>
+#include <vector>
+
+// 被动模式监听socket池，所有会话共享
+// 配置了端口范围时启动时一次性绑定范围内所有端口，否则按需创建临时端口；
+// 传输结束后监听socket归还到池中复用，不再每次PASV都socket/bind/listen/close
+// 热重启时空闲的监听socket交给新进程，旧进程仍占用的端口在它退出后按需补绑
+class PassivePortPool {
+ public:
+    struct Listener {
+        int fd = -1;
+        uint16_t port = 0;
+    };
+    // inherited为从旧进程接管的监听socket，对应的端口不再绑定
+    explicit PassivePortPool(const ServerConfig &config,
+                             const std::vector<int> &inherited = {});
+    PassivePortPool(const PassivePortPool &) = delete;
+    PassivePortPool &operator=(const PassivePortPool &) = delete;
+    ~PassivePortPool();
+
+    // 返回的监听socket没有排队的连接；端口耗尽时返回fd为-1的Listener
+    Listener acquire();
+    // 丢弃尚未取走的连接后放回池中
+    void release(Listener listener);
+    // 取出空闲的监听socket交给新进程，只在配置了端口范围时有意义
+    // keep_half时留下一半，供旧进程排空期间的会话使用
+    std::vector<int> takeIdle(bool keep_half = false);
+    // 放入一个已在监听的socket，例如交接失败后收回的
+    void adopt(int fd);
+    // PASV回复中通告的地址，未配置时返回nullptr，使用控制连接的本地地址
+    const in_addr *publicAddress() const {
+        return m_has_public_addr ? &m_public_addr : nullptr;
+    }
+
+ private:
+    static Listener listen(uint16_t port);
+    // 关闭出错的监听socket，固定端口范围时重新绑定同一端口，失败时fd为-1
+    Listener renew(Listener listener);
+    // 重试绑定启动时被占用的端口，返回成功的个数
+    size_t bindMissing();
+
+    const bool m_fixed_range;
+    std::mutex m_missing_mtx;
+    std::vector<uint16_t> m_missing; // 启动时被其他进程占用的端口
+    MpmcQueue<Listener> m_idle;
+    in_addr m_public_addr{};
+    bool m_has_public_addr = false;
+};
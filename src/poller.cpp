@@ -0,0 +1,6 @@
+#include "poller.h"
+#include "epollpoller.h"
+
+std::unique_ptr<Poller> Poller::create() {
+    return std::make_unique<EpollPoller>();
+}
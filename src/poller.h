@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+
+// I/O多路复用后端接口，事件掩码沿用epoll的EPOLLIN/EPOLLOUT等定义
+class Poller {
+ public:
+    struct Event {
+        int fd;
+        uint32_t events;
+    };
+
+    static std::unique_ptr<Poller> create();
+
+    virtual ~Poller() = default;
+    virtual bool add(int fd, uint32_t events) = 0;
+    virtual bool modify(int fd, uint32_t events) = 0;
+    virtual void remove(int fd) = 0;
+    // 注册监听socket，就绪后由事件循环accept
+    virtual bool addAcceptor(int listen_fd) = 0;
+    // 等待事件，timeout_ms < 0 表示一直等待，返回事件数量，出错返回-1
+    virtual int wait(Event *events, int max_events, int timeout_ms) = 0;
+};
@@ -1,9 +1,76 @@
 #include "response.h"
-#include <spdlog/spdlog.h>
+#include "tls.h"
+#include <cerrno>
 #include <string_view>
+#include <sys/uio.h>
 
-void Response::sendResponse(int socket, const std::string_view &response) {
-    spdlog::debug("发送响应: {}", response);
-    send(socket, response.data(), response.size(),
-         MSG_DONTWAIT | MSG_NOSIGNAL);
+void ResponseQueue::push(std::string_view response) {
+    m_last_code = codeOf(response);
+    m_entries.push_back({response.data(), 0, response.size()});
+    m_pending_bytes += response.size();
+}
+
+bool ResponseQueue::flush() {
+    if (m_tls) return flushTls();
+    while (m_next < m_entries.size()) {
+        iovec iov[IOV_BATCH];
+        size_t count = 0;
+        for (size_t i = m_next; i < m_entries.size() && count < IOV_BATCH;
+             ++i, ++count) {
+            const Entry &entry = m_entries[i];
+            const char *base =
+                entry.data ? entry.data : m_scratch.data() + entry.offset;
+            size_t skip = i == m_next ? m_head_sent : 0;
+            iov[count].iov_base = const_cast<char *>(base + skip);
+            iov[count].iov_len = entry.size - skip;
+        }
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t sent = sendmsg(m_socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (sent < 0) return false;
+        m_pending_bytes -= sent;
+        while (sent > 0) {
+            size_t remaining = m_entries[m_next].size - m_head_sent;
+            if (size_t(sent) < remaining) {
+                m_head_sent += sent;
+                break;
+            }
+            sent -= remaining;
+            ++m_next;
+            m_head_sent = 0;
+        }
+    }
+    // 全部发送完毕，保留缓冲区容量以便复用
+    m_entries.clear();
+    m_scratch.clear();
+    m_next = 0;
+    return true;
+}
+
+bool ResponseQueue::flushTls() {
+    for (size_t i = m_next; i < m_entries.size(); ++i) {
+        const Entry &entry = m_entries[i];
+        const char *base =
+            entry.data ? entry.data : m_scratch.data() + entry.offset;
+        size_t skip = i == m_next ? m_head_sent : 0;
+        m_tls_out.append(base + skip, entry.size - skip);
+    }
+    m_entries.clear();
+    m_scratch.clear();
+    m_next = 0;
+    m_head_sent = 0;
+    // OpenSSL要求重试时至少包含上次未写完的数据，这里只会在末尾追加
+    while (m_tls_sent < m_tls_out.size()) {
+        ssize_t sent = m_tls->write(m_tls_out.data() + m_tls_sent,
+                                    m_tls_out.size() - m_tls_sent);
+        if (sent < 0) return errno == EAGAIN;
+        m_tls_sent += sent;
+        m_pending_bytes -= sent;
+    }
+    m_tls_out.clear();
+    m_tls_sent = 0;
+    return true;
 }
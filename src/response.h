@@ -1,11 +1,20 @@
 #pragma once
+#include <cstddef>
+#include <format>
+#include <iterator>
+#include <string>
 #include <string_view>
 #include <sys/socket.h>
+#include <vector>
+
+class TlsStream;
+
 class Response {
  public:
-    static void sendResponse(int socket, const std::string_view &response);
     constexpr static std::string_view PEND =
         "150 File status okay; about to open data connection\r\n";
+    constexpr static std::string_view CMDOK = "200 Command okay.\r\n";
+    constexpr static std::string_view PBSZOK = "200 PBSZ=0\r\n";
     constexpr static std::string_view READY =
         "220 Service ready for new user\r\n";
     constexpr static std::string_view CLOSECTRL =
@@ -15,17 +24,90 @@ class Response {
         "226 Closing data connection\r\n";
     constexpr static std::string_view LOGGED =
         "230 User logged in, proceed\r\n";
+    constexpr static std::string_view AUTHOK =
+        "234 Proceed with negotiation.\r\n";
     constexpr static std::string_view FILEACTOK =
         "250 Requested file action was okay, completed\r\n";
     constexpr static std::string_view NEEDPASS =
         "331 User name okay, password needed.\r\n";
+    constexpr static std::string_view RANGRESET =
+        "350 Restarting at 0. Range cleared.\r\n";
+    constexpr static std::string_view RESTARTING =
+        "421 Service restarting, please reconnect.\r\n";
+    constexpr static std::string_view TIMEOUT =
+        "421 Timeout, closing control connection.\r\n";
     constexpr static std::string_view FAILDATACONN =
         "425 Can't open data connection.\r\n";
+    constexpr static std::string_view ABORTED =
+        "426 Connection closed; transfer aborted.\r\n";
+    constexpr static std::string_view LINETOOLONG =
+        "500 Syntax error, command line too long.\r\n";
+    constexpr static std::string_view BADARGS =
+        "501 Syntax error in parameters or arguments.\r\n";
     constexpr static std::string_view BADSEQ =
         "503 Bad sequence of commands\r\n";
+    constexpr static std::string_view BADPARAM =
+        "504 Command not implemented for that parameter.\r\n";
     constexpr static std::string_view NOLOG = "530 not logged in.\r\n";
     constexpr static std::string_view NOTIMPL =
         "502 Command not implemented\r\n";
+    constexpr static std::string_view BADPROT =
+        "536 Requested PROT level not supported by mechanism.\r\n";
+    constexpr static std::string_view INVALIDREST =
+        "554 Requested action not taken: invalid REST parameter.\r\n";
     constexpr static std::string_view FILEUNAVAIL =
         "550 Requested action not taken. File unavailable\r\n";
-};
\ No newline at end of file
+};
+
+// 控制连接的响应输出队列
+// 响应先入队，flush时用一次sendmsg(聚集写)发出多条响应；
+// 写不完的部分保留下来，等EPOLLOUT后继续发送
+class ResponseQueue {
+ public:
+    explicit ResponseQueue(int socket) : m_socket(socket) {}
+    // TLS握手完成后经tls加密发送，之前的响应须已全部发出
+    void setTls(TlsStream *tls) { m_tls = tls; }
+    // 只用于生命周期为静态的常量响应，不会复制内容
+    void push(std::string_view response);
+    // 格式化动态响应到可复用的缓冲区中
+    template <class... Args>
+    void format(std::format_string<Args...> fmt, Args &&...args) {
+        size_t begin = m_scratch.size();
+        std::format_to(std::back_inserter(m_scratch), fmt,
+                       std::forward<Args>(args)...);
+        m_entries.push_back({nullptr, begin, m_scratch.size() - begin});
+        m_pending_bytes += m_scratch.size() - begin;
+        m_last_code = codeOf(std::string_view(m_scratch).substr(begin));
+    }
+    // 尽可能多地发送，返回false表示连接出错
+    bool flush();
+    size_t pendingBytes() const { return m_pending_bytes; }
+    // 最近一条入队响应的状态码，用于访问日志
+    int lastCode() const { return m_last_code; }
+
+ private:
+    struct Entry {
+        const char *data; // 为空时内容位于m_scratch的offset处
+        size_t offset;
+        size_t size;
+    };
+    static int codeOf(std::string_view response) {
+        if (response.size() < 3) return 0;
+        return (response[0] - '0') * 100 + (response[1] - '0') * 10 +
+               (response[2] - '0');
+    }
+    // 把待发送的响应合并成一个TLS记录，发不完的部分下次从原位置重试
+    bool flushTls();
+
+    static constexpr int IOV_BATCH = 16;
+    const int m_socket;
+    TlsStream *m_tls = nullptr;
+    std::string m_tls_out;
+    size_t m_tls_sent = 0;
+    std::vector<Entry> m_entries;
+    std::string m_scratch;
+    size_t m_next = 0;      // 第一条未发送完的响应
+    size_t m_head_sent = 0; // 该响应已发送的字节数
+    size_t m_pending_bytes = 0;
+    int m_last_code = 0;
+};
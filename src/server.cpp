@@ -1,4 +1,5 @@
 #include "server.h"
+#include "asynclog.h"
 #include "clientinfo.h"
 #include "clientsession.h"
 #include "threadpool.h"
@@ -11,29 +12,104 @@
 #include <fcntl.h>
 #include <filesystem>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
 #include <spdlog/spdlog.h>
-#include <sys/select.h>
 #include <sys/socket.h>
 #include <thread>
 #include <unistd.h>
 
-const int BUFFER_SIZE = 1024;
+static ServerConfig makeConfig(int port, unsigned limit) {
+    ServerConfig config;
+    config.port = port;
+    config.thread_limit = limit;
+    return config;
+}
 
-Server::Server(int port, unsigned limit)
-    : m_port(port),
-      m_thread_limit(std::min(limit, std::thread::hardware_concurrency()) * 2),
-      m_server_fd(-1), m_threadPool(m_thread_limit), m_working_dir("/var/ftp") {
-    if (!std::filesystem::exists(m_working_dir) ||
-        !std::filesystem::is_directory(m_working_dir)) {
-        spdlog::error("工作目录不存在或不是目录: {}", m_working_dir.string());
+// 必须在打开根目录之前检查，否则只能得到一个异常
+static std::filesystem::path checkWorkingDir(const std::string &dir) {
+    if (!std::filesystem::exists(dir) || !std::filesystem::is_directory(dir)) {
+        spdlog::error("工作目录不存在或不是目录: {}", dir);
         exit(1);
     }
+    return dir;
+}
+
+static std::unique_ptr<TlsContext> makeTls(const ServerConfig &config) {
+    if (config.tls_cert.empty()) return nullptr;
+    auto tls = std::make_unique<TlsContext>(
+        config.tls_cert,
+        config.tls_key.empty() ? config.tls_cert : config.tls_key,
+        config.ktls);
+    spdlog::info("已启用AUTH TLS，kTLS{}",
+                 config.ktls ? "在内核支持时使用" : "已关闭");
+    return tls;
+}
+
+Server::Server(int port, unsigned limit) : Server(makeConfig(port, limit)) {}
+
+Server::Server(const ServerConfig &config)
+    : m_config(config), m_port(config.port),
+      m_thread_limit(
+          std::min(config.thread_limit, std::thread::hardware_concurrency()) *
+          2),
+      m_working_dir(checkWorkingDir(config.working_dir)),
+      m_inherited(HotRestart::takeOver(config.restart_socket)),
+      m_dir_fds(config.working_dir), m_file_cache(config.file_cache_size),
+      m_digests(config.digest_cache_entries, config.digest_xattr),
+      m_passive_ports(config, m_inherited.passive), m_shaper(config),
+      m_tls(makeTls(config)),
+      m_context{m_config,       m_threadPool, m_dir_cache,
+                m_dir_fds,      m_file_cache, m_open_files,
+                m_digests,      m_passive_ports, m_metrics,
+                m_shaper,
+                m_tls.get(),    spdlog::get(ACCESS_LOGGER)},
+      m_threadPool(m_thread_limit, config.pin_workers) {
 #if SOCKETEXAMPLE_DEBUG
     spdlog::set_level(spdlog::level::debug);
 #else
     spdlog::set_level(spdlog::level::info);
 #endif
-    setupServerSocket();
+    // 接管的监听socket每个都要有反应堆accept，多出的反应堆共享已有的socket
+    const std::vector<int> &inherited = m_inherited.listeners;
+    unsigned reactors = std::max(1u, m_config.reactors);
+    if (inherited.size() > reactors) {
+        spdlog::warn("旧进程有{}个监听socket，反应堆数量增加到相同数目",
+                     inherited.size());
+        reactors = inherited.size();
+    }
+    for (unsigned i = 0; i < reactors; ++i) {
+        auto reactor = std::make_unique<Reactor>();
+        if (inherited.empty()) {
+            reactor->listen_fd = setupServerSocket();
+        } else if (i < inherited.size()) {
+            reactor->listen_fd = inherited[i];
+        } else {
+            reactor->listen_fd =
+                fcntl(inherited[i % inherited.size()], F_DUPFD_CLOEXEC, 0);
+        }
+        m_reactors.push_back(std::move(reactor));
+    }
+    m_metrics.setQueueDepthProbe([this]() { return m_threadPool.queueDepth(); });
+    m_metrics.setFileCacheProbe([this]() { return m_file_cache.stats(); });
+    if (m_config.metrics_port > 0) {
+        m_metrics_endpoint = std::make_unique<MetricsEndpoint>(
+            m_reactors[0]->loop, m_metrics, m_config.metrics_port,
+            m_inherited.metrics);
+    } else if (m_inherited.metrics >= 0) {
+        close(m_inherited.metrics);
+    }
+    if (!m_config.restart_socket.empty()) {
+        m_restart = std::make_unique<HotRestart>(
+            m_reactors[0]->loop, m_config.restart_socket,
+            [this]() { return handOff(); },
+            [this](bool confirmed, HotRestart::Sockets &sockets) {
+                finishHandOff(confirmed, sockets);
+            });
+    }
+    spdlog::info("服务器正在监听端口 {} ({}个反应堆) 按q退出", m_port,
+                 reactors);
 }
 
 Server::~Server() {
@@ -41,136 +117,203 @@ Server::~Server() {
     spdlog::info("服务器关闭");
 }
 
-void Server::setupServerSocket() {
-    // 创建socket
-    m_server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (m_server_fd < 0) {
+int Server::setupServerSocket() {
+    // 创建socket，非阻塞以便在事件循环中accept
+    int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (server_fd < 0) {
         spdlog::error("无法创建socket");
         exit(1);
     }
 
-    // 设置socket选项
+    // 设置socket选项，多个反应堆时由内核在各监听socket间分发连接
     int opt = 1;
-    if (setsockopt(m_server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
         spdlog::error("设置socket选项失败");
         exit(1);
     }
+    if (m_config.reactors > 1 &&
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        spdlog::error("设置SO_REUSEPORT失败");
+        exit(1);
+    }
 
     // 绑定地址和端口
     sockaddr_in address{AF_INET, htons(m_port), INADDR_ANY};
 
-    if (bind(m_server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
         spdlog::error("绑定失败");
         exit(1);
     }
 
     // 开始监听
-    if (listen(m_server_fd, 1024) < 0) {
+    if (listen(server_fd, 1024) < 0) {
         spdlog::error("监听失败");
         exit(1);
     }
-
-    spdlog::info("服务器正在监听端口 {} 按q退出", m_port);
+    return server_fd;
 }
 
 void Server::stop() {
     m_running = false;
-    // 关闭监听socket以唤醒accept
-    shutdown(m_server_fd, SHUT_RDWR);
-
-    // 关闭所有客户端socket
-    std::lock_guard<std::mutex> lock(m_mtx);
-    for (int sock : m_client_sockets) { shutdown(sock, SHUT_RDWR); }
+    // 在各反应堆线程中关闭所有会话，唤醒阻塞在数据连接上的工作线程
+    for (auto &reactor : m_reactors) {
+        Reactor *r = reactor.get();
+        r->loop.post([this, r]() {
+            if (r->listen_fd >= 0) r->loop.remove(r->listen_fd);
+            r->loop.remove(m_dir_cache.fd());
+            r->loop.remove(m_dir_fds.fd());
+            r->loop.remove(m_open_files.fd());
+            if (r == m_reactors[0].get() && m_metrics_endpoint) {
+                m_metrics_endpoint->stop();
+            }
+            if (r == m_reactors[0].get() && m_restart) m_restart->stop();
+            // 排空时监听socket已交给新进程并关闭
+            if (r->listen_fd >= 0) shutdown(r->listen_fd, SHUT_RDWR);
+            for (auto &[sock, session] : r->sessions) { session->shutdown(); }
+        });
+        r->loop.stop();
+    }
 }
+
 void Server::run() {
-    setupEpoll();
-    struct epoll_event events[MAX_EVENTS];
-    while (m_running) {
-        int num_events =
-            epoll_wait(m_epoll_fd, events, MAX_EVENTS, 500); // 500ms超时
-
-        if (num_events == -1) {
-            if (errno == EINTR) continue;
-            spdlog::error("epoll错误: {}", strerror(errno));
-            break;
+    std::vector<std::jthread> threads;
+    for (unsigned i = 1; i < m_reactors.size(); ++i) {
+        threads.emplace_back([this, i]() { runReactor(*m_reactors[i], i); });
+    }
+    runReactor(*m_reactors[0], 0);
+}
+
+void Server::runReactor(Reactor &reactor, unsigned index) {
+    if (m_config.pin_reactors) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(index % std::thread::hardware_concurrency(), &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+            spdlog::warn("反应堆{}绑定CPU失败", index);
         }
-        for (int i = 0; i < num_events; ++i) {
-            if (events[i].data.fd == m_server_fd) { handleNewConnections(); }
+    }
+    auto on_accept = [this, &reactor](int sock) {
+        handleNewConnection(reactor, sock);
+    };
+    if (!reactor.loop.addAcceptor(reactor.listen_fd, std::move(on_accept))) {
+        throw std::runtime_error("监听socket注册失败");
+    }
+    if (index == 0 && m_metrics_endpoint && !m_metrics_endpoint->start()) {
+        spdlog::warn("指标导出端点启动失败");
+    }
+    // 目录缓存的失效事件由第一个反应堆处理
+    if (index == 0 && m_dir_cache.fd() >= 0 &&
+        !reactor.loop.add(m_dir_cache.fd(), EPOLLIN | EPOLLET,
+                          [this](uint32_t) { m_dir_cache.processEvents(); })) {
+        spdlog::warn("目录缓存inotify注册失败");
+    }
+    if (index == 0 && m_dir_fds.fd() >= 0 &&
+        !reactor.loop.add(m_dir_fds.fd(), EPOLLIN | EPOLLET,
+                          [this](uint32_t) { m_dir_fds.processEvents(); })) {
+        spdlog::warn("目录fd缓存inotify注册失败");
+    }
+    if (index == 0 && m_open_files.fd() >= 0 &&
+        !reactor.loop.add(m_open_files.fd(), EPOLLIN | EPOLLET,
+                          [this](uint32_t) { m_open_files.processEvents(); })) {
+        spdlog::warn("文件fd缓存inotify注册失败");
+    }
+    if (index == 0) {
+        // 已经开始accept，旧进程可以停止了
+        HotRestart::confirm(m_inherited);
+        if (m_restart && !m_restart->start()) {
+            spdlog::warn("热重启socket启动失败");
         }
     }
+    reactor.loop.run();
 }
 
-void Server::processClient(const ClientInfo &client) {
-    ClientSession session(client.socket, m_working_dir.string());
-    session.start();
-    struct epoll_event event;
-    event.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
-    event.data.fd = client.socket;
-    if (epoll_wait(m_epoll_fd, &event, 1, 100) == 0) { // 100ms超时
-        if (!m_running) return;
-        // 检查停止标志
-    }
-    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, client.socket, nullptr);
-    // 关闭时移除socket记录
-    {
-        std::lock_guard<std::mutex> lock(m_mtx);
-        m_client_sockets.erase(client.socket);
-    }
-    spdlog::debug("关闭客户端连接: {}", inet_ntoa(client.address.sin_addr));
+void Server::handleNewConnection(Reactor &reactor, int socket) {
+    if (!m_running) {
+        close(socket);
+        return;
+    }
+    ClientInfo client{socket};
+    socklen_t addr_len = sizeof(client.address);
+    getpeername(client.socket, (sockaddr *)&client.address, &addr_len);
+    SPDLOG_DEBUG("新客户端连接: {}", inet_ntoa(client.address.sin_addr));
+    // 150和226等相邻的短响应不能被Nagle攒在一起，否则要等对端的延迟确认
+    int nodelay = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    auto session = std::make_unique<ClientSession>(
+        client.socket, reactor.loop, m_context);
+    // 会话结束后延迟到本轮事件分发之后再销毁
+    bool ok = session->start([this, &reactor, sock = client.socket]() {
+        reactor.loop.post([this, &reactor, sock]() {
+            reactor.sessions.erase(sock);
+            checkDrained(reactor);
+        });
+    });
+    if (!ok) {
+        spdlog::error("客户端注册失败: {}", strerror(errno));
+        return;
+    }
+    reactor.sessions.emplace(client.socket, std::move(session));
 }
 
-void Server::setupEpoll() {
-    m_epoll_fd = epoll_create1(0);
-    if (m_epoll_fd == -1) { throw std::runtime_error("epoll创建失败"); }
-    // 添加服务器socket到epoll
-    struct epoll_event event;
-    event.events = EPOLLIN | EPOLLET; // 边缘触发模式
-    event.data.fd = m_server_fd;
-    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_server_fd, &event) == -1) {
-        close(m_epoll_fd);
-        throw std::runtime_error("epoll注册失败");
+HotRestart::Sockets Server::handOff() {
+    HotRestart::Sockets sockets;
+    for (auto &reactor : m_reactors) {
+        sockets.listeners.push_back(reactor->listen_fd);
     }
+    if (m_metrics_endpoint) sockets.metrics = m_metrics_endpoint->fd();
+    // 排空结束之前本进程的会话仍可能PASV，留一半端口给它们
+    sockets.passive = m_passive_ports.takeIdle(true);
+    return sockets;
 }
-void Server::handleNewConnections() {
-    while (m_running) { // 边缘触发需要循环accept
-        ClientInfo client;
-        socklen_t addr_len = sizeof(client.address);
-        client.socket =
-            accept4(m_server_fd, (sockaddr *)&client.address, &addr_len, 0);
-
-        if (client.socket == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
-            continue;
-        }
-        // 注册客户端socket到epoll
-        struct epoll_event event;
-        event.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
-        event.data.fd = client.socket;
-        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, client.socket, &event) == -1) {
-            spdlog::error("客户端注册失败: {}", strerror(errno));
-            close(client.socket);
-            continue;
-        }
-        {
-            std::lock_guard<std::mutex> lock(m_mtx);
-            m_client_sockets.insert(client.socket);
-        }
 
-        m_threadPool.enqueue([this, client]() { processClient(client); });
+void Server::finishHandOff(bool confirmed, HotRestart::Sockets &sockets) {
+    if (!confirmed) {
+        for (int fd : sockets.passive) { m_passive_ports.adopt(fd); }
+        return;
     }
+    // 留下的端口在本进程退出后由新进程补绑
+    for (int fd : sockets.passive) { close(fd); }
+    drain();
 }
-void Server::cleanUp() {
-    std::vector<int> sockets;
-    {
-        std::lock_guard<std::mutex> lock(m_mtx);
-        sockets.assign(m_client_sockets.begin(), m_client_sockets.end());
+
+void Server::drain() {
+    spdlog::info("新进程已接管监听socket，停止accept，最多等待{}秒让会话结束",
+                 m_config.drain_timeout);
+    m_draining = true;
+    m_undrained = m_reactors.size();
+    m_restart->stop();
+    if (m_metrics_endpoint) m_metrics_endpoint->stop();
+    for (auto &reactor : m_reactors) {
+        Reactor *r = reactor.get();
+        r->loop.post([this, r]() {
+            // 监听socket由新进程继续使用，只关闭本进程的fd，不能shutdown
+            // 在此之前accept到的连接已在sessions中，同样被排空
+            r->loop.remove(r->listen_fd);
+            close(r->listen_fd);
+            r->listen_fd = -1;
+            for (auto &[sock, session] : r->sessions) { session->drain(); }
+            checkDrained(*r);
+        });
     }
+    auto timeout = std::chrono::seconds(m_config.drain_timeout);
+    m_reactors[0]->loop.runAfter(timeout, [this]() {
+        spdlog::warn("排空超时，关闭剩余的会话");
+        stop();
+    });
+}
 
-    for (int sock : sockets) {
-        shutdown(sock, SHUT_RDWR);
-        close(sock);
+void Server::checkDrained(Reactor &reactor) {
+    if (!m_draining || reactor.drained || !reactor.sessions.empty()) return;
+    reactor.drained = true;
+    if (--m_undrained == 0) {
+        spdlog::info("所有会话已结束");
+        stop();
     }
+}
 
-    close(m_epoll_fd);
-    close(m_server_fd);
+void Server::cleanUp() {
+    for (auto &reactor : m_reactors) {
+        for (auto &[sock, session] : reactor->sessions) { session->shutdown(); }
+        if (reactor->listen_fd >= 0) close(reactor->listen_fd);
+    }
 }
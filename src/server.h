@@ -1,35 +1,79 @@
 #pragma once
+#include "bandwidth.h"
 #include "clientinfo.h"
+#include "clientsession.h"
+#include "config.h"
+#include "dircache.h"
+#include "dirfdcache.h"
+#include "eventloop.h"
+#include "filecache.h"
+#include "hotrestart.h"
+#include "metrics.h"
+#include "metricsendpoint.h"
+#include "openfilecache.h"
+#include "passiveports.h"
+#include "servercontext.h"
 #include "threadpool.h"
 #include <atomic>
 #include <filesystem>
-#include <mutex>
+#include <memory>
 #include <spdlog/spdlog.h>
-#include <sys/epoll.h>
 #include <thread>
-#include <unordered_set>
+#include <unordered_map>
+#include <vector>
 
 class Server {
  public:
     Server(int port, unsigned limit = std::thread::hardware_concurrency() * 2);
+    explicit Server(const ServerConfig &config);
     ~Server();
+    // 启动所有反应堆，阻塞直到stop()或热重启排空结束
     void run();
     void stop();
 
  private:
-    void setupServerSocket();
-    void processClient(const ClientInfo &client);
-    void setupEpoll();
-    void handleNewConnections();
+    // 每个反应堆拥有独立的监听socket、epoll实例和会话表，互不共享锁
+    struct Reactor {
+        int listen_fd = -1;
+        EventLoop loop;
+        // 控制连接socket -> 会话，只在该反应堆线程中访问
+        std::unordered_map<int, std::unique_ptr<ClientSession>> sessions;
+        bool drained = false;
+    };
+    int setupServerSocket();
+    void runReactor(Reactor &reactor, unsigned index);
+    void handleNewConnection(Reactor &reactor, int socket);
+    // 热重启旧进程：交出监听socket，新进程确认后停止accept并排空会话
+    HotRestart::Sockets handOff();
+    void finishHandOff(bool confirmed, HotRestart::Sockets &sockets);
+    void drain();
+    // 排空期间每个反应堆的会话全部结束后调用，都结束后停止服务器
+    void checkDrained(Reactor &reactor);
     void cleanUp();
-    int m_server_fd;
-    int m_epoll_fd;
+    ServerConfig m_config;
     int m_port;
-    static const int MAX_EVENTS = 64;
     unsigned int m_thread_limit;
     std::atomic<bool> m_running = true;
-    std::mutex m_mtx;
-    ThreadPool m_threadPool;
     std::filesystem::path m_working_dir;
-    std::unordered_set<int> m_client_sockets;
+    // 热重启新进程从旧进程接管的socket，需在端口池和监听socket之前取得
+    HotRestart::Sockets m_inherited;
+    std::atomic<bool> m_draining = false;
+    std::atomic<unsigned> m_undrained = 0;
+    DirCache m_dir_cache;
+    DirFdCache m_dir_fds;
+    FileCache m_file_cache;
+    OpenFileCache m_open_files;
+    DigestCache m_digests;
+    PassivePortPool m_passive_ports;
+    Metrics m_metrics;
+    BandwidthShaper m_shaper;
+    std::unique_ptr<TlsContext> m_tls; // 未配置证书时为空
+    ServerContext m_context;
+    std::vector<std::unique_ptr<Reactor>> m_reactors;
+    // 在第一个反应堆中运行，未配置端口时为空
+    std::unique_ptr<MetricsEndpoint> m_metrics_endpoint;
+    // 在第一个反应堆中等待新进程接管，未配置路径时为空
+    std::unique_ptr<HotRestart> m_restart;
+    // 放在会话之后声明，析构时先等待进行中的数据传输结束
+    ThreadPool m_threadPool;
 };
@@ -0,0 +1,32 @@
+#pragma once
+#include "bandwidth.h"
+#include "config.h"
+#include "digest.h"
+#include "dircache.h"
+#include "dirfdcache.h"
+#include "filecache.h"
+#include "metrics.h"
+#include "openfilecache.h"
+#include "passiveports.h"
+#include "threadpool.h"
+#include "tls.h"
+#include <memory>
+#include <spdlog/logger.h>
+
+// 所有反应堆共享的服务器级资源，生命周期由Server管理
+struct ServerContext {
+    const ServerConfig &config;
+    ThreadPool &pool;
+    DirCache &dir_cache;
+    DirFdCache &dir_fds;
+    FileCache &file_cache;
+    OpenFileCache &open_files;
+    DigestCache &digests;
+    PassivePortPool &passive_ports;
+    Metrics &metrics;
+    BandwidthShaper &shaper;
+    // 未配置证书时为空
+    const TlsContext *tls;
+    // 未配置访问日志时为空
+    std::shared_ptr<spdlog::logger> access_log;
+};
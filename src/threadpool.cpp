@@ -1,30 +1,119 @@
 #include "threadpool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <spdlog/spdlog.h>
 
-ThreadPool::ThreadPool(int numThreads) : m_stop(false) {
+// 当前线程所属的线程池及其下标，用于把工作线程内提交的任务放入自己的队列
+thread_local const ThreadPool *t_pool = nullptr;
+thread_local size_t t_index = 0;
+
+// 找不到任务时先自旋若干轮再休眠，减少短暂空闲时的唤醒开销
+constexpr int SPIN_ROUNDS = 64;
+
+ThreadPool::ThreadPool(int numThreads, bool pin) {
+    numThreads = std::max(1, numThreads);
     for (int i = 0; i < numThreads; ++i) {
-        m_workers.emplace_back([this] {
-            for (;;) {
-                std::function<void()> task;
-                {
-                    std::unique_lock<std::mutex> lock(this->m_mutex);
-                    this->m_condition.wait(lock, [this] {
-                        return this->m_stop || !this->m_tasks.empty();
-                    });
-                    if (this->m_stop && this->m_tasks.empty()) { return; }
-                    task = std::move(this->m_tasks.front());
-                    this->m_tasks.pop();
-                }
-                task();
-            }
-        });
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    const unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < numThreads; ++i) {
+        auto &thread = m_workers[i]->thread;
+        thread = std::thread([this, i]() { workerLoop(i); });
+        if (!pin) continue;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(i % cpus, &set);
+        if (pthread_setaffinity_np(thread.native_handle(), sizeof(set),
+                                   &set) != 0) {
+            spdlog::warn("工作线程{}绑定CPU失败", i);
+        }
     }
 }
 
 ThreadPool::~ThreadPool() {
-    {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        m_stop = true;
+    m_stop = true;
+    m_epoch.fetch_add(1);
+    m_epoch.notify_all();
+    for (auto &worker : m_workers) { worker->thread.join(); }
+}
+
+void ThreadPool::submit(Task &&task) {
+    push(std::move(task));
+    notify(1);
+}
+
+void ThreadPool::push(Task &&task) {
+    if (m_stop.load(std::memory_order_relaxed)) {
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+    }
+    const size_t n = m_workers.size();
+    size_t start = t_pool == this
+                       ? t_index
+                       : m_next.fetch_add(1, std::memory_order_relaxed) % n;
+    for (size_t i = 0; i < n; ++i) {
+        if (m_workers[(start + i) % n]->queue.push(std::move(task))) return;
+    }
+    std::lock_guard<std::mutex> lock(m_overflow_mtx);
+    m_overflow.push_back(std::move(task));
+    m_overflow_size.fetch_add(1, std::memory_order_release);
+}
+
+size_t ThreadPool::queueDepth() const {
+    size_t depth = m_overflow_size.load(std::memory_order_relaxed);
+    for (const auto &worker : m_workers) { depth += worker->queue.size(); }
+    return depth;
+}
+
+void ThreadPool::notify(size_t count) {
+    if (count == 0) return;
+    m_epoch.fetch_add(1);
+    // 没有休眠的线程时省去系统调用
+    if (m_sleepers.load() == 0) return;
+    if (count == 1) {
+        m_epoch.notify_one();
+    } else {
+        m_epoch.notify_all();
+    }
+}
+
+bool ThreadPool::take(size_t self, Task &task) {
+    const size_t n = m_workers.size();
+    for (size_t i = 0; i < n; ++i) {
+        if (m_workers[(self + i) % n]->queue.pop(task)) return true;
+    }
+    if (m_overflow_size.load(std::memory_order_acquire) == 0) return false;
+    std::lock_guard<std::mutex> lock(m_overflow_mtx);
+    if (m_overflow.empty()) return false;
+    task = std::move(m_overflow.front());
+    m_overflow.pop_front();
+    m_overflow_size.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    t_pool = this;
+    t_index = index;
+    Task task;
+    int idle = 0;
+    for (;;) {
+        if (!take(index, task)) {
+            if (++idle < SPIN_ROUNDS) {
+                std::this_thread::yield();
+                continue;
+            }
+            // 先读取epoch再检查一次队列：之后的提交必然会改变epoch，不会丢失唤醒
+            uint32_t epoch = m_epoch.load();
+            if (!take(index, task)) {
+                if (m_stop) return; // 队列已空
+                m_sleepers.fetch_add(1);
+                m_epoch.wait(epoch);
+                m_sleepers.fetch_sub(1);
+                idle = 0;
+                continue;
+            }
+        }
+        task();
+        task = Task();
+        idle = 0;
     }
-    m_condition.notify_all();
-    for (std::thread &worker : m_workers) { worker.join(); }
 }
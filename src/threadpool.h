@@ -1,37 +1,152 @@
 #pragma once
-#include <condition_variable>
+#include "mpmcqueue.h"
+#include <atomic>
+#include <cstddef>
+#include <deque>
 #include <functional>
 #include <future>
-#include <queue>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
 #include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// 工作窃取线程池
+// 每个工作线程有自己的无锁任务队列，空闲时从其他线程的队列窃取任务；
+// 所有队列都满时任务进入加锁的溢出队列，提交永远不会阻塞
 class ThreadPool {
  public:
-    ThreadPool(int numThreads);
+    // 只可移动的任务，小的可调用对象就地存放，不分配堆内存
+    class Task {
+     public:
+        static constexpr size_t INLINE_SIZE = 48;
+
+        Task() = default;
+        template <class F, class Fn = std::decay_t<F>,
+                  class = std::enable_if_t<!std::is_same_v<Fn, Task>>>
+        Task(F &&f) {
+            if constexpr (fitsInline<Fn>()) {
+                new (m_storage) Fn(std::forward<F>(f));
+                m_ops = &INLINE_OPS<Fn>;
+            } else {
+                new (m_storage) Fn *(new Fn(std::forward<F>(f)));
+                m_ops = &HEAP_OPS<Fn>;
+            }
+        }
+        Task(Task &&other) noexcept : m_ops(other.m_ops) {
+            if (m_ops) m_ops->move(m_storage, other.m_storage);
+            other.m_ops = nullptr;
+        }
+        Task &operator=(Task &&other) noexcept {
+            if (this != &other) {
+                reset();
+                m_ops = std::exchange(other.m_ops, nullptr);
+                if (m_ops) m_ops->move(m_storage, other.m_storage);
+            }
+            return *this;
+        }
+        ~Task() { reset(); }
+        explicit operator bool() const { return m_ops != nullptr; }
+        void operator()() { m_ops->invoke(m_storage); }
+
+     private:
+        struct Ops {
+            void (*invoke)(void *);
+            // 把src移动构造到dst并析构src
+            void (*move)(void *dst, void *src);
+            void (*destroy)(void *);
+        };
+        template <class Fn> static constexpr bool fitsInline() {
+            return sizeof(Fn) <= INLINE_SIZE &&
+                   alignof(Fn) <= alignof(std::max_align_t) &&
+                   std::is_nothrow_move_constructible_v<Fn>;
+        }
+        template <class Fn>
+        static constexpr Ops INLINE_OPS{
+            [](void *p) { (*static_cast<Fn *>(p))(); },
+            [](void *dst, void *src) {
+                new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+                static_cast<Fn *>(src)->~Fn();
+            },
+            [](void *p) { static_cast<Fn *>(p)->~Fn(); }};
+        template <class Fn>
+        static constexpr Ops HEAP_OPS{
+            [](void *p) { (**static_cast<Fn **>(p))(); },
+            [](void *dst, void *src) {
+                new (dst) Fn *(*static_cast<Fn **>(src));
+            },
+            [](void *p) { delete *static_cast<Fn **>(p); }};
+        void reset() {
+            if (m_ops) m_ops->destroy(m_storage);
+            m_ops = nullptr;
+        }
+
+        alignas(std::max_align_t) unsigned char m_storage[INLINE_SIZE];
+        const Ops *m_ops = nullptr;
+    };
+
+    // pin为true时把第i个工作线程绑定到第i个CPU
+    explicit ThreadPool(int numThreads, bool pin = false);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    // 执行完所有已提交的任务后返回
     ~ThreadPool();
 
+    // 提交任务，不返回结果
+    void submit(Task &&task);
+    // 批量提交，分散到各工作线程的队列后只唤醒一次
+    // 传入右值时移动其中的元素，否则复制
+    template <class Range> void submitBatch(Range &&tasks) {
+        size_t count = 0;
+        for (auto &&task : tasks) {
+            if constexpr (std::is_lvalue_reference_v<Range>) {
+                push(Task(task));
+            } else {
+                push(Task(std::move(task)));
+            }
+            ++count;
+        }
+        notify(count);
+    }
+
+    // 排队中的任务数，近似值
+    size_t queueDepth() const;
+
+    // 需要返回值时使用，每个任务会额外分配共享状态
     template <class F, class... Args>
     auto enqueue(F &&f, Args &&...args) -> std::future<decltype(f(args...))> {
         using return_type = decltype(f(args...));
-
-        auto task = std::make_shared<std::packaged_task<return_type()>>(
+        std::packaged_task<return_type()> task(
             std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-
-        std::future<return_type> res = task->get_future();
-        {
-            std::unique_lock<std::mutex> lock(m_mutex);
-            if (m_stop) {
-                throw std::runtime_error("enqueue on stopped ThreadPool");
-            }
-            m_tasks.emplace([task]() { (*task)(); });
-        }
-        m_condition.notify_one();
+        std::future<return_type> res = task.get_future();
+        submit([task = std::move(task)]() mutable { task(); });
         return res;
     }
 
  private:
-    std::vector<std::thread> m_workers;
-    std::queue<std::function<void()>> m_tasks;
-    std::mutex m_mutex;
-    std::condition_variable m_condition;
-    bool m_stop;
-};
\ No newline at end of file
+    static constexpr size_t QUEUE_CAPACITY = 1024;
+    struct Worker {
+        Worker() : queue(QUEUE_CAPACITY) {}
+        MpmcQueue<Task> queue;
+        std::thread thread;
+    };
+    void push(Task &&task);
+    // 唤醒最多count个休眠的工作线程
+    void notify(size_t count);
+    // 依次尝试自己的队列、其他线程的队列和溢出队列
+    bool take(size_t self, Task &task);
+    void workerLoop(size_t index);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<size_t> m_next = 0; // 外部线程提交时轮流选择队列
+    std::mutex m_overflow_mtx;
+    std::deque<Task> m_overflow;
+    std::atomic<size_t> m_overflow_size = 0;
+    // 每次提交加一，空闲的工作线程在其上等待
+    std::atomic<uint32_t> m_epoch = 0;
+    std::atomic<uint32_t> m_sleepers = 0;
+    std::atomic<bool> m_stop = false;
+};
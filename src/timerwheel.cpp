@@ -0,0 +1,186 @@
+#include "timerwheel.h"
+#include <algorithm>
+#include <bit>
+#include <climits>
+
+TimerWheel::TimerWheel(Clock::time_point origin)
+    : m_origin(origin), m_nodes(HEADS) {
+    for (uint32_t i = 0; i < HEADS; ++i) {
+        m_nodes[i].prev = m_nodes[i].next = i;
+    }
+}
+
+uint64_t TimerWheel::tickOf(Clock::time_point when, bool round_up) const {
+    using std::chrono::milliseconds;
+    if (when <= m_origin) return 0;
+    auto elapsed = when - m_origin;
+    // 定时器向上取整，保证不会提前执行
+    return round_up ? std::chrono::ceil<milliseconds>(elapsed).count()
+                    : std::chrono::floor<milliseconds>(elapsed).count();
+}
+
+void TimerWheel::link(uint32_t head, uint32_t index) {
+    const uint32_t last = m_nodes[head].prev;
+    m_nodes[index].prev = last;
+    m_nodes[index].next = head;
+    m_nodes[last].next = index;
+    m_nodes[head].prev = index;
+    if (head < FIRING) {
+        m_occupied[head / SLOTS][head % SLOTS / 64] |= uint64_t(1)
+                                                       << (head % 64);
+    }
+}
+
+void TimerWheel::unlink(uint32_t index) {
+    const uint32_t prev = m_nodes[index].prev;
+    const uint32_t next = m_nodes[index].next;
+    m_nodes[prev].next = next;
+    m_nodes[next].prev = prev;
+    // 前后都是同一个哨兵说明槽已经空了
+    if (prev == next && prev < FIRING) {
+        m_occupied[prev / SLOTS][prev % SLOTS / 64] &=
+            ~(uint64_t(1) << (prev % 64));
+    }
+}
+
+void TimerWheel::splice(uint32_t from, uint32_t to) {
+    if (empty(from)) return;
+    const uint32_t first = m_nodes[from].next;
+    const uint32_t last = m_nodes[from].prev;
+    m_nodes[to].next = first;
+    m_nodes[to].prev = last;
+    m_nodes[first].prev = to;
+    m_nodes[last].next = to;
+    m_nodes[from].next = m_nodes[from].prev = from;
+    if (from < FIRING) {
+        m_occupied[from / SLOTS][from % SLOTS / 64] &=
+            ~(uint64_t(1) << (from % 64));
+    }
+}
+
+void TimerWheel::release(uint32_t index) {
+    Node &node = m_nodes[index];
+    // 代数变化后旧句柄不再匹配，跳过0以免与默认句柄相同
+    if (++node.generation == 0) node.generation = 1;
+    node.task = nullptr;
+    node.next = m_free;
+    m_free = index;
+    --m_size;
+}
+
+void TimerWheel::place(uint32_t index) {
+    Node &node = m_nodes[index];
+    // 已经过期的放在下一个要处理的槽
+    node.expire =
+        std::clamp(node.expire, m_next_tick, m_next_tick + MAX_DELAY);
+    const uint64_t delta = node.expire - m_next_tick;
+    unsigned level = 0;
+    while (level + 1 < LEVELS && delta >> (SLOT_BITS * (level + 1)) != 0) {
+        ++level;
+    }
+    link(headOf(level, node.expire >> (SLOT_BITS * level)), index);
+}
+
+TimerWheel::TimerId TimerWheel::add(Clock::time_point when, Task &&task) {
+    uint32_t index;
+    if (m_free != NIL) {
+        index = m_free;
+        m_free = m_nodes[index].next;
+    } else {
+        index = uint32_t(m_nodes.size());
+        m_nodes.emplace_back();
+    }
+    m_nodes[index].expire = tickOf(when, true);
+    m_nodes[index].task = std::move(task);
+    place(index);
+    ++m_size;
+    return {index, m_nodes[index].generation};
+}
+
+void TimerWheel::cancel(const TimerId &timer) {
+    if (timer.index < HEADS || timer.index >= m_nodes.size() ||
+        m_nodes[timer.index].generation != timer.generation) {
+        return;
+    }
+    unlink(timer.index);
+    release(timer.index);
+}
+
+void TimerWheel::cascade(unsigned level, uint64_t slot) {
+    // 先整体摘下，重新放入时即使落回同一个槽也不会被重复处理
+    splice(headOf(level, slot), CASCADING);
+    while (!empty(CASCADING)) {
+        const uint32_t index = m_nodes[CASCADING].next;
+        unlink(index);
+        place(index);
+    }
+}
+
+int TimerWheel::nextOccupied(unsigned level, uint64_t slot) const {
+    const uint64_t from = slot & SLOT_MASK;
+    for (uint64_t i = from; i < from + SLOTS;) {
+        const uint64_t s = i & SLOT_MASK;
+        const uint64_t word = m_occupied[level][s / 64] >> (s % 64);
+        if (word != 0) return int(i - from) + std::countr_zero(word);
+        i += 64 - s % 64;
+    }
+    return -1;
+}
+
+int TimerWheel::nextTimeout(Clock::time_point now) const {
+    if (m_size == 0) return -1;
+    uint64_t next = UINT64_MAX;
+    // 第0层的定时器都在[m_next_tick, m_next_tick + SLOTS)之内
+    if (int distance = nextOccupied(0, m_next_tick); distance >= 0) {
+        next = m_next_tick + distance;
+    }
+    // 高层的槽在下移时才能确定其中最早的到期时间，以下移时刻作为下界
+    for (unsigned level = 1; level < LEVELS; ++level) {
+        const unsigned shift = SLOT_BITS * level;
+        const uint64_t boundary =
+            (m_next_tick + (uint64_t(1) << shift) - 1) >> shift;
+        if (int distance = nextOccupied(level, boundary); distance >= 0) {
+            next = std::min(next, (boundary + distance) << shift);
+        }
+    }
+    const uint64_t now_tick = tickOf(now, false);
+    if (next <= now_tick) return 0;
+    return int(std::min<uint64_t>(next - now_tick, INT_MAX));
+}
+
+void TimerWheel::advance(Clock::time_point now) {
+    const uint64_t target = tickOf(now, false);
+    while (m_next_tick <= target) {
+        if (m_size == 0) {
+            m_next_tick = target + 1;
+            break;
+        }
+        const uint64_t tick = m_next_tick;
+        // 低层每转完一圈，把高层对应槽中的定时器移下来
+        for (unsigned level = 1; level < LEVELS; ++level) {
+            const unsigned shift = SLOT_BITS * level;
+            if ((tick & ((uint64_t(1) << shift) - 1)) != 0) break;
+            cascade(level, tick >> shift);
+        }
+        const uint32_t head = headOf(0, tick);
+        m_next_tick = tick + 1;
+        if (empty(head)) {
+            // 跳过空槽，但不能越过下一次下移的时刻
+            const uint64_t boundary = (tick | SLOT_MASK) + 1;
+            int distance = nextOccupied(0, m_next_tick);
+            uint64_t skip_to =
+                distance >= 0 ? m_next_tick + distance : boundary;
+            m_next_tick = std::min({skip_to, boundary, target + 1});
+            continue;
+        }
+        // 任务中添加的定时器最早落在下一个tick，不会混入本次执行的链表
+        splice(head, FIRING);
+        while (!empty(FIRING)) {
+            const uint32_t index = m_nodes[FIRING].next;
+            unlink(index);
+            Task task = std::move(m_nodes[index].task);
+            release(index);
+            task();
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// 分层时间轮，精度1毫秒，添加和取消定时器都是O(1)
+// 共4层，每层256个槽：第0层每槽1毫秒，上一层每槽等于下一层转一圈；
+// 较远的定时器先挂在高层，时间推进到对应的槽时逐层下移，最远约49天
+// 节点存放在数组中复用，句柄带代数，定时器执行或取消后句柄自动失效
+// 不是线程安全的，只在所属的事件循环线程中使用
+class TimerWheel {
+ public:
+    using Clock = std::chrono::steady_clock;
+    using Task = std::function<void()>;
+    // 默认构造的句柄不对应任何定时器，可以安全地cancel
+    struct TimerId {
+        uint32_t index = 0;
+        uint32_t generation = 0;
+    };
+
+    explicit TimerWheel(Clock::time_point origin = Clock::now());
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    // when之后的第一次advance执行task
+    TimerId add(Clock::time_point when, Task &&task);
+    // 定时器已执行或已取消时什么也不做
+    void cancel(const TimerId &timer);
+    // 距离下一次需要advance的毫秒数，没有定时器时返回-1
+    // 最近的定时器还在高层时返回它下移的时刻，不会晚于实际到期时间
+    int nextTimeout(Clock::time_point now) const;
+    // 执行now之前到期的定时器，任务中可以添加或取消定时器
+    void advance(Clock::time_point now);
+    size_t size() const { return m_size; }
+
+ private:
+    static constexpr unsigned LEVELS = 4;
+    static constexpr unsigned SLOT_BITS = 8;
+    static constexpr unsigned SLOTS = 1u << SLOT_BITS;
+    static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+    static constexpr uint64_t MAX_DELAY = (uint64_t(1) << 32) - 1;
+    // 节点数组开头是各个槽的哨兵，之后两个是临时链表的哨兵
+    static constexpr uint32_t FIRING = LEVELS * SLOTS;
+    static constexpr uint32_t CASCADING = FIRING + 1;
+    static constexpr uint32_t HEADS = CASCADING + 1;
+    static constexpr uint32_t NIL = UINT32_MAX;
+    // 双向循环链表节点，以下标相连，数组扩容后仍然有效
+    struct Node {
+        uint32_t prev = 0;
+        uint32_t next = 0;
+        uint32_t generation = 1;
+        uint64_t expire = 0; // 到期的tick
+        Task task;
+    };
+    // 每层槽是否非空的位图，用于快速找到下一个到期的槽
+    using Bitmap = std::array<uint64_t, SLOTS / 64>;
+
+    static uint32_t headOf(unsigned level, uint64_t slot) {
+        return level * SLOTS + uint32_t(slot & SLOT_MASK);
+    }
+    uint64_t tickOf(Clock::time_point when, bool round_up) const;
+    bool empty(uint32_t head) const { return m_nodes[head].next == head; }
+    void link(uint32_t head, uint32_t index);
+    void unlink(uint32_t index);
+    // 把from整条链表移到空的to上
+    void splice(uint32_t from, uint32_t to);
+    void release(uint32_t index);
+    // 按到期时间与当前tick的距离放入对应层的槽
+    void place(uint32_t index);
+    // 把高层一个槽中的定时器重新放入较低的层
+    void cascade(unsigned level, uint64_t slot);
+    // 从slot(含)开始循环查找第一个非空的槽，返回距离，全空时返回-1
+    int nextOccupied(unsigned level, uint64_t slot) const;
+
+    const Clock::time_point m_origin;
+    uint64_t m_next_tick = 0; // 下一个要处理的tick
+    std::vector<Node> m_nodes;
+    std::array<Bitmap, LEVELS> m_occupied{};
+    uint32_t m_free = NIL; // 空闲节点经next串联
+    size_t m_size = 0;
+};
@@ -0,0 +1,121 @@
+#include "tls.h"
+#include <cerrno>
+#include <new>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+// 取出并清空OpenSSL线程错误队列中最早的一条
+static std::string takeError() {
+    char text[256] = "unknown error";
+    if (unsigned long err = ERR_get_error()) {
+        ERR_error_string_n(err, text, sizeof(text));
+    }
+    ERR_clear_error();
+    return text;
+}
+
+TlsContext::TlsContext(const std::string &cert_file,
+                       const std::string &key_file, bool ktls)
+    : m_ctx(SSL_CTX_new(TLS_server_method())) {
+    if (!m_ctx) throw std::runtime_error("无法创建TLS上下文: " + takeError());
+    SSL_CTX_set_min_proto_version(m_ctx, TLS1_2_VERSION);
+    // 客户端不发close_notify直接关闭数据连接很常见，当作正常结束
+    uint64_t options = SSL_OP_IGNORE_UNEXPECTED_EOF | SSL_OP_NO_RENEGOTIATION;
+    if (ktls) options |= SSL_OP_ENABLE_KTLS;
+    SSL_CTX_set_options(m_ctx, options);
+    // 调用方重试时缓冲区可能已经移动(例如响应队列扩容)；
+    // 空闲的控制连接不保留读写缓冲区
+    SSL_CTX_set_mode(m_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                                SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                                SSL_MODE_RELEASE_BUFFERS);
+    // 数据连接复用控制连接的会话，省去一次完整握手
+    static const unsigned char SESSION_ID[] = "socket-example-ftp";
+    SSL_CTX_set_session_id_context(m_ctx, SESSION_ID, sizeof(SESSION_ID) - 1);
+    if (SSL_CTX_use_certificate_chain_file(m_ctx, cert_file.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(m_ctx, key_file.c_str(),
+                                    SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(m_ctx) != 1) {
+        std::string error = takeError();
+        SSL_CTX_free(m_ctx);
+        throw std::runtime_error("加载TLS证书或私钥失败: " + error);
+    }
+}
+
+TlsContext::~TlsContext() { SSL_CTX_free(m_ctx); }
+
+TlsStream::TlsStream(const TlsContext &context, int sock, Kind kind)
+    : m_ssl(SSL_new(context.get())) {
+    if (!m_ssl) throw std::bad_alloc();
+    SSL_set_fd(m_ssl, sock);
+    if (kind == DATA) SSL_set_num_tickets(m_ssl, 0);
+    SSL_set_accept_state(m_ssl);
+}
+
+TlsStream::~TlsStream() { SSL_free(m_ssl); }
+
+ssize_t TlsStream::fail(int ret, const char *what) {
+    switch (SSL_get_error(m_ssl, ret)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE: errno = EAGAIN; return -1;
+    case SSL_ERROR_ZERO_RETURN: return 0; // 对端发送了close_notify
+    case SSL_ERROR_SYSCALL:
+        if (errno == 0) errno = ECONNRESET;
+        ERR_clear_error();
+        return -1;
+    default:
+        spdlog::warn("{}失败: {}", what, takeError());
+        errno = EPROTO;
+        return -1;
+    }
+}
+
+bool TlsStream::handshake() {
+    if (m_established) return true;
+    ERR_clear_error();
+    int ret = SSL_do_handshake(m_ssl);
+    if (ret == 1) {
+        m_established = true;
+        SPDLOG_DEBUG("TLS握手完成: {} {}，kTLS发送{} 接收{}",
+                     SSL_get_version(m_ssl), SSL_get_cipher_name(m_ssl),
+                     kernelSend(), kernelReceive());
+        return true;
+    }
+    if (fail(ret, "TLS握手") == 0) errno = ECONNRESET;
+    return false;
+}
+
+ssize_t TlsStream::read(void *buf, size_t len) {
+    ERR_clear_error();
+    size_t n = 0;
+    int ret = SSL_read_ex(m_ssl, buf, len, &n);
+    return ret == 1 ? ssize_t(n) : fail(ret, "TLS读取");
+}
+
+ssize_t TlsStream::write(const void *buf, size_t len) {
+    if (len == 0) return 0;
+    ERR_clear_error();
+    size_t n = 0;
+    int ret = SSL_write_ex(m_ssl, buf, len, &n);
+    if (ret == 1) return ssize_t(n);
+    if (fail(ret, "TLS发送") == 0) errno = EPIPE;
+    return -1;
+}
+
+bool TlsStream::kernelSend() const {
+    return BIO_get_ktls_send(SSL_get_wbio(m_ssl));
+}
+
+bool TlsStream::kernelReceive() const {
+    return BIO_get_ktls_recv(SSL_get_rbio(m_ssl));
+}
+
+bool TlsStream::close() {
+    if (!m_established) return true;
+    ERR_clear_error();
+    int ret = SSL_shutdown(m_ssl);
+    if (ret < 0 && fail(ret, "TLS关闭") < 0 && errno == EAGAIN) return false;
+    m_established = false;
+    return true;
+}
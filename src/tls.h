@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <sys/types.h>
+
+typedef struct ssl_ctx_st SSL_CTX;
+typedef struct ssl_st SSL;
+
+// FTPS(RFC 4217)的TLS配置，所有会话共享
+// 握手由OpenSSL完成；内核支持kTLS时会话密钥随后装入socket，
+// 数据连接上的send/sendfile/splice由内核加解密，不需要经过用户态缓冲区
+class TlsContext {
+ public:
+    // 证书或私钥无法加载时抛出std::runtime_error
+    TlsContext(const std::string &cert_file, const std::string &key_file,
+               bool ktls);
+    TlsContext(const TlsContext &) = delete;
+    TlsContext &operator=(const TlsContext &) = delete;
+    ~TlsContext();
+    SSL_CTX *get() const { return m_ctx; }
+
+ private:
+    SSL_CTX *m_ctx = nullptr;
+};
+
+// 非阻塞socket上服务器端的一个TLS连接，不拥有socket
+// read/write的返回值和errno与recv/send相同，需要等待socket就绪时errno为EAGAIN
+class TlsStream {
+ public:
+    enum Kind {
+        CONTROL,
+        DATA // 数据连接不发会话票据，客户端复用控制连接的会话
+    };
+    TlsStream(const TlsContext &context, int sock, Kind kind);
+    TlsStream(const TlsStream &) = delete;
+    TlsStream &operator=(const TlsStream &) = delete;
+    ~TlsStream();
+    // 继续握手，完成时返回true；返回false且errno为EAGAIN时等待socket就绪
+    bool handshake();
+    bool established() const { return m_established; }
+    ssize_t read(void *buf, size_t len);
+    ssize_t write(const void *buf, size_t len);
+    // 握手后内核是否接管了该方向的加解密，接管后可以直接读写socket
+    bool kernelSend() const;
+    bool kernelReceive() const;
+    // 发送close_notify，不等待对端的回应
+    // 返回false且errno为EAGAIN时等socket可写后重试
+    bool close();
+
+ private:
+    // 把SSL_get_error的结果转换为errno并返回-1，对端发送close_notify时返回0
+    ssize_t fail(int ret, const char *what);
+
+    SSL *m_ssl = nullptr;
+    bool m_established = false;
+};
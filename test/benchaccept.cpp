@@ -0,0 +1,91 @@
+// 测量1到N个反应堆时服务器每秒能完成的控制连接数(连接+接收欢迎信息+关闭)
+// 以及每个连接消耗的进程CPU时间(含客户端线程)
+// 用法: benchaccept [最大反应堆数]
+#include "server.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+const int PORT = 8090;
+const auto DURATION = std::chrono::seconds(2);
+
+static bool connect_once() {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == -1) return false;
+    sockaddr_in server_addr{};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(PORT);
+    server_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    bool ok = false;
+    if (connect(sock, (sockaddr *)&server_addr, sizeof(server_addr)) == 0) {
+        char buffer[128];
+        ok = recv(sock, buffer, sizeof(buffer), 0) > 0; // 220
+    }
+    close(sock);
+    return ok;
+}
+
+struct Result {
+    double rate;   // 每秒连接数
+    double cpu_us; // 每个连接的用户态+内核态CPU时间
+};
+
+static double cpuSeconds() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static Result measure(unsigned reactors, unsigned clients) {
+    ServerConfig config;
+    config.port = PORT;
+    config.reactors = reactors;
+    config.pin_reactors = true;
+    Server server(config);
+    spdlog::set_level(spdlog::level::warn); // 构造函数会重设日志级别
+    std::jthread t([&server]() { server.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::atomic<long> done = 0;
+    std::atomic<bool> stop = false;
+    std::vector<std::jthread> threads;
+    auto start = std::chrono::steady_clock::now();
+    const double cpu_start = cpuSeconds();
+    for (unsigned i = 0; i < clients; ++i) {
+        threads.emplace_back([&]() {
+            while (!stop) {
+                if (connect_once()) ++done;
+            }
+        });
+    }
+    std::this_thread::sleep_for(DURATION);
+    stop = true;
+    threads.clear();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    const double cpu = cpuSeconds() - cpu_start;
+    server.stop();
+    return {done / seconds, cpu / done * 1e6};
+}
+
+int main(int argc, char *argv[]) {
+    unsigned max_reactors =
+        argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+    unsigned clients = std::max(4u, std::thread::hardware_concurrency() * 2);
+    for (unsigned r = 1; r <= std::max(1u, max_reactors); ++r) {
+        Result result = measure(r, clients);
+        std::cout << "reactors=" << r << " connections/s=" << result.rate
+                  << " cpu_us/connection=" << result.cpu_us << std::endl;
+    }
+    return 0;
+}
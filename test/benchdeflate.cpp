@@ -0,0 +1,116 @@
+// MODE Z压缩吞吐：单线程整体压缩与DeflateStream按块并行压缩的对比
+// 输入是内存中类似日志的文本，输出经zlib解压校验
+// 这里发送方总在等压缩，自适应级别会逐步降到1，压缩后的大小随之变大
+// 用法: benchdeflate [输入大小MB] [压缩级别]
+#include "deflatestream.h"
+#include "eventloop.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <zlib.h>
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    std::cerr << "失败: " << what << std::endl;
+    std::exit(1);
+}
+
+static std::string makeLog(size_t size) {
+    static const char *const WORDS[] = {"GET",   "PUT",     "session",
+                                        "error", "timeout", "transfer",
+                                        "ok",    "retry",   "client"};
+    std::mt19937 rng(1);
+    std::string text;
+    text.reserve(size + 128);
+    for (uint64_t line = 0; text.size() < size; ++line) {
+        text += std::to_string(line);
+        for (int i = 0; i < 4; ++i) {
+            text += ' ';
+            text += WORDS[rng() % std::size(WORDS)];
+        }
+        text += ' ';
+        text += std::to_string(rng() % 100000);
+        text += '\n';
+    }
+    text.resize(size);
+    return text;
+}
+
+static void verify(const std::string &compressed, const std::string &input) {
+    std::string out(input.size(), '\0');
+    uLongf len = out.size();
+    check(uncompress(reinterpret_cast<Bytef *>(out.data()), &len,
+                     reinterpret_cast<const Bytef *>(compressed.data()),
+                     compressed.size()) == Z_OK &&
+              len == input.size() && out == input,
+          "解压校验");
+}
+
+// 返回MB/s，compressed_size为输出大小
+static double runStream(const std::shared_ptr<const std::string> &input,
+                        unsigned threads, int level, size_t &compressed_size) {
+    ThreadPool pool(threads);
+    EventLoop loop;
+    std::string output;
+    std::shared_ptr<DeflateStream> stream;
+    // 模拟发送方：取出所有就绪的输出，没有时等待on_ready
+    auto drain = [&]() {
+        for (;;) {
+            std::string_view data = stream->pending();
+            if (data.empty()) break;
+            output.append(data);
+            stream->consume(data.size());
+        }
+        check(!stream->failed(), "压缩");
+        if (stream->finished()) loop.stop();
+    };
+    auto start = std::chrono::steady_clock::now();
+    DeflateStream::Options options;
+    options.level = level;
+    stream = DeflateStream::create(loop, pool, {input, nullptr, 0,
+                                                off_t(input->size())},
+                                   options, drain);
+    loop.post(drain);
+    loop.run();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    verify(output, *input);
+    compressed_size = output.size();
+    return input->size() / elapsed.count() / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    const size_t size = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64)
+                        << 20;
+    const int level = argc > 2 ? std::atoi(argv[2]) : 6;
+    auto input = std::make_shared<const std::string>(makeLog(size));
+
+    std::string output(compressBound(size), '\0');
+    uLongf len = output.size();
+    auto start = std::chrono::steady_clock::now();
+    check(compress2(reinterpret_cast<Bytef *>(output.data()), &len,
+                    reinterpret_cast<const Bytef *>(input->data()), size,
+                    level) == Z_OK,
+          "单线程压缩");
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "输入" << (size >> 20) << "MB，级别" << level
+              << "，吞吐(MB/s)和压缩后大小:" << std::endl;
+    std::cout << "单线程compress2: " << size / elapsed.count() / 1e6 << "  "
+              << len << std::endl;
+
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= cores * 2; threads *= 2) {
+        size_t compressed = 0;
+        double rate = runStream(input, threads, level, compressed);
+        std::cout << "DeflateStream " << threads << "线程: " << rate << "  "
+                  << compressed << std::endl;
+    }
+    return 0;
+}
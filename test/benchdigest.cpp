@@ -0,0 +1,90 @@
+// HASH/XCRC等命令的摘要吞吐：各算法读取整个文件计算的速度，
+// 以及DigestCache命中时的开销(重复校验同一个大文件的情形)
+// 文件在页缓存中，测得的是计算本身而不是磁盘
+// 用法: benchdigest [文件大小MB]
+#include "digest.h"
+#include "openfilecache.h"
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    std::cerr << "失败: " << what << std::endl;
+    std::exit(1);
+}
+
+// 逐位计算的CRC-32C，用来校验查表和SSE4.2的结果
+static uint32_t crc32cBitwise(const std::string &data) {
+    uint32_t crc = ~0u;
+    for (unsigned char c : data) {
+        crc ^= c;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? crc >> 1 ^ 0x82F63B78 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+int main(int argc, char *argv[]) {
+    const size_t size = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256)
+                        << 20;
+    // RFC 3720附录B.4的测试向量
+    check(crc32c(0, "123456789", 9) == 0xE3069283, "CRC-32C测试向量");
+    std::mt19937 rng(1);
+    std::string sample(4099, '\0');
+    for (char &c : sample) c = char(rng());
+    // 分两段计算，检验续算和未对齐的尾部
+    check(crc32c(crc32c(0, sample.data(), 13), sample.data() + 13,
+                 sample.size() - 13) == crc32cBitwise(sample),
+          "CRC-32C续算");
+
+    char path[] = "/tmp/benchdigestXXXXXX";
+    int fd = mkstemp(path);
+    check(fd >= 0, "创建临时文件");
+    unlink(path);
+    std::vector<char> chunk(1 << 20);
+    for (size_t done = 0; done < size; done += chunk.size()) {
+        for (char &c : chunk) c = char(rng());
+        check(write(fd, chunk.data(), chunk.size()) == ssize_t(chunk.size()),
+              "写入临时文件");
+    }
+    struct statx stx;
+    check(statx(fd, "", AT_EMPTY_PATH, STATX_BASIC_STATS, &stx) == 0, "statx");
+    OpenFile file(fd, stx);
+
+    std::cout << "文件" << (size >> 20) << "MB，吞吐(MB/s):" << std::endl;
+    const DigestAlgorithm ALGORITHMS[] = {
+        DigestAlgorithm::CRC32,  DigestAlgorithm::CRC32C,
+        DigestAlgorithm::MD5,    DigestAlgorithm::SHA1,
+        DigestAlgorithm::SHA256, DigestAlgorithm::SHA512};
+    for (DigestAlgorithm algorithm : ALGORITHMS) {
+        computeDigest(fd, 0, size, algorithm); // 预热页缓存
+        auto start = std::chrono::steady_clock::now();
+        std::string digest = computeDigest(fd, 0, size, algorithm);
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        check(!digest.empty(), "计算摘要");
+        std::cout << digestName(algorithm) << ": "
+                  << size / elapsed.count() / 1e6 << std::endl;
+    }
+
+    DigestCache cache;
+    cache.put(file, DigestAlgorithm::SHA256,
+              computeDigest(fd, 0, size, DigestAlgorithm::SHA256));
+    constexpr int LOOKUPS = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < LOOKUPS; ++i) {
+        check(!cache.get(file, DigestAlgorithm::SHA256).empty(), "缓存命中");
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "缓存命中: " << elapsed.count() / LOOKUPS << "ns/次"
+              << std::endl;
+    return 0;
+}
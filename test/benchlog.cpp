@@ -0,0 +1,85 @@
+// 对比每条命令的日志开销：原先同步写三条调试日志，现在调试日志在编译期去掉，
+// 每条命令只经异步队列写一行访问日志
+#include "asynclog.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 命令按批到来，只统计调用方(反应堆线程)花的时间；
+// 每批不超过队列容量，批间的空闲留给写日志线程，不计入耗时
+constexpr int BATCH = 256;
+template <class F> static double measure(int rounds, F &&f) {
+    double total = 0;
+    for (int done = 0; done < rounds; done += BATCH) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = done; i < std::min(rounds, done + BATCH); ++i) { f(); }
+        total += std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return total;
+}
+
+int main() {
+    const std::vector<std::string> lines{
+        "USER anonymous", "PASS guest", "PWD",      "CWD pub",
+        "PASV",           "LIST",       "RETR a.txt", "NOOP",
+    };
+    const int ROUNDS = 20000;
+    auto null_sink =
+        std::make_shared<spdlog::sinks::basic_file_sink_mt>("/dev/null");
+
+    // 原先的做法：每条命令在反应堆线程上同步格式化并写三条日志
+    spdlog::logger sync_logger("sync", null_sink);
+    auto old_style = [&](spdlog::level::level_enum level) {
+        sync_logger.set_level(level);
+        return measure(ROUNDS, [&] {
+            for (const auto &line : lines) {
+                sync_logger.debug("接收到命令: {}", line);
+                sync_logger.debug("匹配到命令: {}", line);
+                sync_logger.debug("发送响应: {}", "200 Command okay.\r\n");
+            }
+        });
+    };
+    double sync_debug = old_style(spdlog::level::debug);
+    // 运行时过滤：级别检查仍在每个调用点执行
+    double sync_info = old_style(spdlog::level::info);
+
+    // 现在的做法：调试日志不参与编译，访问日志只把正文放进队列
+    double async_time;
+    uint64_t dropped;
+    {
+        auto sink = std::make_shared<AsyncSink>(
+            std::vector<spdlog::sink_ptr>{null_sink}, 4096, LogOverflow::Block);
+        spdlog::logger access("access", sink);
+        access.set_pattern("ts=%Y-%m-%dT%H:%M:%S.%f%z %v");
+        uint64_t session = 1;
+        async_time = measure(ROUNDS, [&] {
+            for (const auto &line : lines) {
+                access.info("session={} user={} event=command cmd={} arg={} "
+                            "reply={} us={}",
+                            session, "\"anonymous\"", line.substr(0, 4),
+                            "\"\"", 200, 3);
+            }
+        });
+        dropped = sink->dropped();
+    }
+
+    double commands = double(ROUNDS) * lines.size();
+    auto report = [&](const char *name, double seconds) {
+        std::cout << name << seconds * 1e9 / commands << " ns/命令"
+                  << std::endl;
+    };
+    report("同步调试日志(debug级别):  ", sync_debug);
+    report("同步调试日志(info级别过滤): ", sync_info);
+    report("异步访问日志:              ", async_time);
+    std::cout << "加速比: " << sync_debug / async_time << "x (丢弃 "
+              << dropped << ")" << std::endl;
+    return 0;
+}
@@ -0,0 +1,80 @@
+// 对比手写解析器与原先基于std::regex的解析器的吞吐量
+#include "ftpcmd.h"
+#include <chrono>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+// 原先的实现：依次尝试每个正则，并把捕获组复制到vector<string>
+struct RegexCommand {
+    int command;
+    std::vector<std::string> args;
+};
+static const std::vector<std::regex> REGEXES{
+    std::regex(R"(^USER\s+(\S+))"),
+    std::regex(R"(^PASS\s+(\S+))"),
+    std::regex(R"(^QUIT\s*)"),
+    std::regex(R"(^CWD\s+(\S+))"),
+    std::regex(R"(^PWD\s*)"),
+    std::regex(R"(^LIST\s*(\S*))"),
+    std::regex(R"(^RETR\s+(\S+))"),
+    std::regex(R"(^STOR\s+(\S+))"),
+    std::regex(R"(^PASV)"),
+    std::regex(R"(^PORT\s+(\d+),(\d+),(\d+),(\d+),(\d+),(\d+))"),
+    std::regex(R"(^FEAT)"),
+    std::regex(R"(^AUTH\s+(\S+))"),
+    std::regex(R"(^NOOP\s*)"),
+    std::regex(R"(^ABOR)"),
+};
+static RegexCommand regexParse(const std::string &raw_cmd) {
+    RegexCommand cmd{-1, {}};
+    for (size_t i = 0; i < REGEXES.size(); ++i) {
+        std::smatch match;
+        if (std::regex_search(raw_cmd, match, REGEXES[i])) {
+            cmd.command = static_cast<int>(i);
+            for (size_t j = 1; j < match.size(); ++j) {
+                cmd.args.push_back(match[j].str());
+            }
+            return cmd;
+        }
+    }
+    return cmd;
+}
+
+template <class F> static double measure(int rounds, F &&f) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) { f(); }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+int main() {
+    const std::vector<std::string> lines{
+        "USER anonymous\r\n", "PASS guest\r\n",       "PWD\r\n",
+        "CWD pub\r\n",        "PASV\r\n",             "LIST\r\n",
+        "RETR file.bin\r\n",  "STOR upload.bin\r\n",  "NOOP\r\n",
+        "ABOR\r\n",           "PORT 127,0,0,1,4,1\r\n", "QUIT\r\n",
+    };
+    const int ROUNDS = 20000;
+    size_t checksum = 0;
+    double regex_time = measure(ROUNDS, [&] {
+        for (const auto &line : lines) {
+            checksum += regexParse(line).command;
+        }
+    });
+    double hand_time = measure(ROUNDS, [&] {
+        for (const auto &line : lines) {
+            checksum += FTPCommandParser::parse(line).command;
+        }
+    });
+    double commands = double(ROUNDS) * lines.size();
+    std::cout << "regex:       " << commands / regex_time << " 命令/秒, "
+              << regex_time * 1e9 / commands << " ns/命令" << std::endl;
+    std::cout << "handwritten: " << commands / hand_time << " 命令/秒, "
+              << hand_time * 1e9 / commands << " ns/命令" << std::endl;
+    std::cout << "加速比: " << regex_time / hand_time << "x (校验 " << checksum
+              << ")" << std::endl;
+    return 0;
+}
@@ -0,0 +1,62 @@
+// 时间轮与原先std::map定时器的添加/取消开销对比，正确性检查见testtimer
+// 用法: benchtimer [定时器数量]
+#include "timerwheel.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+using Clock = TimerWheel::Clock;
+using std::chrono::milliseconds;
+
+// 原先的实现：按(到期时间, 序号)排序的std::map
+class MapTimers {
+ public:
+    using TimerId = std::pair<Clock::time_point, uint64_t>;
+    TimerId add(Clock::time_point when, std::function<void()> &&task) {
+        TimerId id{when, ++m_seq};
+        m_timers.emplace(id, std::move(task));
+        return id;
+    }
+    void cancel(const TimerId &timer) { m_timers.erase(timer); }
+
+ private:
+    std::map<TimerId, std::function<void()>> m_timers;
+    uint64_t m_seq = 0;
+};
+
+template <class Timers> static double armCancel(size_t count, int rounds) {
+    Timers timers;
+    std::vector<decltype(timers.add(Clock::now(), nullptr))> ids(count);
+    std::mt19937 rng(1);
+    auto now = Clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        ids[i] = timers.add(now + milliseconds(rng() % 300'000), [] {});
+    }
+    // 模拟每个连接收到命令后重新设置空闲超时
+    auto start = Clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < count; ++i) {
+            timers.cancel(ids[i]);
+            ids[i] = timers.add(now + milliseconds(rng() % 300'000), [] {});
+        }
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    return elapsed.count() * 1e9 / (double(count) * rounds);
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100'000;
+    const int ROUNDS = 10;
+    double map_ns = armCancel<MapTimers>(count, ROUNDS);
+    double wheel_ns = armCancel<TimerWheel>(count, ROUNDS);
+    std::cout << count << "个定时器，取消并重新添加:" << std::endl;
+    std::cout << "std::map:   " << map_ns << " ns/次" << std::endl;
+    std::cout << "TimerWheel: " << wheel_ns << " ns/次" << std::endl;
+    std::cout << "加速比: " << map_ns / wheel_ns << "x" << std::endl;
+    return 0;
+}
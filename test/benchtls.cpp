@@ -0,0 +1,187 @@
+// 数据连接下载吞吐对比：明文sendfile、OpenSSL用户态加密、kTLS下的sendfile
+// 客户端线程在同一台机器上接收并解密，结果是端到端的吞吐
+// 用法: benchtls [文件大小MB]
+#include "tls.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <string>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+constexpr size_t TLS_CHUNK = 64 << 10; // 与ClientSession的用户态TLS相同
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    std::cerr << "失败: " << what << std::endl;
+    std::exit(1);
+}
+
+// 生成自签名的P-256证书，写入临时文件
+static void makeCertificate(const std::string &cert, const std::string &key) {
+    EVP_PKEY *pkey = EVP_EC_gen("P-256");
+    X509 *x509 = X509_new();
+    check(pkey && x509, "生成密钥");
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+    X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+    X509_gmtime_adj(X509_getm_notAfter(x509), 3600);
+    X509_set_pubkey(x509, pkey);
+    X509_NAME *name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               (const unsigned char *)"localhost", -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+    check(X509_sign(x509, pkey, EVP_sha256()) > 0, "签名证书");
+    FILE *f = std::fopen(cert.c_str(), "w");
+    check(f && PEM_write_X509(f, x509), "写入证书");
+    std::fclose(f);
+    f = std::fopen(key.c_str(), "w");
+    check(f && PEM_write_PrivateKey(f, pkey, nullptr, nullptr, 0, nullptr,
+                                    nullptr),
+          "写入私钥");
+    std::fclose(f);
+    X509_free(x509);
+    EVP_PKEY_free(pkey);
+}
+
+// 返回一对已连接的TCP socket：{服务器端, 客户端}
+static std::pair<int, int> connectPair() {
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr{AF_INET, 0, {htonl(INADDR_LOOPBACK)}};
+    socklen_t len = sizeof(addr);
+    check(bind(listener, (sockaddr *)&addr, sizeof(addr)) == 0 &&
+              listen(listener, 1) == 0 &&
+              getsockname(listener, (sockaddr *)&addr, &len) == 0,
+          "监听");
+    int client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    check(connect(client, (sockaddr *)&addr, sizeof(addr)) == 0, "连接");
+    int server = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    check(server >= 0, "accept");
+    close(listener);
+    return {server, client};
+}
+
+enum class Mode { Plain, UserTls, KernelTls };
+
+// 发送整个文件，返回MB/s；kTLS不可用时返回负数
+static double run(Mode mode, int file_fd, size_t size,
+                  const TlsContext *context, SSL_CTX *client_ctx) {
+    auto [server, client] = connectPair();
+    // 客户端：接收并丢弃所有数据，TLS时在用户态解密
+    std::thread receiver([client, mode, client_ctx]() {
+        std::vector<char> buf(1 << 20);
+        SSL *ssl = nullptr;
+        if (mode != Mode::Plain) {
+            ssl = SSL_new(client_ctx);
+            SSL_set_fd(ssl, client);
+            check(SSL_connect(ssl) == 1, "客户端握手");
+        }
+        for (;;) {
+            int n = ssl ? SSL_read(ssl, buf.data(), buf.size())
+                        : int(recv(client, buf.data(), buf.size(), 0));
+            if (n <= 0) break;
+        }
+        SSL_free(ssl);
+        close(client);
+    });
+    std::unique_ptr<TlsStream> tls;
+    if (mode != Mode::Plain) {
+        tls = std::make_unique<TlsStream>(*context, server, TlsStream::DATA);
+        check(tls->handshake(), "服务器握手");
+        if (mode == Mode::KernelTls && !tls->kernelSend()) {
+            tls->close();
+            tls.reset();
+            shutdown(server, SHUT_RDWR);
+            receiver.join();
+            close(server);
+            return -1;
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    off_t offset = 0;
+    std::vector<char> buf(TLS_CHUNK);
+    while (size_t(offset) < size) {
+        ssize_t n;
+        if (mode == Mode::UserTls) {
+            // ClientSession::sendFileTls的做法：读出一块再交给OpenSSL加密
+            ssize_t got = pread(file_fd, buf.data(), buf.size(), offset);
+            check(got > 0, "读取文件");
+            for (ssize_t done = 0; done < got; done += n) {
+                n = tls->write(buf.data() + done, got - done);
+                check(n > 0, "TLS发送");
+            }
+            offset += got;
+            continue;
+        }
+        // 明文和kTLS走同一条sendfile路径，kTLS时由内核加密
+        n = sendfile(server, file_fd, &offset, size - offset);
+        check(n > 0, "sendfile");
+    }
+    if (tls) tls->close();
+    shutdown(server, SHUT_WR);
+    receiver.join();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    close(server);
+    return size / elapsed.count() / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    const size_t size = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256)
+                        << 20;
+    std::signal(SIGPIPE, SIG_IGN); // 与服务器的main相同
+    char dir_template[] = "/tmp/benchtlsXXXXXX";
+    check(mkdtemp(dir_template), "创建临时目录");
+    const std::string dir = dir_template;
+    const std::string cert = dir + "/cert.pem", key = dir + "/key.pem";
+    const std::string data = dir + "/data.bin";
+    makeCertificate(cert, key);
+    // 文件内容先进入页缓存，各模式都不受磁盘影响
+    int file_fd = open(data.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    check(file_fd >= 0, "创建文件");
+    std::vector<char> block(1 << 20);
+    for (size_t i = 0; i < block.size(); ++i) { block[i] = char(i * 131); }
+    for (size_t done = 0; done < size; done += block.size()) {
+        check(write(file_fd, block.data(), block.size()) > 0, "写入文件");
+    }
+
+    TlsContext user_tls(cert, key, false);
+    TlsContext kernel_tls(cert, key, true);
+    SSL_CTX *client_ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(client_ctx, SSL_VERIFY_NONE, nullptr);
+
+    std::cout << "文件" << (size >> 20) << "MB，吞吐(MB/s):" << std::endl;
+    std::cout << "明文sendfile:  " << run(Mode::Plain, file_fd, size, nullptr,
+                                        client_ctx)
+              << std::endl;
+    std::cout << "用户态TLS:     "
+              << run(Mode::UserTls, file_fd, size, &user_tls, client_ctx)
+              << std::endl;
+    double ktls =
+        run(Mode::KernelTls, file_fd, size, &kernel_tls, client_ctx);
+    if (ktls < 0) {
+        std::cout << "kTLS sendfile: 不可用(内核没有tls模块或OpenSSL未启用kTLS)"
+                  << std::endl;
+    } else {
+        std::cout << "kTLS sendfile: " << ktls << std::endl;
+    }
+    SSL_CTX_free(client_ctx);
+    close(file_fd);
+    unlink(data.c_str());
+    unlink(cert.c_str());
+    unlink(key.c_str());
+    rmdir(dir.c_str());
+    return 0;
+}
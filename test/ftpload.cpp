@@ -0,0 +1,684 @@
+// FTP负载生成器：大量并发会话按脚本执行USER/PASS/PASV/LIST/RETR/STOR
+// 结果以JSON输出，便于在部署前比较性能回归
+// -G时改为分段下载模式：先单流RETR整个-f文件，再用G个会话各自RANG+RETR
+// 其中一段并行下载，比较两者的吞吐
+// 用法: ftpload [-H 地址] [-p 端口] [-c 并发会话数] [-n 会话总数] [-t 线程数]
+//              [-o 每个会话的操作数] [-m list=1,retr=3,stor=1]
+//              [-f RETR文件] [-z STOR字节数] [-G 分段数]
+//              [-S 服务器程序 -d 根目录]
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <random>
+#include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    unsigned concurrency = 100;
+    unsigned sessions = 1000;
+    unsigned threads = 1;
+    unsigned ops_per_session = 4;
+    // 操作权重：LIST, RETR, STOR
+    std::array<unsigned, 3> weights = {1, 3, 1};
+    std::string retr_file = "a.txt";
+    size_t stor_size = 64 * 1024;
+    unsigned segments = 0;  // 大于0时运行分段下载模式
+    std::string server;     // 非空时由本程序启动服务器
+    std::string server_dir; // 服务器根目录
+};
+
+enum Op { LIST_OP, RETR_OP, STOR_OP };
+// 统计延迟的类别：控制命令到收到第一个响应，以及整个数据操作
+enum Kind { USER_CMD, PASS_CMD, PASV_CMD, LIST_CMD, RETR_CMD, STOR_CMD,
+            QUIT_CMD, LIST_XFER, RETR_XFER, STOR_XFER, SESSION, KINDS };
+const char *const KIND_NAMES[KINDS] = {
+    "USER", "PASS", "PASV", "LIST", "RETR", "STOR",
+    "QUIT", "LIST_transfer", "RETR_transfer", "STOR_transfer", "session"};
+
+struct Stats {
+    std::array<std::vector<uint32_t>, KINDS> latency_us;
+    uint64_t sessions = 0;
+    uint64_t commands = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    void merge(const Stats &other) {
+        for (int k = 0; k < KINDS; ++k) {
+            latency_us[k].insert(latency_us[k].end(),
+                                 other.latency_us[k].begin(),
+                                 other.latency_us[k].end());
+        }
+        sessions += other.sessions;
+        commands += other.commands;
+        bytes += other.bytes;
+        errors += other.errors;
+    }
+};
+
+static uint32_t elapsedUs(Clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+                                                                 since)
+        .count();
+}
+
+// 一个线程中运行的一组会话，使用单个epoll驱动
+class Worker {
+ public:
+    Worker(const Options &options, unsigned slots,
+           std::atomic<unsigned> &remaining, unsigned id)
+        : m_options(options), m_remaining(remaining), m_id(id),
+          m_clients(slots), m_rng(id) {
+        m_epoll = epoll_create1(EPOLL_CLOEXEC);
+        m_server.sin_family = AF_INET;
+        m_server.sin_port = htons(options.port);
+        inet_pton(AF_INET, options.host.c_str(), &m_server.sin_addr);
+        m_upload.assign(std::min<size_t>(options.stor_size, 1 << 20), 'x');
+    }
+    ~Worker() { close(m_epoll); }
+
+    void run() {
+        for (size_t i = 0; i < m_clients.size(); ++i) { startSession(i); }
+        epoll_event events[256];
+        while (m_active > 0) {
+            int n = epoll_wait(m_epoll, events, 256, 1000);
+            for (int i = 0; i < n; ++i) {
+                size_t slot = events[i].data.u64 >> 1;
+                if (events[i].data.u64 & 1) {
+                    onData(slot, events[i].events);
+                } else {
+                    onControl(slot);
+                }
+            }
+        }
+    }
+    const Stats &stats() const { return m_stats; }
+
+ private:
+    enum Step { GREETING, USER_SENT, PASS_SENT, PASV_SENT, CMD_SENT, DATA,
+                QUIT_SENT };
+    struct Client {
+        int ctrl = -1;
+        int data = -1;
+        Step step = GREETING;
+        std::string inbuf;
+        unsigned ops_left = 0;
+        Op op = LIST_OP;
+        Kind pending = USER_CMD;
+        Clock::time_point sent_at, op_start, session_start;
+        bool got_reply = false; // 数据操作已收到226
+        bool data_done = false; // 数据连接已读到EOF或已写完
+        size_t upload_left = 0;
+    };
+
+    void startSession(size_t slot) {
+        // 取走一个会话名额，用完后该槽位不再启动新会话
+        unsigned left = m_remaining.load();
+        do {
+            if (left == 0) return;
+        } while (!m_remaining.compare_exchange_weak(left, left - 1));
+        Client &c = m_clients[slot];
+        c = Client{};
+        c.session_start = Clock::now();
+        c.ops_left = m_options.ops_per_session;
+        c.ctrl = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (c.ctrl < 0 ||
+            (connect(c.ctrl, (sockaddr *)&m_server, sizeof(m_server)) < 0 &&
+             errno != EINPROGRESS)) {
+            // 不立即重试，避免服务器不可用时递归耗尽所有名额
+            ++m_stats.errors;
+            if (c.ctrl >= 0) close(c.ctrl);
+            c.ctrl = -1;
+            return;
+        }
+        epoll_event ev{EPOLLIN | EPOLLRDHUP, {.u64 = slot << 1}};
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, c.ctrl, &ev);
+        ++m_active;
+    }
+
+    void endSession(size_t slot) {
+        Client &c = m_clients[slot];
+        if (c.data >= 0) close(c.data);
+        if (c.ctrl >= 0) close(c.ctrl);
+        c.data = c.ctrl = -1;
+        --m_active;
+        startSession(slot);
+    }
+
+    void fail(size_t slot, const char *what) {
+        ++m_stats.errors;
+        if (m_stats.errors <= 10) std::cerr << what << std::endl;
+        endSession(slot);
+    }
+
+    void send(size_t slot, Kind kind, std::string_view command) {
+        Client &c = m_clients[slot];
+        c.pending = kind;
+        c.sent_at = Clock::now();
+        // 命令很短，非阻塞socket上一次就能写完
+        if (::send(c.ctrl, command.data(), command.size(), MSG_NOSIGNAL) !=
+            (ssize_t)command.size()) {
+            fail(slot, "发送命令失败");
+        }
+    }
+
+    void onControl(size_t slot) {
+        Client &c = m_clients[slot];
+        char buffer[4096];
+        bool closed = false;
+        for (;;) {
+            ssize_t n = recv(c.ctrl, buffer, sizeof(buffer), 0);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n <= 0) {
+                // 221之后服务器会立即关闭连接，先处理已收到的响应
+                closed = true;
+                break;
+            }
+            c.inbuf.append(buffer, n);
+        }
+        // 逐行处理，多行响应只看最后一行("NNN ")
+        size_t eol;
+        while ((eol = c.inbuf.find("\r\n")) != std::string::npos) {
+            std::string line = c.inbuf.substr(0, eol);
+            c.inbuf.erase(0, eol + 2);
+            if (line.size() < 4 || line[3] == '-') continue;
+            if (!onReply(slot, std::atoi(line.c_str()), line)) return;
+        }
+        if (closed) fail(slot, "控制连接被关闭");
+    }
+
+    // 返回false表示会话已结束，槽位可能已被新会话占用
+    bool onReply(size_t slot, int code, const std::string &line) {
+        Client &c = m_clients[slot];
+        if (c.step != GREETING && c.step != DATA) {
+            m_stats.latency_us[c.pending].push_back(elapsedUs(c.sent_at));
+            ++m_stats.commands;
+        }
+        switch (c.step) {
+        case GREETING:
+            if (code != 220) break;
+            c.step = USER_SENT;
+            send(slot, USER_CMD, "USER anonymous\r\n");
+            return true;
+        case USER_SENT:
+            if (code != 331 && code != 230) break;
+            c.step = PASS_SENT;
+            send(slot, PASS_CMD, "PASS load@\r\n");
+            return true;
+        case PASS_SENT:
+            if (code != 230) break;
+            nextOp(slot);
+            return true;
+        case PASV_SENT:
+            if (code != 227 || !openData(slot, line)) break;
+            return true;
+        case CMD_SENT:
+            if (code != 150 && code != 125) break;
+            c.step = DATA;
+            return true;
+        case DATA:
+            if (code != 226) break;
+            c.got_reply = true;
+            if (c.data_done) finishOp(slot);
+            return true;
+        case QUIT_SENT:
+            ++m_stats.sessions;
+            m_stats.latency_us[SESSION].push_back(elapsedUs(c.session_start));
+            endSession(slot);
+            return false;
+        }
+        fail(slot, ("意外的响应: " + line).c_str());
+        return false;
+    }
+
+    void nextOp(size_t slot) {
+        Client &c = m_clients[slot];
+        if (c.ops_left == 0) {
+            c.step = QUIT_SENT;
+            return send(slot, QUIT_CMD, "QUIT\r\n");
+        }
+        --c.ops_left;
+        const auto &w = m_options.weights;
+        unsigned pick = m_rng() % (w[0] + w[1] + w[2]);
+        c.op = pick < w[0] ? LIST_OP : pick < w[0] + w[1] ? RETR_OP : STOR_OP;
+        c.op_start = Clock::now();
+        c.step = PASV_SENT;
+        send(slot, PASV_CMD, "PASV\r\n");
+    }
+
+    bool openData(size_t slot, const std::string &line) {
+        Client &c = m_clients[slot];
+        unsigned h[4], p[2];
+        size_t open = line.find('(');
+        if (open == std::string::npos ||
+            std::sscanf(line.c_str() + open, "(%u,%u,%u,%u,%u,%u)", &h[0],
+                        &h[1], &h[2], &h[3], &p[0], &p[1]) != 6) {
+            return false;
+        }
+        sockaddr_in addr = m_server; // 与控制连接相同的地址
+        addr.sin_port = htons(p[0] * 256 + p[1]);
+        c.data = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (c.data < 0 || (connect(c.data, (sockaddr *)&addr, sizeof(addr)) < 0 &&
+                           errno != EINPROGRESS)) {
+            return false;
+        }
+        uint32_t events = c.op == STOR_OP ? EPOLLOUT : EPOLLIN | EPOLLRDHUP;
+        epoll_event ev{events, {.u64 = slot << 1 | 1}};
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, c.data, &ev);
+        c.got_reply = c.data_done = false;
+        c.upload_left = m_options.stor_size;
+        c.step = CMD_SENT;
+        switch (c.op) {
+        case LIST_OP: send(slot, LIST_CMD, "LIST\r\n"); break;
+        case RETR_OP:
+            send(slot, RETR_CMD, "RETR " + m_options.retr_file + "\r\n");
+            break;
+        case STOR_OP:
+            send(slot, STOR_CMD,
+                 "STOR ftpload." + std::to_string(m_id) + "." +
+                     std::to_string(slot) + "\r\n");
+            break;
+        }
+        return true;
+    }
+
+    void onData(size_t slot, uint32_t events) {
+        Client &c = m_clients[slot];
+        if (c.data < 0) return;
+        if (c.op == STOR_OP) {
+            while (c.upload_left > 0) {
+                size_t chunk = std::min(c.upload_left, m_upload.size());
+                ssize_t n = ::send(c.data, m_upload.data(), chunk, MSG_NOSIGNAL);
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+                if (n < 0) return fail(slot, "上传失败");
+                c.upload_left -= n;
+                m_stats.bytes += n;
+            }
+        } else {
+            char buffer[64 * 1024];
+            for (;;) {
+                ssize_t n = recv(c.data, buffer, sizeof(buffer), 0);
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+                if (n < 0) return fail(slot, "下载失败");
+                if (n == 0) break;
+                m_stats.bytes += n;
+            }
+        }
+        // 下载读到EOF或上传写完，关闭数据连接后等待226
+        close(c.data);
+        c.data = -1;
+        c.data_done = true;
+        if (c.got_reply) finishOp(slot);
+    }
+
+    void finishOp(size_t slot) {
+        Client &c = m_clients[slot];
+        Kind kind = c.op == LIST_OP   ? LIST_XFER
+                    : c.op == RETR_OP ? RETR_XFER
+                                      : STOR_XFER;
+        m_stats.latency_us[kind].push_back(elapsedUs(c.op_start));
+        nextOp(slot);
+    }
+
+    const Options &m_options;
+    std::atomic<unsigned> &m_remaining;
+    const unsigned m_id;
+    std::vector<Client> m_clients;
+    std::mt19937 m_rng;
+    int m_epoll = -1;
+    unsigned m_active = 0;
+    sockaddr_in m_server{};
+    std::string m_upload;
+    Stats m_stats;
+};
+
+// 分段下载模式使用的阻塞式客户端，每段一个会话
+class SegmentClient {
+ public:
+    explicit SegmentClient(const sockaddr_in &server) : m_server(server) {
+        m_ctrl = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    }
+    SegmentClient(const SegmentClient &) = delete;
+    SegmentClient &operator=(const SegmentClient &) = delete;
+    ~SegmentClient() {
+        if (m_ctrl >= 0) close(m_ctrl);
+    }
+
+    bool login() {
+        auto addr = reinterpret_cast<const sockaddr *>(&m_server);
+        if (connect(m_ctrl, addr, sizeof(m_server)) < 0 || reply() != 220) {
+            return false;
+        }
+        int code = command("USER anonymous");
+        if (code == 331) code = command("PASS load@");
+        return code == 230 && command("TYPE I") == 200;
+    }
+
+    // 返回文件大小，失败时返回-1
+    int64_t size(const std::string &file) {
+        std::string line;
+        if (command("SIZE " + file, &line) != 213) return -1;
+        return std::atoll(line.c_str() + 4);
+    }
+
+    // 下载[begin, end)并丢弃，end为0时下载整个文件
+    // 返回收到的字节数，失败时返回-1
+    int64_t retrieve(const std::string &file, uint64_t begin, uint64_t end) {
+        std::string line;
+        if (command("PASV", &line) != 227) return -1;
+        unsigned h[4], p[2];
+        size_t open = line.find('(');
+        if (open == std::string::npos ||
+            std::sscanf(line.c_str() + open, "(%u,%u,%u,%u,%u,%u)", &h[0],
+                        &h[1], &h[2], &h[3], &p[0], &p[1]) != 6) {
+            return -1;
+        }
+        sockaddr_in addr = m_server;
+        addr.sin_port = htons(p[0] * 256 + p[1]);
+        int data = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (connect(data, (sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(data);
+            return -1;
+        }
+        // RANG的结束位置包含在内
+        if (end > 0 && command("RANG " + std::to_string(begin) + " " +
+                               std::to_string(end - 1)) != 350) {
+            close(data);
+            return -1;
+        }
+        int code = command("RETR " + file);
+        if (code != 150 && code != 125) {
+            close(data);
+            return -1;
+        }
+        int64_t bytes = 0;
+        std::vector<char> buffer(256 * 1024);
+        for (;;) {
+            ssize_t n = recv(data, buffer.data(), buffer.size(), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            bytes += n;
+        }
+        close(data);
+        return reply() == 226 ? bytes : -1;
+    }
+
+ private:
+    // 读取一条响应，多行响应返回最后一行的响应码
+    int reply(std::string *line = nullptr) {
+        for (;;) {
+            size_t eol;
+            while ((eol = m_inbuf.find("\r\n")) != std::string::npos) {
+                std::string text = m_inbuf.substr(0, eol);
+                m_inbuf.erase(0, eol + 2);
+                if (text.size() < 4 || text[3] == '-') continue;
+                if (line) *line = text;
+                return std::atoi(text.c_str());
+            }
+            char buffer[1024];
+            ssize_t n = recv(m_ctrl, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return -1;
+            m_inbuf.append(buffer, n);
+        }
+    }
+
+    int command(const std::string &cmd, std::string *line = nullptr) {
+        std::string text = cmd + "\r\n";
+        if (::send(m_ctrl, text.data(), text.size(), MSG_NOSIGNAL) !=
+            (ssize_t)text.size()) {
+            return -1;
+        }
+        return reply(line);
+    }
+
+    const sockaddr_in m_server;
+    int m_ctrl = -1;
+    std::string m_inbuf;
+};
+
+// 分段下载模式：比较单流RETR与分段并行下载同一文件的吞吐，结果为JSON
+static bool runSegmented(const Options &options) {
+    sockaddr_in server{AF_INET, htons(options.port), {}};
+    inet_pton(AF_INET, options.host.c_str(), &server.sin_addr);
+    const std::string &file = options.retr_file;
+    SegmentClient single(server);
+    int64_t size = single.login() ? single.size(file) : -1;
+    if (size <= 0) {
+        std::cerr << "无法获取文件大小: " << file << std::endl;
+        return false;
+    }
+    auto start = Clock::now();
+    bool ok = single.retrieve(file, 0, 0) == size;
+    double single_secs =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    // 每段一个会话，各自从同一文件的不同位置读取
+    const unsigned segments = options.segments;
+    std::vector<int64_t> received(segments, -1);
+    start = Clock::now();
+    {
+        std::vector<std::jthread> threads;
+        for (unsigned i = 0; i < segments; ++i) {
+            threads.emplace_back([&, i]() {
+                const uint64_t begin = size * i / segments;
+                const uint64_t end = size * (i + 1) / segments;
+                SegmentClient client(server);
+                if (begin == end) {
+                    received[i] = 0;
+                } else if (client.login()) {
+                    received[i] = client.retrieve(file, begin, end);
+                }
+            });
+        }
+    }
+    double segmented_secs =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    int64_t total = 0;
+    for (unsigned i = 0; i < segments; ++i) {
+        const int64_t expected =
+            size * (i + 1) / segments - size * i / segments;
+        ok = ok && received[i] == expected;
+        total += std::max<int64_t>(received[i], 0);
+    }
+    const double single_rate = size / single_secs / (1 << 20);
+    const double segmented_rate = total / segmented_secs / (1 << 20);
+    std::printf("{\n  \"file\": \"%s\",\n  \"bytes\": %lld,\n"
+                "  \"segments\": %u,\n  \"single_mb_per_sec\": %.2f,\n"
+                "  \"segmented_mb_per_sec\": %.2f,\n  \"speedup\": %.2f,\n"
+                "  \"ok\": %s\n}\n",
+                file.c_str(), (long long)size, segments, single_rate,
+                segmented_rate, segmented_rate / single_rate,
+                ok ? "true" : "false");
+    return ok;
+}
+
+static double percentile(std::vector<uint32_t> &values, double q) {
+    if (values.empty()) return 0;
+    size_t index = std::min(values.size() - 1, size_t(q * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static void printJson(Stats &stats, double secs, const Options &options) {
+    std::printf("{\n  \"concurrency\": %u,\n  \"seconds\": %.3f,\n"
+                "  \"sessions\": %llu,\n  \"sessions_per_sec\": %.1f,\n"
+                "  \"commands\": %llu,\n  \"commands_per_sec\": %.1f,\n"
+                "  \"bytes\": %llu,\n  \"mb_per_sec\": %.2f,\n"
+                "  \"errors\": %llu,\n  \"latency_us\": {",
+                options.concurrency, secs, (unsigned long long)stats.sessions,
+                stats.sessions / secs, (unsigned long long)stats.commands,
+                stats.commands / secs, (unsigned long long)stats.bytes,
+                stats.bytes / secs / (1 << 20),
+                (unsigned long long)stats.errors);
+    const char *sep = "\n";
+    for (int k = 0; k < KINDS; ++k) {
+        auto &values = stats.latency_us[k];
+        if (values.empty()) continue;
+        std::printf("%s    \"%s\": {\"count\": %zu, \"p50\": %.0f, \"p90\": "
+                    "%.0f, \"p99\": %.0f, \"max\": %.0f}",
+                    sep, KIND_NAMES[k], values.size(), percentile(values, 0.5),
+                    percentile(values, 0.9), percentile(values, 0.99),
+                    percentile(values, 1.0));
+        sep = ",\n";
+    }
+    std::printf("\n  }\n}\n");
+}
+
+// 启动服务器并等待端口可连接，返回子进程pid，stdin_fd用于发送退出命令
+static pid_t spawnServer(const Options &options, int &stdin_fd) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) return -1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[0], STDIN_FILENO);
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        std::string port = std::to_string(options.port);
+        const char *dir =
+            options.server_dir.empty() ? "/var/ftp" : options.server_dir.c_str();
+        execl(options.server.c_str(), options.server.c_str(), "-p",
+              port.c_str(), "-d", dir, (char *)nullptr);
+        _exit(127);
+    }
+    close(fds[0]);
+    stdin_fd = fds[1];
+    sockaddr_in addr{AF_INET, htons(options.port), {}};
+    inet_pton(AF_INET, options.host.c_str(), &addr.sin_addr);
+    for (int i = 0; i < 100; ++i) {
+        int sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool ok = connect(sock, (sockaddr *)&addr, sizeof(addr)) == 0;
+        close(sock);
+        if (ok) return pid;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+    return -1;
+}
+
+static bool parseWeights(const char *arg, std::array<unsigned, 3> &weights) {
+    weights = {0, 0, 0};
+    std::string_view spec(arg);
+    while (!spec.empty()) {
+        size_t comma = spec.find(',');
+        std::string_view item = spec.substr(0, comma);
+        spec = comma == spec.npos ? "" : spec.substr(comma + 1);
+        size_t eq = item.find('=');
+        if (eq == item.npos) return false;
+        std::string_view name = item.substr(0, eq);
+        unsigned value = std::atoi(std::string(item.substr(eq + 1)).c_str());
+        if (name == "list") {
+            weights[LIST_OP] = value;
+        } else if (name == "retr") {
+            weights[RETR_OP] = value;
+        } else if (name == "stor") {
+            weights[STOR_OP] = value;
+        } else {
+            return false;
+        }
+    }
+    return weights[0] + weights[1] + weights[2] > 0;
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "H:p:c:n:t:o:m:f:z:G:S:d:")) != -1) {
+        switch (opt) {
+        case 'H': options.host = optarg; break;
+        case 'p': options.port = std::atoi(optarg); break;
+        case 'c': options.concurrency = std::max(1, std::atoi(optarg)); break;
+        case 'n': options.sessions = std::max(1, std::atoi(optarg)); break;
+        case 't': options.threads = std::max(1, std::atoi(optarg)); break;
+        case 'o': options.ops_per_session = std::atoi(optarg); break;
+        case 'm':
+            if (!parseWeights(optarg, options.weights)) {
+                std::cerr << "无效的操作比例: " << optarg << std::endl;
+                return 1;
+            }
+            break;
+        case 'f': options.retr_file = optarg; break;
+        case 'z': options.stor_size = std::atoll(optarg); break;
+        case 'G': options.segments = std::max(1, std::atoi(optarg)); break;
+        case 'S': options.server = optarg; break;
+        case 'd': options.server_dir = optarg; break;
+        default:
+            std::cerr << "用法: " << argv[0]
+                      << " [-H 地址] [-p 端口] [-c 并发] [-n 会话数]"
+                         " [-t 线程数] [-o 每会话操作数]"
+                         " [-m list=1,retr=3,stor=1] [-f 文件] [-z 上传字节数]"
+                         " [-G 分段数] [-S 服务器程序 -d 根目录]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    // 数千个并发会话每个需要两个fd
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    int server_stdin = -1;
+    pid_t server = -1;
+    if (!options.server.empty()) {
+        server = spawnServer(options, server_stdin);
+        if (server < 0) {
+            std::cerr << "启动服务器失败" << std::endl;
+            return 1;
+        }
+    }
+    auto stopServer = [&]() {
+        if (server <= 0) return;
+        (void)!write(server_stdin, "q\n", 2);
+        close(server_stdin);
+        waitpid(server, nullptr, 0);
+    };
+    if (options.segments > 0) {
+        bool ok = runSegmented(options);
+        stopServer();
+        return ok ? 0 : 1;
+    }
+
+    options.threads = std::min(options.threads, options.concurrency);
+    std::atomic<unsigned> remaining = options.sessions;
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (unsigned i = 0; i < options.threads; ++i) {
+        unsigned slots = options.concurrency / options.threads +
+                         (i < options.concurrency % options.threads);
+        workers.push_back(
+            std::make_unique<Worker>(options, slots, remaining, i));
+    }
+    auto start = Clock::now();
+    {
+        std::vector<std::jthread> threads;
+        for (auto &worker : workers) {
+            threads.emplace_back([&worker]() { worker->run(); });
+        }
+    }
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+    Stats total;
+    for (auto &worker : workers) { total.merge(worker->stats()); }
+    printJson(total, secs, options);
+    stopServer();
+    return total.errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+#pragma once
+// 端到端测试共用：在临时根目录下启动服务器，阻塞式的FTP客户端
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+inline int failures = 0;
+
+inline void expect(bool ok, const std::string &what) {
+    if (ok) return;
+    std::cerr << "失败: " << what << std::endl;
+    ++failures;
+}
+
+// 与ftpload -S相同：服务器从stdin读到q时退出
+class TestServer {
+ public:
+    // args为-p/-d之外的命令行参数
+    TestServer(const char *program, int port,
+               const std::vector<std::string> &args = {})
+        : m_address{AF_INET, htons(port), {}} {
+        inet_pton(AF_INET, "127.0.0.1", &m_address.sin_addr);
+        char dir_template[] = "/tmp/ftptestXXXXXX";
+        if (!mkdtemp(dir_template)) return;
+        m_dir = dir_template;
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0) return;
+        m_pid = fork();
+        if (m_pid == 0) {
+            dup2(fds[0], STDIN_FILENO);
+            int devnull = open("/dev/null", O_WRONLY);
+            dup2(devnull, STDOUT_FILENO);
+            std::string port_arg = std::to_string(port);
+            std::vector<const char *> argv = {program, "-p", port_arg.c_str(),
+                                              "-d", m_dir.c_str()};
+            for (const auto &arg : args) { argv.push_back(arg.c_str()); }
+            argv.push_back(nullptr);
+            execv(program, const_cast<char *const *>(argv.data()));
+            _exit(127);
+        }
+        close(fds[0]);
+        m_stdin = fds[1];
+    }
+    TestServer(const TestServer &) = delete;
+    TestServer &operator=(const TestServer &) = delete;
+    ~TestServer() {
+        if (m_pid > 0) {
+            (void)!write(m_stdin, "q\n", 2);
+            close(m_stdin);
+            waitpid(m_pid, nullptr, 0);
+        }
+        if (!m_dir.empty()) std::filesystem::remove_all(m_dir);
+    }
+
+    // 在根目录下创建文件，服务器启动后也可以调用
+    void createFile(const std::string &name, const std::string &content) {
+        std::ofstream(m_dir + "/" + name) << content;
+    }
+    const std::string &dir() const { return m_dir; }
+    const sockaddr_in &address() const { return m_address; }
+
+    // 等待端口可连接
+    bool waitReady() {
+        if (m_pid <= 0) return false;
+        for (int i = 0; i < 100; ++i) {
+            int sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            bool ok = connect(sock, (const sockaddr *)&m_address,
+                              sizeof(m_address)) == 0;
+            close(sock);
+            if (ok) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        return false;
+    }
+
+ private:
+    sockaddr_in m_address;
+    std::string m_dir;
+    pid_t m_pid = -1;
+    int m_stdin = -1;
+};
+
+class FtpClient {
+ public:
+    explicit FtpClient(const sockaddr_in &server) : m_server(server) {
+        m_ctrl = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    }
+    FtpClient(const FtpClient &) = delete;
+    FtpClient &operator=(const FtpClient &) = delete;
+    ~FtpClient() {
+        if (m_ctrl >= 0) close(m_ctrl);
+    }
+
+    bool login() {
+        auto addr = reinterpret_cast<const sockaddr *>(&m_server);
+        if (connect(m_ctrl, addr, sizeof(m_server)) < 0 || reply() != 220) {
+            return false;
+        }
+        int code = command("USER anonymous");
+        if (code == 331) code = command("PASS test@");
+        return code == 230 && command("TYPE I") == 200;
+    }
+
+    int command(const std::string &cmd) {
+        return sendRaw(cmd + "\r\n") ? reply() : -1;
+    }
+
+    // 原样发送，不加CRLF也不等待响应
+    bool sendRaw(const std::string &text) {
+        for (size_t sent = 0; sent < text.size();) {
+            ssize_t n = ::send(m_ctrl, text.data() + sent, text.size() - sent,
+                               MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    // 发送PASV，返回通告的端口，失败时返回-1
+    int pasv() {
+        if (command("PASV") != 227) return -1;
+        unsigned h[4], p[2];
+        size_t open = m_last.find('(');
+        if (open == std::string::npos ||
+            std::sscanf(m_last.c_str() + open, "(%u,%u,%u,%u,%u,%u)", &h[0],
+                        &h[1], &h[2], &h[3], &p[0], &p[1]) != 6) {
+            return -1;
+        }
+        return p[0] * 256 + p[1];
+    }
+
+    // 打开数据连接后发送cmd，返回最终的响应码，数据放入data
+    int transfer(const std::string &cmd, std::string &data) {
+        data.clear();
+        int port = pasv();
+        if (port < 0) return -1;
+        sockaddr_in addr = m_server;
+        addr.sin_port = htons(port);
+        int sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (connect(sock, (sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(sock);
+            return -1;
+        }
+        int code = command(cmd);
+        if (code != 150 && code != 125) {
+            close(sock);
+            return code;
+        }
+        char buffer[4096];
+        for (;;) {
+            ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            data.append(buffer, n);
+        }
+        close(sock);
+        return reply();
+    }
+
+    // 最后一条响应
+    const std::string &last() const { return m_last; }
+
+    // 读取一条响应，多行响应返回最后一行的响应码
+    int reply() {
+        for (;;) {
+            size_t eol;
+            while ((eol = m_inbuf.find("\r\n")) != std::string::npos) {
+                std::string text = m_inbuf.substr(0, eol);
+                m_inbuf.erase(0, eol + 2);
+                if (text.size() < 4 || text[3] == '-') continue;
+                m_last = text;
+                return std::atoi(text.c_str());
+            }
+            char buffer[1024];
+            ssize_t n = recv(m_ctrl, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return -1;
+            m_inbuf.append(buffer, n);
+        }
+    }
+
+ private:
+    const sockaddr_in m_server;
+    int m_ctrl = -1;
+    std::string m_inbuf;
+    std::string m_last;
+};
+
+// 测试结束时输出结果，作为main的返回值
+inline int report() {
+    if (failures == 0) std::cout << "全部通过" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+// 摘要扩展属性与文件缓存的回归测试：-X时HASH把摘要写入扩展属性，
+// 这会产生IN_ATTRIB并改变ctime，曾经使已打开文件的缓存项失效，
+// 之后的RETR重新statx得到新的ctime，小文件缓存因版本不符而未命中
+// 用法: testcache <服务器程序> [端口] [指标端口]
+#include "ftptest.h"
+#include <sys/xattr.h>
+
+static const std::string CONTENT = "hello\n";
+
+// 从指标端口读取小文件缓存的命中次数，失败时返回-1
+static long cacheHits(int metrics_port) {
+    sockaddr_in addr{AF_INET, htons(metrics_port), {}};
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connect(sock, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    const std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+    (void)!send(sock, request.data(), request.size(), MSG_NOSIGNAL);
+    std::string text;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(sock, buffer, sizeof(buffer), 0)) > 0) {
+        text.append(buffer, n);
+    }
+    close(sock);
+    const std::string name = "ftp_file_cache_requests_total{result=\"hit\"} ";
+    size_t pos = text.find(name);
+    if (pos == std::string::npos) return -1;
+    return std::atol(text.c_str() + pos + name.size());
+}
+
+static bool hasDigestXattr(const std::string &path) {
+    char names[1024];
+    ssize_t n = listxattr(path.c_str(), names, sizeof(names));
+    return n > 0 &&
+           std::string(names, n).find("user.ftp.") != std::string::npos;
+}
+
+// 等服务器处理完inotify事件
+static void settle() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+}
+
+static void run(TestServer &server, int metrics_port) {
+    FtpClient client(server.address());
+    if (!client.login()) {
+        expect(false, "登录");
+        return;
+    }
+    std::string data;
+    expect(client.transfer("RETR a.txt", data) == 226 && data == CONTENT,
+           "第一次RETR");
+    expect(client.transfer("RETR a.txt", data) == 226 && data == CONTENT,
+           "第二次RETR");
+    expect(cacheHits(metrics_port) == 1, "第二次RETR命中缓存");
+
+    expect(client.command("HASH a.txt") == 213, "HASH");
+    const std::string digest = client.last();
+    expect(hasDigestXattr(server.dir() + "/a.txt"), "摘要写入扩展属性");
+    settle();
+    expect(client.transfer("RETR a.txt", data) == 226 && data == CONTENT,
+           "HASH后RETR");
+    expect(cacheHits(metrics_port) == 2, "写入扩展属性后RETR仍命中缓存");
+    expect(client.command("HASH a.txt") == 213 && client.last() == digest,
+           "再次HASH得到相同摘要");
+
+    // 内容变化仍要使缓存失效
+    server.createFile("a.txt", "changed\n");
+    settle();
+    expect(client.transfer("RETR a.txt", data) == 226 && data == "changed\n",
+           "修改文件后RETR得到新内容");
+    expect(client.command("HASH a.txt") == 213 && client.last() != digest,
+           "修改文件后HASH得到新摘要");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "用法: " << argv[0] << " <服务器程序> [端口] [指标端口]"
+                  << std::endl;
+        return 1;
+    }
+    const int port = argc > 2 ? std::atoi(argv[2]) : 8095;
+    const int metrics_port = argc > 3 ? std::atoi(argv[3]) : 8094;
+    TestServer server(argv[1], port,
+                      {"-X", "-m", std::to_string(metrics_port)});
+    server.createFile("a.txt", CONTENT);
+    if (server.waitReady()) {
+        run(server, metrics_port);
+    } else {
+        expect(false, "启动服务器");
+    }
+    return report();
+}
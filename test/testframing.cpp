@@ -0,0 +1,74 @@
+// 控制连接按CRLF切分命令的回归测试：命令行被拆成多段到达、
+// 一次发送多条命令、超过MAX_LINE的命令行被丢弃且只回复一次500
+// 用法: testframing <服务器程序> [端口]
+#include "ftptest.h"
+
+// 与ClientSession::MAX_LINE相同，包含CRLF在内不超过该长度的命令行都能处理
+constexpr size_t MAX_LINE = 8192;
+
+// 让之前发送的部分先被服务器单独读取
+static void settle() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+static void run(const sockaddr_in &server) {
+    FtpClient client(server);
+    if (!client.login()) {
+        expect(false, "登录");
+        return;
+    }
+    // 拆成多段，CR和LF也分开到达
+    client.sendRaw("NO");
+    settle();
+    client.sendRaw("OP\r");
+    settle();
+    client.sendRaw("\n");
+    expect(client.reply() == 200, "拆成多段的NOOP");
+
+    // 一次发送多条命令，按顺序各回复一次
+    client.sendRaw("NOOP\r\nCWD /\r\nPWD\r\n");
+    expect(client.reply() == 200, "连发的第一条NOOP");
+    expect(client.reply() == 250, "连发的第二条CWD");
+    expect(client.reply() == 257, "连发的第三条PWD");
+    // 最后一条不完整，等剩余部分到达后才处理
+    client.sendRaw("NOOP\r\nPW");
+    expect(client.reply() == 200, "不完整命令之前的NOOP");
+    settle();
+    client.sendRaw("D\r\n");
+    expect(client.reply() == 257, "补全后的PWD");
+    client.sendRaw("NOOP\n");
+    expect(client.reply() == 200, "只以LF结尾的命令");
+
+    // 恰好MAX_LINE字节的命令行仍能处理，多一个字节就被丢弃
+    std::string fits = "NOOP" + std::string(MAX_LINE - 6, ' ') + "\r\n";
+    client.sendRaw(fits);
+    expect(client.reply() == 200, "恰好MAX_LINE字节的命令行");
+    client.sendRaw("NOOP" + std::string(MAX_LINE - 5, ' ') + "\r\nPWD\r\n");
+    expect(client.reply() == 500, "超过MAX_LINE一个字节的命令行");
+    expect(client.reply() == 257, "超长命令行之后的PWD");
+
+    // 几倍于MAX_LINE的命令行分多次到达，也只回复一次500
+    const std::string huge(MAX_LINE * 3, 'A');
+    for (size_t i = 0; i < huge.size(); i += 1000) {
+        client.sendRaw(huge.substr(i, 1000));
+        if (i % 8000 == 0) settle();
+    }
+    client.sendRaw("\r\nPWD\r\n");
+    expect(client.reply() == 500, "分段到达的超长命令行");
+    expect(client.reply() == 257, "超长命令行只回复一次500");
+    expect(client.command("NOOP") == 200, "丢弃超长命令行后照常处理");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "用法: " << argv[0] << " <服务器程序> [端口]" << std::endl;
+        return 1;
+    }
+    TestServer server(argv[1], argc > 2 ? std::atoi(argv[2]) : 8092);
+    if (server.waitReady()) {
+        run(server.address());
+    } else {
+        expect(false, "启动服务器");
+    }
+    return report();
+}
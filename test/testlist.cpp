@@ -0,0 +1,46 @@
+// LIST/NLST参数的回归测试：客户端常在路径前加ls风格的选项，
+// 曾经整个参数都被丢弃，"LIST -la /sub"列出的是当前目录
+// 用法: testlist <服务器程序> [端口]
+#include "ftptest.h"
+#include <sys/stat.h>
+
+static void run(const sockaddr_in &server) {
+    FtpClient client(server);
+    if (!client.login()) {
+        expect(false, "登录");
+        return;
+    }
+    std::string data;
+    expect(client.transfer("NLST", data) == 226 && data == "sub\r\n",
+           "NLST列出根目录");
+    expect(client.transfer("NLST -l", data) == 226 && data == "sub\r\n",
+           "只有选项时列出当前目录");
+    expect(client.transfer("NLST -la /sub", data) == 226 &&
+               data == "b.txt\r\n",
+           "NLST -la /sub");
+    expect(client.transfer("NLST -l  -a sub", data) == 226 &&
+               data == "b.txt\r\n",
+           "多个选项和连续空格");
+    expect(client.transfer("LIST -la /sub", data) == 226 &&
+               data.find("b.txt") != std::string::npos &&
+               data.find("sub") == std::string::npos,
+           "LIST -la /sub");
+    expect(client.transfer("NLST -l /missing", data) == 550,
+           "NLST -l /missing应返回550");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "用法: " << argv[0] << " <服务器程序> [端口]" << std::endl;
+        return 1;
+    }
+    TestServer server(argv[1], argc > 2 ? std::atoi(argv[2]) : 8093);
+    mkdir((server.dir() + "/sub").c_str(), 0755);
+    server.createFile("sub/b.txt", "b\n");
+    if (server.waitReady()) {
+        run(server.address());
+    } else {
+        expect(false, "启动服务器");
+    }
+    return report();
+}
@@ -0,0 +1,87 @@
+// 命令解析器的单元测试：动词查找与大小写、必须带参数的命令、
+// 含数字的动词，以及过长、过短和未知的动词
+// 用法: testparser
+#include "ftpcmd.h"
+#include <iostream>
+#include <string>
+
+static int failures = 0;
+
+static void expect(bool ok, const std::string &what) {
+    if (ok) return;
+    std::cerr << "失败: " << what << std::endl;
+    ++failures;
+}
+
+static void expectCommand(std::string_view line, FTPCMD command,
+                          std::string_view arg = {}) {
+    FTPCommand cmd = FTPCommandParser::parse(line);
+    expect(cmd.command == command && cmd.arg == arg,
+           "解析\"" + std::string(line) + "\"得到" +
+               std::string(FTPCommandParser::name(cmd.command)) + " \"" +
+               std::string(cmd.arg) + "\"");
+}
+
+int main() {
+    // 每个命令的动词都能查到自己，不区分大小写
+    for (int i = 0; i < Unknown; ++i) {
+        const FTPCMD command = static_cast<FTPCMD>(i);
+        std::string verb(FTPCommandParser::name(command));
+        expectCommand(verb, command);
+        std::string lower = verb;
+        for (char &c : lower) {
+            if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        }
+        expectCommand(lower, command);
+        lower[0] = verb[0];
+        expectCommand(lower + " x", command, "x");
+    }
+
+    // 参数从第一个非空格字符开始，保留其中的空格，去掉行尾的CRLF
+    expectCommand("retr a.txt\r\n", RETR, "a.txt");
+    expectCommand("STOR   my file.txt\r\n", STOR, "my file.txt");
+    expectCommand("LIST\r\n", LIST);
+    expectCommand("NOOP   ", NOOP);
+
+    // 必须带参数的命令解析时不报错，由会话回复501
+    for (std::string_view verb : {"TYPE", "MODE", "PROT"}) {
+        FTPCommand cmd = FTPCommandParser::parse(std::string(verb) + "  \r\n");
+        expect(cmd.verb == verb && cmd.arg.empty() &&
+                   FTPCommandParser::requiresArg(cmd.command),
+               std::string(verb) + "不带参数时应判定为缺少参数");
+    }
+    expectCommand("TYPE I", TYPE, "I");
+    expectCommand("PROT P", PROT, "P");
+    for (FTPCMD command : {PASV, LIST, NLST, NOOP, PWD, QUIT, Unknown}) {
+        expect(!FTPCommandParser::requiresArg(command),
+               std::string(FTPCommandParser::name(command)) + "不需要参数");
+    }
+
+    // 动词中的数字
+    expectCommand("XSHA256 a.txt", XSHA256, "a.txt");
+    expectCommand("xsha256 a.txt", XSHA256, "a.txt");
+    expectCommand("XMD5 a.txt", XMD5, "a.txt");
+    expectCommand("XSHA25 a.txt", Unknown, "a.txt");
+    expectCommand("X1D5", Unknown);
+
+    // 长度超出3~8个字符、前缀相同或含有其他字符的动词
+    expectCommand("XSHA2560", Unknown);
+    FTPCommand overlong = FTPCommandParser::parse("XSHA256512 a.txt");
+    expect(overlong.command == Unknown && overlong.verb == "XSHA256512",
+           "过长的动词原样保留");
+    expectCommand("USERNAME x", Unknown, "x");
+    expectCommand("RETRX a.txt", Unknown, "a.txt");
+    expectCommand("RET a.txt", Unknown, "a.txt");
+    expectCommand("CW /", Unknown, "/");
+    expectCommand("", Unknown);
+    expectCommand("\r\n", Unknown);
+    expectCommand("RE-R a.txt", Unknown, "a.txt");
+    expectCommand("RETR\ta.txt", Unknown);
+    // 打包时高位补0，前导NUL不能与短动词撞车
+    expectCommand(std::string_view("\0CWD /", 6), Unknown, "/");
+    expectCommand("FOOB", Unknown);
+    expect(FTPCommandParser::name(Unknown) == "UNKNOWN", "name(Unknown)");
+
+    if (failures == 0) std::cout << "全部通过" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
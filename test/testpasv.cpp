@@ -0,0 +1,59 @@
+// 被动模式端口回收的回归测试：端口范围只有一个端口，一个会话PASV之后
+// 发送失败的传输命令，另一个会话随后必须仍能PASV并完成传输
+// 失败的RETR/LIST曾经一直占着监听socket，直到会话下一次PASV或结束
+// 用法: testpasv <服务器程序> [端口] [被动模式端口]
+#include "ftptest.h"
+
+static const std::string CONTENT = "hello\n";
+
+static void run(const sockaddr_in &server, int pasv_port) {
+    FtpClient a(server), b(server);
+    if (!a.login() || !b.login()) {
+        expect(false, "登录");
+        return;
+    }
+    // 每个失败的命令之后，另一个会话都要拿到同一个端口
+    const std::vector<std::pair<std::string, int>> failing = {
+        {"RETR missing.txt", 550},
+        {"LIST /missing", 550},
+        {"STOR missing/x.txt", 550},
+        {"NLST /missing", 550},
+        {"MKD x", 503}, // PASV之后不是传输命令
+    };
+    std::string data;
+    for (const auto &[cmd, code] : failing) {
+        expect(a.pasv() == pasv_port, "PASV: " + cmd);
+        int reply = a.command(cmd);
+        if (reply == 150) reply = a.reply();
+        expect(reply == code, cmd + "应返回" + std::to_string(code));
+        expect(b.transfer("RETR a.txt", data) == 226 && data == CONTENT,
+               cmd + "失败后另一个会话复用端口");
+    }
+    expect(a.command("REST 100") == 350, "REST 100");
+    expect(a.pasv() == pasv_port, "PASV: 超出文件末尾的REST");
+    expect(a.command("RETR a.txt") == 554, "超出文件末尾的REST应返回554");
+    expect(b.transfer("RETR a.txt", data) == 226 && data == CONTENT,
+           "REST无效后另一个会话复用端口");
+    expect(a.transfer("RETR a.txt", data) == 226 && data == CONTENT,
+           "失败之后同一会话照常传输");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "用法: " << argv[0]
+                  << " <服务器程序> [端口] [被动模式端口]" << std::endl;
+        return 1;
+    }
+    const int port = argc > 2 ? std::atoi(argv[2]) : 8096;
+    const int pasv_port = argc > 3 ? std::atoi(argv[3]) : 30100;
+    const std::string range =
+        std::to_string(pasv_port) + "-" + std::to_string(pasv_port);
+    TestServer server(argv[1], port, {"-P", range});
+    server.createFile("a.txt", CONTENT);
+    if (server.waitReady()) {
+        run(server.address(), pasv_port);
+    } else {
+        expect(false, "启动服务器");
+    }
+    return report();
+}
@@ -1,23 +1,170 @@
+// 工作窃取线程池与原先单队列线程池的吞吐量和唤醒延迟对比
+// 用法: testpool [最大线程数] [每轮任务数]
 #include "threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <future>
 #include <iostream>
-int main() {
-    ThreadPool pool(4);
-    std::vector<std::future<int>> results;
+#include <queue>
+#include <thread>
+#include <vector>
 
-    for (int i = 0; i < 8; i++) {
-        auto tp = [i] {
-            std::cout << "hello " << i << std::endl;
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            std::cout << "world " << i << std::endl;
-            return i * i;
-        };
-        auto ans = pool.enqueue(std::move(tp));
-        results.emplace_back(std::move(ans));
+// 原先的实现：std::bind + shared_ptr<packaged_task> + 单个互斥锁保护的队列
+class LegacyThreadPool {
+ public:
+    LegacyThreadPool(int numThreads) : m_stop(false) {
+        for (int i = 0; i < numThreads; ++i) {
+            m_workers.emplace_back([this] {
+                for (;;) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        m_condition.wait(lock, [this] {
+                            return m_stop || !m_tasks.empty();
+                        });
+                        if (m_stop && m_tasks.empty()) { return; }
+                        task = std::move(m_tasks.front());
+                        m_tasks.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+    ~LegacyThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+        for (std::thread &worker : m_workers) { worker.join(); }
     }
+    template <class F, class... Args>
+    auto enqueue(F &&f, Args &&...args) -> std::future<decltype(f(args...))> {
+        using return_type = decltype(f(args...));
+        auto task = std::make_shared<std::packaged_task<return_type()>>(
+            std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        std::future<return_type> res = task->get_future();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_tasks.emplace([task]() { (*task)(); });
+        }
+        m_condition.notify_one();
+        return res;
+    }
+
+ private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop;
+};
 
-    for (auto &&result : results)
-        std::cout << result.get() << ' ';
-    std::cout << std::endl;
+using Clock = std::chrono::steady_clock;
+
+static void waitFor(const std::atomic<size_t> &counter, size_t target) {
+    while (counter.load(std::memory_order_acquire) < target) {
+        std::this_thread::yield();
+    }
+}
+
+// 单个生产者连续提交tasks个空任务，返回每秒完成的任务数
+template <class Submit> static double throughput(size_t tasks, Submit &&submit) {
+    std::atomic<size_t> done = 0;
+    auto start = Clock::now();
+    for (size_t i = 0; i < tasks; ++i) {
+        submit([&done]() { done.fetch_add(1, std::memory_order_release); });
+    }
+    waitFor(done, tasks);
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+    return tasks / secs;
+}
 
+// 线程池空闲时逐个提交，测量从提交到开始执行的延迟，返回p50和p99(微秒)
+template <class Submit>
+static std::pair<double, double> latency(size_t samples, Submit &&submit) {
+    std::vector<double> delays(samples);
+    std::atomic<size_t> done = 0;
+    for (size_t i = 0; i < samples; ++i) {
+        auto submitted = Clock::now();
+        submit([&, i, submitted]() {
+            delays[i] = std::chrono::duration<double, std::micro>(
+                            Clock::now() - submitted)
+                            .count();
+            done.fetch_add(1, std::memory_order_release);
+        });
+        waitFor(done, i + 1);
+        // 等工作线程进入休眠，测量的是唤醒延迟
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    std::sort(delays.begin(), delays.end());
+    return {delays[samples / 2], delays[samples * 99 / 100]};
+}
+
+// 功能检查：带返回值的enqueue和批量提交
+static bool check() {
+    ThreadPool pool(4);
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 64; i++) {
+        results.emplace_back(pool.enqueue([](int x) { return x * x; }, i));
+    }
+    int sum = 0;
+    for (auto &&result : results) { sum += result.get(); }
+    std::atomic<size_t> done = 0;
+    std::vector<std::function<void()>> batch(5000, [&done]() { ++done; });
+    pool.submitBatch(batch);
+    waitFor(done, batch.size());
+    return sum == 85344;
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = argc > 1 ? std::atoi(argv[1]) : 64;
+    size_t tasks = argc > 2 ? std::atoll(argv[2]) : 200000;
+    if (!check()) {
+        std::cerr << "线程池结果错误" << std::endl;
+        return 1;
+    }
+    std::cout << "线程数  旧吞吐(万/秒)  新吞吐(万/秒)  批量(万/秒)"
+                 "  旧延迟p50/p99(us)  新延迟p50/p99(us)"
+              << std::endl;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double legacy_rate, rate, batch_rate;
+        std::pair<double, double> legacy_lat, lat;
+        {
+            LegacyThreadPool pool(threads);
+            auto submit = [&pool](auto &&f) { pool.enqueue(f); };
+            legacy_rate = throughput(tasks, submit);
+            legacy_lat = latency(200, submit);
+        }
+        {
+            ThreadPool pool(threads);
+            auto submit = [&pool](auto &&f) { pool.submit(f); };
+            rate = throughput(tasks, submit);
+            lat = latency(200, submit);
+            // 每次提交64个任务
+            std::atomic<size_t> done = 0;
+            auto task = [&done]() {
+                done.fetch_add(1, std::memory_order_release);
+            };
+            std::vector<decltype(task)> batch(64, task);
+            auto start = Clock::now();
+            for (size_t i = 0; i < tasks / batch.size(); ++i) {
+                pool.submitBatch(batch);
+            }
+            waitFor(done, tasks / batch.size() * batch.size());
+            batch_rate = done / std::chrono::duration<double>(Clock::now() -
+                                                             start)
+                                    .count();
+        }
+        std::printf("%6d  %13.1f  %13.1f  %11.1f  %8.1f/%-8.1f  %8.1f/%-8.1f\n",
+                    threads, legacy_rate / 1e4, rate / 1e4, batch_rate / 1e4,
+                    legacy_lat.first, legacy_lat.second, lat.first,
+                    lat.second);
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,90 @@
+// REST/RANG参数边界的回归测试：启动服务器，在临时根目录下对小文件
+// 发送各种断点和范围，检查响应码和收到的内容
+// 负的断点曾经使缓存内容的发送位置回绕，MODE Z下会把堆内存压缩后发出；
+// RANG的结束位置为最大值时曾经溢出
+// 用法: testrange <服务器程序> [端口]
+#include "ftptest.h"
+#include <zlib.h>
+
+static const std::string CONTENT = "hello\n";
+
+static std::string inflateAll(const std::string &data) {
+    std::string out(4096, '\0');
+    uLongf len = out.size();
+    if (uncompress(reinterpret_cast<Bytef *>(out.data()), &len,
+                   reinterpret_cast<const Bytef *>(data.data()),
+                   data.size()) != Z_OK) {
+        return "<解压失败>";
+    }
+    out.resize(len);
+    return out;
+}
+
+static void run(const sockaddr_in &server) {
+    FtpClient client(server);
+    if (!client.login()) {
+        expect(false, "登录");
+        return;
+    }
+    std::string data;
+    expect(client.command("REST -200") == 501, "REST -200应返回501");
+    expect(client.command("REST abc") == 501, "REST abc应返回501");
+    // 被拒绝的REST不影响之后的传输
+    expect(client.transfer("RETR a.txt", data) == 226 && data == CONTENT,
+           "REST被拒绝后RETR整个文件");
+    expect(client.command("REST 2") == 350, "REST 2");
+    expect(client.transfer("RETR a.txt", data) == 226 &&
+               data == CONTENT.substr(2),
+           "REST 2后RETR");
+    expect(client.command("REST 7") == 350, "REST 7");
+    expect(client.transfer("RETR a.txt", data) == 554, "超出文件末尾的REST");
+
+    // RANG的结束位置包含在内，为最大值时不能溢出
+    expect(client.command("RANG 2 9223372036854775807") == 350,
+           "RANG 2 INT64_MAX");
+    expect(client.transfer("RETR a.txt", data) == 226 &&
+               data == CONTENT.substr(2),
+           "RANG 2 INT64_MAX后RETR");
+    expect(client.command("RANG 1 3") == 350, "RANG 1 3");
+    expect(client.transfer("RETR a.txt", data) == 226 &&
+               data == CONTENT.substr(1, 3),
+           "RANG 1 3后RETR");
+    expect(client.command("RANG -1 3") == 501, "RANG -1 3应返回501");
+    expect(client.command("RANG 7 9") == 350, "RANG 7 9");
+    expect(client.transfer("RETR a.txt", data) == 554, "超出文件末尾的RANG");
+    expect(client.command("RANG 7 9") == 350, "RANG 7 9");
+    expect(client.command("HASH a.txt") == 554, "超出文件末尾的RANG后HASH");
+    expect(client.command("RANG 3 9223372036854775807") == 350,
+           "RANG 3 INT64_MAX");
+    expect(client.command("HASH a.txt") == 213, "RANG 3 INT64_MAX后HASH");
+
+    expect(client.command("MODE Z") == 200, "MODE Z");
+    expect(client.command("REST -200") == 501, "MODE Z下REST -200应返回501");
+    expect(client.transfer("RETR a.txt", data) == 226 &&
+               inflateAll(data) == CONTENT,
+           "MODE Z下RETR整个文件");
+    expect(client.command("REST 3") == 350, "MODE Z下REST 3");
+    expect(client.transfer("RETR a.txt", data) == 226 &&
+               inflateAll(data) == CONTENT.substr(3),
+           "MODE Z下REST 3后RETR");
+    expect(client.command("RANG 2 9223372036854775807") == 350,
+           "MODE Z下RANG 2 INT64_MAX");
+    expect(client.transfer("RETR a.txt", data) == 226 &&
+               inflateAll(data) == CONTENT.substr(2),
+           "MODE Z下RANG 2 INT64_MAX后RETR");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "用法: " << argv[0] << " <服务器程序> [端口]" << std::endl;
+        return 1;
+    }
+    TestServer server(argv[1], argc > 2 ? std::atoi(argv[2]) : 8097);
+    server.createFile("a.txt", CONTENT);
+    if (server.waitReady()) {
+        run(server.address());
+    } else {
+        expect(false, "启动服务器");
+    }
+    return report();
+}
@@ -0,0 +1,102 @@
+// ResponseQueue的单元测试：积压的响应远多于IOV_BATCH、发送缓冲区很小时，
+// sendmsg每次只写出一部分(包括停在某条响应的中间)，
+// 接收端拼起来必须与入队顺序完全一致
+// 用法: testresponse
+#include "response.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+static void expect(bool ok, const std::string &what) {
+    if (ok) return;
+    std::cerr << "失败: " << what << std::endl;
+    ++failures;
+}
+
+// 读出peer中当前可读的数据，最多max字节
+static void drain(int peer, std::string &received, size_t max) {
+    char buffer[4096];
+    while (max > 0) {
+        ssize_t n = recv(peer, buffer, std::min(max, sizeof(buffer)),
+                         MSG_DONTWAIT);
+        if (n <= 0) break;
+        received.append(buffer, n);
+        max -= n;
+    }
+}
+
+int main() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        std::cerr << "socketpair失败" << std::endl;
+        return 1;
+    }
+    // Unix域socket每次最多写出约半个发送缓冲区，一批响应比这更长时
+    // sendmsg会停在某条响应的中间
+    int sndbuf = 4096;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    ResponseQueue queue(fds[0]);
+    std::string expected, received;
+    std::set<size_t> boundaries{0}; // 每条响应结束处在expected中的偏移
+    std::mt19937 rng(7);
+    // 常量响应与格式化到缓冲区的动态响应交替，长度各不相同
+    auto enqueue = [&](int count) {
+        for (int i = 0; i < count; ++i) {
+            if (rng() % 2 == 0) {
+                queue.push(Response::CMDOK);
+                expected += Response::CMDOK;
+            } else {
+                std::string name(rng() % 2000, char('a' + i % 26));
+                queue.format("213 {} {}\r\n", i, name);
+                expected += "213 " + std::to_string(i) + ' ' + name + "\r\n";
+            }
+            boundaries.insert(expected.size());
+        }
+    };
+
+    enqueue(200); // 远多于IOV_BATCH，总长度远大于发送缓冲区
+    expect(queue.flush(), "第一次flush");
+    expect(queue.pendingBytes() > 0, "发送缓冲区满时应只写出一部分");
+    drain(fds[1], received, SIZE_MAX);
+    expect(queue.pendingBytes() == expected.size() - received.size(),
+           "pendingBytes与已发送的字节数一致");
+
+    int mid_entry = 0; // 停在某条响应中间的次数
+    for (int round = 0; queue.pendingBytes() > 0 && round < 100000; ++round) {
+        // 读取任意长度，使对端窗口以不规则的大小打开
+        drain(fds[1], received, 1 + rng() % 3000);
+        // 仍有积压时继续入队，新响应排在后面
+        if (round % 50 == 0 && expected.size() < 1000000) enqueue(20);
+        expect(queue.flush(), "flush");
+        if (!boundaries.contains(expected.size() - queue.pendingBytes())) {
+            ++mid_entry;
+        }
+    }
+    expect(queue.pendingBytes() == 0, "所有响应最终发送完毕");
+    expect(mid_entry > 0, "部分写入停在响应中间");
+    drain(fds[1], received, SIZE_MAX);
+    expect(received == expected, "接收到的内容与入队顺序一致");
+
+    // 全部发出后缓冲区被复用，再次入队照常工作
+    queue.push(Response::CMDOK);
+    queue.format("257 \"{}\"\r\n", "/");
+    expect(queue.lastCode() == 257, "lastCode为最后一条响应的状态码");
+    expect(queue.flush() && queue.pendingBytes() == 0, "复用后一次发完");
+    received.clear();
+    drain(fds[1], received, SIZE_MAX);
+    expect(received == std::string(Response::CMDOK) + "257 \"/\"\r\n",
+           "复用后的内容");
+
+    close(fds[0]);
+    close(fds[1]);
+    if (failures == 0) std::cout << "全部通过" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
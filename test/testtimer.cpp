@@ -0,0 +1,106 @@
+// 时间轮的随机化正确性检查：用模拟时钟随机添加、取消定时器，
+// 检查执行时刻、nextTimeout和取消语义
+// 用法: testtimer [定时器数量]
+#include "timerwheel.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using Clock = TimerWheel::Clock;
+using std::chrono::milliseconds;
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    std::cerr << "检查失败: " << what << std::endl;
+    std::exit(1);
+}
+
+// 用模拟时钟随机添加、取消定时器，并在任务中继续添加和取消，
+// 检查每个定时器恰好在到期后的第一次advance中执行
+static void verify(size_t count) {
+    const Clock::time_point origin{};
+    auto at = [&](uint64_t tick) { return origin + milliseconds(tick); };
+    TimerWheel wheel(origin);
+    std::mt19937_64 rng(42);
+    struct Expect {
+        uint64_t due = 0; // 在任务中添加的定时器最早在下一个tick执行
+        TimerWheel::TimerId id;
+        bool cancelled = false;
+        bool fired = false;
+    };
+    std::vector<Expect> timers;
+    uint64_t now = 0;
+    int64_t last = -1; // 上一次advance的时刻
+    auto delay = [&]() -> uint64_t {
+        // 近处、中等、很远的定时器各占一部分，覆盖所有层
+        switch (rng() % 4) {
+        case 0: return rng() % 300;
+        case 1: return rng() % 70'000;
+        case 2: return rng() % 20'000'000;
+        default: return rng() % 3'000'000'000;
+        }
+    };
+    std::function<void(size_t)> fire;
+    auto add = [&](uint64_t expire, uint64_t due) {
+        size_t n = timers.size();
+        timers.push_back({due, {}, false, false});
+        timers[n].id = wheel.add(at(expire), [&fire, n]() { fire(n); });
+    };
+    fire = [&](size_t n) {
+        Expect &t = timers[n];
+        check(!t.cancelled, "已取消的定时器被执行");
+        check(!t.fired, "定时器被执行了两次");
+        check(t.due <= now && int64_t(t.due) > last, "定时器执行时间不对");
+        t.fired = true;
+        // 任务中取消另一个定时器、添加新的定时器
+        if (rng() % 3 == 0) {
+            Expect &other = timers[rng() % timers.size()];
+            if (!other.fired && !other.cancelled) other.cancelled = true;
+            wheel.cancel(other.id);
+        }
+        if (timers.size() < count * 2 && rng() % 2 == 0) {
+            uint64_t expire = now + delay();
+            add(expire, std::max(expire, now + 1));
+        }
+    };
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t expire = delay();
+        add(expire, expire);
+    }
+    for (size_t i = 0; i < count / 3; ++i) {
+        Expect &t = timers[rng() % timers.size()];
+        t.cancelled = true;
+        wheel.cancel(t.id);
+    }
+    wheel.cancel({});
+    while (wheel.size() != 0) {
+        uint64_t earliest = UINT64_MAX;
+        for (const auto &t : timers) {
+            if (!t.fired && !t.cancelled) {
+                earliest = std::min(earliest, t.due);
+            }
+        }
+        int wait = wheel.nextTimeout(at(now));
+        check(wait >= 0, "还有定时器时nextTimeout返回-1");
+        check(now + wait <= std::max(earliest, now),
+              "nextTimeout晚于最早的定时器");
+        now += wait + rng() % 3;
+        wheel.advance(at(now));
+        last = int64_t(now);
+    }
+    for (const auto &t : timers) {
+        check(t.fired != t.cancelled, "定时器既未执行也未取消");
+    }
+    check(wheel.nextTimeout(at(now)) == -1, "没有定时器时nextTimeout应为-1");
+    std::cout << "正确性检查通过: " << timers.size() << "个定时器" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    verify(argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4000);
+    return 0;
+}